@@ -0,0 +1,38 @@
+#ifndef LDP_POOL_H
+#define LDP_POOL_H
+
+#include <vector>
+#include <csm/csm_all.h>
+
+/*
+ * PL-ICP使用的激光数据缓冲池
+ * 预先用ld_alloc_new()分配若干个能容纳max_rays束激光的LDP，按顺序循环使用，
+ * 每帧激光只改写nrays和各个数组的内容，不再分配内存。
+ * 前一帧(m_prevLDP)和当前帧各占用一个缓冲区，所以缓冲区的数量至少为2。
+ */
+class LDPPool
+{
+public:
+    LDPPool();
+    ~LDPPool();
+
+    //预先分配size个缓冲区 每个能容纳max_rays束激光
+    void Init(int size,int max_rays);
+
+    //取下一个缓冲区 并设置为nrays束激光
+    //超过容量时只重新分配这一个缓冲区(它是最早被使用的，已经不再被引用)
+    LDP Get(int nrays);
+
+    //重新分配内存的次数
+    int Realloc_number() const { return realloc_num; }
+
+private:
+    void Release();
+
+    std::vector<LDP> buffers;
+    std::vector<int> capacity;
+    int next;
+    int realloc_num;
+};
+
+#endif
@@ -5,6 +5,27 @@
 #include <eigen3/Eigen/Dense>
 #include <eigen3/Eigen/Core>
 #include <eigen3/Eigen/Householder>
+
+/*
+ * 最小二乘的求解方式
+ * CALIB_SOLVER_BATCH_QR:       保存最近data_len组数据构成的超定方程组A(3*len x 9)，求解时做列主元QR
+ * CALIB_SOLVER_NORMAL_LDLT:    每组数据累加到法方程A^T*A x = A^T*b中，求解时做LDLT
+ * CALIB_SOLVER_INCREMENTAL_QR: 每组数据用Givens旋转更新QR分解的R和Q^T*b，不会平方条件数
+ *
+ * A中每组数据的3行为kron(I3,odom^T)，所以A^T*A = kron(I3,sum(odom*odom^T))，
+ * 9个未知数分成3个共用同一个3x3系数矩阵的子问题，后两种方式只需要保存3x3的矩阵，
+ * 内存和求解时间都和数据的数量无关；它们使用全部的历史数据，而不是最近的data_len组。
+ * CALIB_SOLVER_RLS:            带遗忘因子的递推最小二乘，每组数据直接更新矫正矩阵和协方差，
+ *                              可以跟踪随负载、轮胎磨损缓慢变化的参数
+ */
+enum OdomCalibSolver
+{
+    CALIB_SOLVER_BATCH_QR,
+    CALIB_SOLVER_NORMAL_LDLT,
+    CALIB_SOLVER_INCREMENTAL_QR,
+    CALIB_SOLVER_RLS
+};
+
 class OdomCalib
 {
 
@@ -12,20 +33,51 @@ public:
     OdomCalib(){
         data_len = 0;
         now_len = 0;
+        solver = CALIB_SOLVER_BATCH_QR;
+        lambda = 0.999;
+        set_data_zero();
     }
 
    // virtual ~OdomCalib();
     void Set_data_len(int len);
+    void Set_solver(OdomCalibSolver method);
+    void Set_forgetting_factor(double factor);
     bool Add_Data(Eigen::Vector3d Odom,Eigen::Vector3d scan);
     Eigen::Matrix3d Solve();
     bool is_full();
     void set_data_zero();
 
+    //参与求解的数据的组数
+    int Data_Num() const;
+
+    //里程计数据的3x3信息矩阵sum(odom*odom^T)满秩时 矫正矩阵才能唯一确定
+    bool Is_full_rank() const;
+
+    //矫正矩阵按行展开成9维向量之后的协方差 只有RLS有效
+    Eigen::Matrix<double,9,9> Covariance();
+
 private:
+    void Add_Data_Incremental(const Eigen::Vector3d& Odom,const Eigen::Vector3d& scan);
+    void Add_Data_RLS(const Eigen::Vector3d& Odom,const Eigen::Vector3d& scan);
+
     Eigen::MatrixXd  A;
     Eigen::VectorXd  b;
     int data_len,now_len;
+    OdomCalibSolver solver;
+
+    //法方程: OtO = sum(odom*odom^T)  OtS = sum(odom*scan^T)
+    //RLS只用OtO判断是否满秩 按遗忘因子衰减
+    Eigen::Matrix3d OtO,OtS;
+
+    //增量QR: R为上三角矩阵 QtS = Q^T*[scan]
+    Eigen::Matrix3d R,QtS;
 
+    //RLS: X为矫正矩阵的转置 P为3个子问题共用的逆信息矩阵
+    //J为每个子问题加权的残差平方和 weight为加权的数据数量
+    double lambda;
+    Eigen::Matrix3d X,P;
+    Eigen::Vector3d J;
+    double weight;
 };
 
 #endif
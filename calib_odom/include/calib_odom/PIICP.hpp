@@ -0,0 +1,27 @@
+#ifndef PIICP_H
+#define PIICP_H
+
+#include <eigen3/Eigen/Core>
+#include <csm/csm_all.h>
+
+/*
+ * PL-ICP相关的函数 不依赖ROS，在线标定和离线标定共用
+ */
+
+//设置PL-ICP的参数
+void SetPIICPParams(sm_params& params);
+
+//把激光数据写入ldp 距离不在(0.1,20)之内的激光为无效
+//ldp必须能容纳n束激光(见LDPPool)
+void RangesToLDP(const float* ranges,int n,double angle_min,double angle_inc,LDP ldp);
+
+/*
+ * 求sens在ref坐标系中的位姿，guess为初始值(里程计的增量)
+ * 匹配失败时返回false，rPose为guess
+ * sm_icp会改写ref和sens，所以多线程匹配时每个线程要使用自己的LDP
+ */
+bool PIICPMatch(sm_params& params,LDP ref,LDP sens,
+                const Eigen::Vector3d& guess,Eigen::Vector3d& rPose,
+                sm_result* output = NULL);
+
+#endif
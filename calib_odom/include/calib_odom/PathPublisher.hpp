@@ -0,0 +1,51 @@
+#ifndef PATH_PUBLISHER_H
+#define PATH_PUBLISHER_H
+
+#include <deque>
+#include <string>
+
+#include <ros/ros.h>
+#include <nav_msgs/Path.h>
+#include <geometry_msgs/PoseStamped.h>
+#include <eigen3/Eigen/Core>
+
+/*
+ * 长度有界的路径发布
+ * 和上一个保存的位姿相比，平移小于min_dist并且旋转小于min_angle的位姿不保存(空间抽稀)；
+ * 最多保存max_length个位姿，超过时丢掉最老的位姿。
+ * topic上发布保存的整条路径(长度有界)，topic_segment上只发布新增的一段(上一个位姿和新位姿)，
+ * 需要完整路径的程序可以自己拼接。每次调用的代价和运行的时间无关。
+ */
+class PathPublisher
+{
+public:
+    PathPublisher();
+
+    void Init(ros::NodeHandle& nh,const std::string& topic,const std::string& frame_id,
+              int max_length,double min_dist,double min_angle);
+
+    //加入新的位姿 被保存时返回true
+    //publish为false时不发布，用于一次加入很多位姿，最后再调用Publish()
+    bool AddPose(const Eigen::Vector3d& pose,bool publish = true);
+
+    //清空路径 不发布
+    void Clear();
+
+    //发布整条路径
+    void Publish();
+
+private:
+    geometry_msgs::PoseStamped ToPoseStamped(const Eigen::Vector3d& pose,const ros::Time& stamp);
+
+    ros::Publisher path_pub,segment_pub;
+    std::string frame;
+
+    int max_len;
+    double dist_thresh,angle_thresh;
+
+    std::deque<geometry_msgs::PoseStamped> poses;
+    Eigen::Vector3d last_pose;
+    bool has_last;
+};
+
+#endif
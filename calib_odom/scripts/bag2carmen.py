@@ -0,0 +1,66 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+# 把bag中的激光和里程计导出成carmen的ROBOTLASER1格式 供calib_odom_offline使用
+# 用法: bag2carmen.py <bagfile> <logfile> [scan_topic] [odom_topic]
+# 里程计按照激光的时间戳线性插值，激光前后没有里程计的帧会被丢掉
+
+import sys
+import math
+import bisect
+import rosbag
+
+
+def yaw_from_quaternion(q):
+    return math.atan2(2.0 * (q.w * q.z + q.x * q.y), 1.0 - 2.0 * (q.y * q.y + q.z * q.z))
+
+
+def interpolate(odoms, stamps, t):
+    i = bisect.bisect_left(stamps, t)
+    if i == 0 or i >= len(stamps):
+        return None
+    t0, x0, y0, th0 = odoms[i - 1]
+    t1, x1, y1, th1 = odoms[i]
+    s = (t - t0) / (t1 - t0) if t1 > t0 else 0.0
+    dth = math.atan2(math.sin(th1 - th0), math.cos(th1 - th0))
+    return (x0 + s * (x1 - x0), y0 + s * (y1 - y0), th0 + s * dth)
+
+
+def main():
+    if len(sys.argv) < 3:
+        print("usage: bag2carmen.py <bagfile> <logfile> [scan_topic] [odom_topic]")
+        return 1
+    scan_topic = sys.argv[3] if len(sys.argv) > 3 else "/sick_scan"
+    odom_topic = sys.argv[4] if len(sys.argv) > 4 else "/odom"
+
+    bag = rosbag.Bag(sys.argv[1])
+
+    odoms = []
+    for _, msg, _ in bag.read_messages(topics=[odom_topic]):
+        p = msg.pose.pose
+        odoms.append((msg.header.stamp.to_sec(), p.position.x, p.position.y,
+                      yaw_from_quaternion(p.orientation)))
+    odoms.sort()
+    stamps = [o[0] for o in odoms]
+
+    written = 0
+    with open(sys.argv[2], "w") as out:
+        for _, scan, _ in bag.read_messages(topics=[scan_topic]):
+            t = scan.header.stamp.to_sec()
+            pose = interpolate(odoms, stamps, t)
+            if pose is None:
+                continue
+
+            ranges = ["%.4f" % (0.0 if math.isinf(r) or math.isnan(r) else r) for r in scan.ranges]
+            out.write("ROBOTLASER1 0 %f %f %f %f 0 0 %d %s 0 0 0 0 %f %f %f 0 0 0 0 0 %f bag2carmen %f\n" %
+                      (scan.angle_min, scan.angle_max - scan.angle_min, scan.angle_increment,
+                       scan.range_max, len(ranges), " ".join(ranges),
+                       pose[0], pose[1], pose[2], t, t))
+            written += 1
+
+    bag.close()
+    print("%d scans written" % written)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
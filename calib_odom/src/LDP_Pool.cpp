@@ -0,0 +1,66 @@
+#include "../include/calib_odom/LDP_Pool.hpp"
+
+
+LDPPool::LDPPool()
+{
+    next = 0;
+    realloc_num = 0;
+}
+
+LDPPool::~LDPPool()
+{
+    Release();
+}
+
+void LDPPool::Release()
+{
+    for(size_t i = 0; i < buffers.size(); i++)
+    {
+        if(buffers[i] != NULL)
+            ld_free(buffers[i]);
+    }
+    buffers.clear();
+    capacity.clear();
+}
+
+void LDPPool::Init(int size,int max_rays)
+{
+    Release();
+
+    if(size < 2)
+        size = 2;
+
+    buffers.resize(size,NULL);
+    capacity.resize(size,0);
+    for(int i = 0; i < size; i++)
+    {
+        if(max_rays > 0)
+        {
+            buffers[i] = ld_alloc_new(max_rays);
+            capacity[i] = max_rays;
+        }
+    }
+    next = 0;
+}
+
+LDP LDPPool::Get(int nrays)
+{
+    if(buffers.empty())
+        Init(2,nrays);
+
+    int idx = next;
+    next = (next + 1) % buffers.size();
+
+    if(capacity[idx] < nrays)
+    {
+        if(buffers[idx] != NULL)
+            ld_free(buffers[idx]);
+        buffers[idx] = ld_alloc_new(nrays);
+        capacity[idx] = nrays;
+        realloc_num++;
+    }
+
+    LDP ldp = buffers[idx];
+    ldp->nrays = nrays;
+    return ldp;
+}
@@ -1,14 +1,46 @@
 #include "../include/calib_odom/Odom_Calib.hpp"
+#include <algorithm>
 
 
 //设置数据长度,即多少数据计算一次
 void OdomCalib::Set_data_len(int len)
 {
     data_len = len;
-    A.conservativeResize(len*3,9);
-    b.conservativeResize(len*3);
-    A.setZero();
-    b.setZero();
+
+    //只有批量QR需要保存数据
+    if(solver == CALIB_SOLVER_BATCH_QR)
+    {
+        A.conservativeResize(len*3,9);
+        b.conservativeResize(len*3);
+        A.setZero();
+        b.setZero();
+    }
+}
+
+//设置遗忘因子 1表示不遗忘 数据的有效长度约为1/(1-factor)
+void OdomCalib::Set_forgetting_factor(double factor)
+{
+    if(factor <= 0.0 || factor > 1.0)
+        factor = 1.0;
+    lambda = factor;
+}
+
+//设置求解方式 会清空已有的数据
+void OdomCalib::Set_solver(OdomCalibSolver method)
+{
+    solver = method;
+    now_len = 0;
+
+    if(solver == CALIB_SOLVER_BATCH_QR)
+    {
+        Set_data_len(data_len);
+    }
+    else
+    {
+        A.resize(0,9);
+        b.resize(0);
+    }
+    set_data_zero();
 }
 
 
@@ -25,6 +57,26 @@ bool OdomCalib::Add_Data(Eigen::Vector3d Odom,Eigen::Vector3d scan)
 
     if(now_len<INT_MAX)
     {
+        if(solver == CALIB_SOLVER_NORMAL_LDLT)
+        {
+            OtO += Odom * Odom.transpose();
+            OtS += Odom * scan.transpose();
+            now_len++;
+            return true;
+        }
+        else if(solver == CALIB_SOLVER_INCREMENTAL_QR)
+        {
+            Add_Data_Incremental(Odom,scan);
+            now_len++;
+            return true;
+        }
+        else if(solver == CALIB_SOLVER_RLS)
+        {
+            Add_Data_RLS(Odom,scan);
+            now_len++;
+            return true;
+        }
+
         //TODO: 构建超定方程组
         A(now_len%data_len*3,0)=Odom(0);
         A(now_len%data_len*3,1)=Odom(1);
@@ -49,6 +101,67 @@ bool OdomCalib::Add_Data(Eigen::Vector3d Odom,Eigen::Vector3d scan)
         return false;
     }
 }
+/*
+ * 用Givens旋转把新的一行[odom^T | scan^T]合并到R和QtS中
+ * 依次消去新行的第j个元素，每组数据O(27)次乘加
+*/
+void OdomCalib::Add_Data_Incremental(const Eigen::Vector3d& Odom,const Eigen::Vector3d& scan)
+{
+    Eigen::Vector3d row = Odom;
+    Eigen::Vector3d rhs = scan;
+
+    for(int j = 0; j < 3; j++)
+    {
+        if(row(j) == 0.0)
+            continue;
+
+        double r = hypot(R(j,j),row(j));
+        double c = R(j,j) / r;
+        double s = row(j) / r;
+
+        for(int k = j; k < 3; k++)
+        {
+            double a = R(j,k);
+            R(j,k) = c * a + s * row(k);
+            row(k) = -s * a + c * row(k);
+        }
+        for(int k = 0; k < 3; k++)
+        {
+            double a = QtS(j,k);
+            QtS(j,k) = c * a + s * rhs(k);
+            rhs(k) = -s * a + c * rhs(k);
+        }
+    }
+}
+
+/*
+ * 递推最小二乘
+ * 3个子问题的系数相同，共用增益k和P:
+ *   k = P*odom / (lambda + odom^T*P*odom)
+ *   X = X + k*(scan^T - odom^T*X)
+ *   P = (P - k*odom^T*P) / lambda
+ * 总共只有几十次乘加
+*/
+void OdomCalib::Add_Data_RLS(const Eigen::Vector3d& Odom,const Eigen::Vector3d& scan)
+{
+    Eigen::Vector3d Po = P * Odom;
+    double denom = lambda + Odom.dot(Po);
+    Eigen::Vector3d k = Po / denom;
+
+    //先验残差
+    Eigen::Vector3d e = scan - X.transpose() * Odom;
+
+    X += k * e.transpose();
+    P = (P - k * Po.transpose()) / lambda;
+    P = 0.5 * (P + P.transpose());
+
+    //J_n = lambda*J_{n-1} + e_prior*e_post  e_post = e_prior*lambda/denom
+    J = lambda * J + e.cwiseProduct(e) * (lambda / denom);
+    weight = lambda * weight + 1.0;
+
+    OtO = lambda * OtO + Odom * Odom.transpose();
+}
+
 /* 用于判断数据是否满
  * 数据满即可以进行最小二乘计算
 */
@@ -62,6 +175,43 @@ bool OdomCalib::is_full()
     else
         return false;
 }
+//参与求解的数据的组数 批量QR最多保存data_len组
+int OdomCalib::Data_Num() const
+{
+    if(solver == CALIB_SOLVER_BATCH_QR)
+        return std::min(now_len,data_len);
+    return now_len;
+}
+
+/*
+ * 判断里程计数据的信息矩阵是否满秩
+ * 例如只走直线的时候odom的y和theta分量都接近0 解出来的矩阵没有意义
+ * 条件数超过1e6认为不满秩
+*/
+bool OdomCalib::Is_full_rank() const
+{
+    Eigen::Matrix3d info;
+
+    if(solver == CALIB_SOLVER_INCREMENTAL_QR)
+        info = R.transpose() * R;
+    else if(solver == CALIB_SOLVER_BATCH_QR)
+    {
+        //A中每组数据的第1行的前3列就是odom^T
+        info.setZero();
+        for(int i = 0; i < Data_Num(); i++)
+        {
+            Eigen::Vector3d odom = A.block<1,3>(3*i,0).transpose();
+            info += odom * odom.transpose();
+        }
+    }
+    else
+        info = OtO;
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigen(info);
+    Eigen::Vector3d values = eigen.eigenvalues();
+    return values(2) > 0.0 && values(0) > 1e-6 * values(2);
+}
+
 /* 解最小二乘
  * 返回最小二乘矩阵
 */
@@ -69,6 +219,34 @@ Eigen::Matrix3d OdomCalib::Solve()
 {
     Eigen::Matrix3d correct_matrix;
 
+    if(solver == CALIB_SOLVER_NORMAL_LDLT)
+    {
+        //OtO * X = OtS  X的第i列为矫正矩阵的第i行
+        Eigen::LDLT<Eigen::Matrix3d> ldlt(OtO);
+        if(ldlt.info() == Eigen::Success && ldlt.isPositive() &&
+           ldlt.vectorD().minCoeff() > 1e-12 * ldlt.vectorD().maxCoeff())
+            correct_matrix = ldlt.solve(OtS).transpose();
+        else
+            correct_matrix = OtO.colPivHouseholderQr().solve(OtS).transpose();
+
+        return correct_matrix;
+    }
+    else if(solver == CALIB_SOLVER_RLS)
+    {
+        return X.transpose();
+    }
+    else if(solver == CALIB_SOLVER_INCREMENTAL_QR)
+    {
+        //|Ax-b|^2 = |Rx-QtS|^2 + const  R满秩时直接回代
+        double max_diag = R.diagonal().cwiseAbs().maxCoeff();
+        if(R.diagonal().cwiseAbs().minCoeff() > 1e-9 * max_diag)
+            correct_matrix = R.triangularView<Eigen::Upper>().solve(QtS).transpose();
+        else
+            correct_matrix = R.colPivHouseholderQr().solve(QtS).transpose();
+
+        return correct_matrix;
+    }
+
     //TODO:求解线性最小二乘
     Eigen::VectorXd correct_vector =  A.colPivHouseholderQr().solve(b);
 
@@ -87,4 +265,31 @@ void OdomCalib::set_data_zero()
 {
     A.setZero();
     b.setZero();
+    OtO.setZero();
+    OtS.setZero();
+    R.setZero();
+    QtS.setZero();
+
+    //初始认为里程计是准的 初始协方差取得很大
+    X.setIdentity();
+    P = Eigen::Matrix3d::Identity() * 1e6;
+    J.setZero();
+    weight = 0.0;
+}
+
+/*
+ * 第i行的协方差为 sigma_i^2 * P，不同行之间认为不相关
+*/
+Eigen::Matrix<double,9,9> OdomCalib::Covariance()
+{
+    Eigen::Matrix<double,9,9> cov = Eigen::Matrix<double,9,9>::Zero();
+    if(solver != CALIB_SOLVER_RLS || weight <= 3.0)
+        return cov;
+
+    for(int i = 0; i < 3; i++)
+    {
+        double sigma2 = J(i) / (weight - 3.0);
+        cov.block<3,3>(3*i,3*i) = sigma2 * P;
+    }
+    return cov;
 }
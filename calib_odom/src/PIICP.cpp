@@ -0,0 +1,138 @@
+#include "../include/calib_odom/PIICP.hpp"
+
+
+//设置PL-ICP的参数
+void SetPIICPParams(sm_params& params)
+{
+    //设置激光的范围
+    params.min_reading = 0.1;
+    params.max_reading = 20;
+
+    //设置位姿最大的变化范围
+    params.max_angular_correction_deg = 20.0;
+    params.max_linear_correction = 1;
+
+    //设置迭代停止的条件
+    params.max_iterations = 50;
+    params.epsilon_xy = 0.000001;
+    params.epsilon_theta = 0.0000001;
+
+    //设置correspondence相关参数
+    params.max_correspondence_dist = 1;
+    params.sigma = 0.01;
+    params.use_corr_tricks = 1;
+
+    //设置restart过程，因为不需要restart所以可以不管
+    params.restart = 0;
+    params.restart_threshold_mean_error = 0.01;
+    params.restart_dt = 1.0;
+    params.restart_dtheta = 0.1;
+
+    //设置聚类参数
+    params.clustering_threshold = 0.2;
+
+    //用最近的10个点来估计方向
+    params.orientation_neighbourhood = 10;
+
+    //设置使用PI-ICP
+    params.use_point_to_line_distance = 1;
+
+    //不进行alpha_test
+    params.do_alpha_test = 0;
+    params.do_alpha_test_thresholdDeg = 5;
+
+    //设置trimmed参数 用来进行outlier remove
+    params.outliers_maxPerc = 0.9;
+    params.outliers_adaptive_order = 0.7;
+    params.outliers_adaptive_mult = 2.0;
+
+    //进行visibility_test 和 remove double
+    params.do_visibility_test = 1;
+    params.outliers_remove_doubles = 1;
+    params.do_compute_covariance = 0;
+    params.debug_verify_tricks = 0;
+    params.use_ml_weights = 0;
+    params.use_sigma_weights = 0;
+}
+
+
+void RangesToLDP(const float* ranges,int n,double angle_min,double angle_inc,LDP ldp)
+{
+    for(int i = 0;i < n;i++)
+    {
+        double dist = ranges[i];
+        if(dist > 0.1 && dist < 20)
+        {
+            ldp->valid[i] = 1;
+            ldp->readings[i] = dist;
+        }
+        else
+        {
+            ldp->valid[i] = 0;
+            ldp->readings[i] = -1;
+        }
+        ldp->theta[i] = angle_min+angle_inc*i;
+
+        //缓冲区被上一次的匹配改写过 恢复成ld_alloc_new()之后的状态
+        ldp->cluster[i] = -1;
+        ldp->alpha_valid[i] = 0;
+        ldp->corr[i].valid = 0;
+    }
+    ldp->nrays = n;
+    ldp->min_theta = ldp->theta[0];
+    ldp->max_theta = ldp->theta[n-1];
+
+    ldp->odometry[0] = 0.0;
+    ldp->odometry[1] = 0.0;
+    ldp->odometry[2] = 0.0;
+
+    ldp->true_pose[0] = 0.0;
+    ldp->true_pose[1] = 0.0;
+    ldp->true_pose[2] = 0.0;
+}
+
+bool PIICPMatch(sm_params& params,LDP ref,LDP sens,
+                const Eigen::Vector3d& guess,Eigen::Vector3d& rPose,
+                sm_result* output)
+{
+    ref->odometry[0] = 0.0;
+    ref->odometry[1] = 0.0;
+    ref->odometry[2] = 0.0;
+
+    ref->estimate[0] = 0.0;
+    ref->estimate[1] = 0.0;
+    ref->estimate[2] = 0.0;
+
+    ref->true_pose[0] = 0.0;
+    ref->true_pose[1] = 0.0;
+    ref->true_pose[2] = 0.0;
+
+    //设置匹配的参数值
+    params.laser_ref = ref;
+    params.laser_sens = sens;
+
+    params.first_guess[0] = guess(0);
+    params.first_guess[1] = guess(1);
+    params.first_guess[2] = guess(2);
+
+    sm_result result;
+    result.cov_x_m = 0;
+    result.dx_dy1_m = 0;
+    result.dx_dy2_m = 0;
+
+    sm_icp(&params,&result);
+    if(output != NULL)
+        *output = result;
+
+    //nowPose在lastPose中的坐标
+    if(result.valid)
+    {
+        rPose(0) = result.x[0];
+        rPose(1) = result.x[1];
+        rPose(2) = result.x[2];
+        return true;
+    }
+
+    rPose = guess;
+    return false;
+}
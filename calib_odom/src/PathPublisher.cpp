@@ -0,0 +1,92 @@
+#include "../include/calib_odom/PathPublisher.hpp"
+
+#include <cmath>
+#include <tf/transform_datatypes.h>
+
+
+PathPublisher::PathPublisher()
+{
+    max_len = 1;
+    dist_thresh = 0.0;
+    angle_thresh = 0.0;
+    has_last = false;
+}
+
+void PathPublisher::Init(ros::NodeHandle& nh,const std::string& topic,const std::string& frame_id,
+                         int max_length,double min_dist,double min_angle)
+{
+    path_pub = nh.advertise<nav_msgs::Path>(topic,1,true);
+    segment_pub = nh.advertise<nav_msgs::Path>(topic + "_segment",10);
+    frame = frame_id;
+
+    max_len = max_length < 2 ? 2 : max_length;
+    dist_thresh = min_dist;
+    angle_thresh = min_angle;
+
+    Clear();
+}
+
+void PathPublisher::Clear()
+{
+    poses.clear();
+    has_last = false;
+}
+
+geometry_msgs::PoseStamped PathPublisher::ToPoseStamped(const Eigen::Vector3d& pose,const ros::Time& stamp)
+{
+    geometry_msgs::PoseStamped this_pose_stamped;
+    this_pose_stamped.pose.position.x = pose(0);
+    this_pose_stamped.pose.position.y = pose(1);
+    this_pose_stamped.pose.orientation = tf::createQuaternionMsgFromYaw(pose(2));
+
+    this_pose_stamped.header.stamp = stamp;
+    this_pose_stamped.header.frame_id = frame;
+    return this_pose_stamped;
+}
+
+bool PathPublisher::AddPose(const Eigen::Vector3d& pose,bool publish)
+{
+    //空间抽稀
+    if(has_last)
+    {
+        double dist = hypot(pose(0) - last_pose(0),pose(1) - last_pose(1));
+        double angle = fabs(atan2(sin(pose(2) - last_pose(2)),cos(pose(2) - last_pose(2))));
+        if(dist < dist_thresh && angle < angle_thresh)
+            return false;
+    }
+
+    ros::Time stamp = ros::Time::now();
+    geometry_msgs::PoseStamped new_pose = ToPoseStamped(pose,stamp);
+
+    //新增的一段
+    if(publish)
+    {
+        nav_msgs::Path segment;
+        segment.header.stamp = stamp;
+        segment.header.frame_id = frame;
+        if(!poses.empty())
+            segment.poses.push_back(poses.back());
+        segment.poses.push_back(new_pose);
+        segment_pub.publish(segment);
+    }
+
+    poses.push_back(new_pose);
+    if((int)poses.size() > max_len)
+        poses.pop_front();
+
+    last_pose = pose;
+    has_last = true;
+
+    if(publish)
+        Publish();
+    return true;
+}
+
+void PathPublisher::Publish()
+{
+    nav_msgs::Path path;
+    path.header.stamp = ros::Time::now();
+    path.header.frame_id = frame;
+    path.poses.assign(poses.begin(),poses.end());
+    path_pub.publish(path);
+}
@@ -0,0 +1,396 @@
+/*
+ * 离线的里程计标定 不依赖ROS
+ * 从carmen格式的日志(FLASER / ROBOTLASER1，bag可以用scripts/bag2carmen.py导出)中读取激光和里程计，
+ * 按照和在线标定相同的条件选出关键帧，所有相邻关键帧之间的PL-ICP相互独立，用多个线程并行计算，
+ * 最后求解OdomCalib并输出标定前后的残差。
+ *
+ * 用法: calib_odom_offline [options] <logfile>
+ *   -threads <n>     匹配线程的数量，默认为CPU的核数
+ *   -solver <name>   batch_qr / normal_ldlt / incremental_qr(默认) / rls
+ *   -res <deg>       FLASER的角度分辨率，默认根据激光的数量推断
+ *   -min_dist <m>    关键帧之间的最小平移，默认0.05
+ *   -min_angle <deg> 关键帧之间的最小旋转，默认5
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <sys/time.h>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "../include/calib_odom/Odom_Calib.hpp"
+#include "../include/calib_odom/LDP_Pool.hpp"
+#include "../include/calib_odom/PIICP.hpp"
+
+using namespace std;
+
+static double GetTime()
+{
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+//now在prev坐标系中的位姿 和cal_delta_distence()相同
+static Eigen::Vector3d RelativePose(const Eigen::Vector3d& prev,const Eigen::Vector3d& now)
+{
+    double c = cos(prev(2)), s = sin(prev(2));
+    double dx = now(0) - prev(0);
+    double dy = now(1) - prev(1);
+
+    Eigen::Vector3d d_pos;
+    d_pos(0) =  c * dx + s * dy;
+    d_pos(1) = -s * dx + c * dy;
+    d_pos(2) = atan2(sin(now(2) - prev(2)),cos(now(2) - prev(2)));
+    return d_pos;
+}
+
+/////////////////////////////////////////////读取日志/////////////////////////////////////////////
+
+struct LogScan
+{
+    double timestamp;
+    Eigen::Vector3d odom;
+    double angle_min;
+    double angle_inc;
+    std::vector<float> ranges;
+};
+
+struct OfflineParams
+{
+    int threads;
+    std::string solver;
+    double flaser_res;
+    double min_dist;
+    double min_angle;
+};
+
+//FLASER中没有角度信息 和gmapping读取carmen日志的方式相同，根据激光的数量推断分辨率
+static double FlaserResolution(int n,double res_deg)
+{
+    if(res_deg > 0.0)
+        return res_deg * M_PI / 180.0;
+    if(n == 180 || n == 181)
+        return M_PI / 180.0;
+    if(n == 360 || n == 361 || n == 540 || n == 541)
+        return 0.5 * M_PI / 180.0;
+    return M_PI / (n - 1);
+}
+
+/*
+ * FLASER n r1..rn x y theta odom_x odom_y odom_theta timestamp hostname logger_timestamp
+ * ROBOTLASER1 type start_angle fov res max_range accuracy remission_mode n r1..rn
+ *             m e1..em laser_x laser_y laser_theta robot_x robot_y robot_theta ... timestamp ...
+ */
+static bool ParseLine(const std::string& line,const OfflineParams& params,LogScan& scan)
+{
+    std::istringstream is(line);
+    std::string tag;
+    is >> tag;
+
+    int n = 0;
+    if(tag == "FLASER")
+    {
+        is >> n;
+        if(!is || n < 2)
+            return false;
+
+        scan.ranges.resize(n);
+        for(int i = 0; i < n; i++)
+            is >> scan.ranges[i];
+
+        double laser_x,laser_y,laser_theta;
+        is >> laser_x >> laser_y >> laser_theta;
+        is >> scan.odom(0) >> scan.odom(1) >> scan.odom(2) >> scan.timestamp;
+
+        scan.angle_inc = FlaserResolution(n,params.flaser_res);
+        scan.angle_min = -0.5 * (n - 1) * scan.angle_inc;
+    }
+    else if(tag == "ROBOTLASER1")
+    {
+        int laser_type,remission_mode,m;
+        double fov,max_range,accuracy;
+        is >> laser_type >> scan.angle_min >> fov >> scan.angle_inc
+           >> max_range >> accuracy >> remission_mode >> n;
+        if(!is || n < 2)
+            return false;
+
+        scan.ranges.resize(n);
+        for(int i = 0; i < n; i++)
+            is >> scan.ranges[i];
+
+        is >> m;
+        double remission;
+        for(int i = 0; i < m; i++)
+            is >> remission;
+
+        double laser_x,laser_y,laser_theta;
+        double tv,rv,forward_safety_dist,side_safety_dist,turn_axis;
+        is >> laser_x >> laser_y >> laser_theta;
+        is >> scan.odom(0) >> scan.odom(1) >> scan.odom(2);
+        is >> tv >> rv >> forward_safety_dist >> side_safety_dist >> turn_axis >> scan.timestamp;
+    }
+    else
+    {
+        return false;
+    }
+
+    return !is.fail();
+}
+
+/*
+ * 读取日志 只保留关键帧
+ * 和在线标定一样，相对上一个关键帧的平移或旋转足够大的时候才作为新的关键帧
+ */
+static bool ReadLog(const std::string& file,const OfflineParams& params,
+                    std::vector<LogScan>& keyframes,int& scan_number)
+{
+    std::ifstream in(file.c_str());
+    if(!in)
+    {
+        std::cerr <<"Cannot open log file:"<<file<<std::endl;
+        return false;
+    }
+
+    keyframes.clear();
+    scan_number = 0;
+
+    std::string line;
+    LogScan scan;
+    while(std::getline(in,line))
+    {
+        if(!ParseLine(line,params,scan))
+            continue;
+        scan_number++;
+
+        if(!keyframes.empty())
+        {
+            Eigen::Vector3d d = RelativePose(keyframes.back().odom,scan.odom);
+            if(fabs(d(0)) < params.min_dist &&
+               fabs(d(1)) < params.min_dist &&
+               fabs(d(2)) < params.min_angle)
+                continue;
+        }
+        keyframes.push_back(scan);
+    }
+    return true;
+}
+
+/////////////////////////////////////////////并行匹配/////////////////////////////////////////////
+
+struct PairResult
+{
+    Eigen::Vector3d d_point_odom;
+    Eigen::Vector3d d_point_scan;
+    bool valid;
+};
+
+/*
+ * 匹配线程 从共享的计数器中依次取相邻关键帧对
+ * 每个线程有自己的PL-ICP参数和LDP缓冲区：sm_icp会改写参考帧，
+ * 同一个关键帧同时是两个帧对的参考帧和当前帧，不能在线程之间共享
+ */
+class MatchWorker
+{
+public:
+    MatchWorker(const std::vector<LogScan>* keyframes,
+                std::vector<PairResult>* results,
+                int* next,
+                boost::mutex* mutex)
+        : keyframes_(keyframes),results_(results),next_(next),mutex_(mutex)
+    {
+    }
+
+    void operator()()
+    {
+        sm_params params;
+        SetPIICPParams(params);
+
+        int max_beams = 0;
+        for(size_t i = 0; i < keyframes_->size(); i++)
+            max_beams = std::max(max_beams,(int)(*keyframes_)[i].ranges.size());
+
+        LDPPool pool;
+        pool.Init(2,max_beams);
+
+        while(true)
+        {
+            int k;
+            {
+                boost::mutex::scoped_lock lock(*mutex_);
+                k = (*next_)++;
+            }
+            if(k + 1 >= (int)keyframes_->size())
+                break;
+
+            const LogScan& prev = (*keyframes_)[k];
+            const LogScan& now = (*keyframes_)[k + 1];
+
+            LDP ref = pool.Get(prev.ranges.size());
+            RangesToLDP(&prev.ranges[0],prev.ranges.size(),prev.angle_min,prev.angle_inc,ref);
+            LDP sens = pool.Get(now.ranges.size());
+            RangesToLDP(&now.ranges[0],now.ranges.size(),now.angle_min,now.angle_inc,sens);
+
+            PairResult& result = (*results_)[k];
+            result.d_point_odom = RelativePose(prev.odom,now.odom);
+            result.valid = PIICPMatch(params,ref,sens,result.d_point_odom,result.d_point_scan);
+        }
+    }
+
+private:
+    const std::vector<LogScan>* keyframes_;
+    std::vector<PairResult>* results_;
+    int* next_;
+    boost::mutex* mutex_;
+};
+
+static void MatchPairs(const std::vector<LogScan>& keyframes,int threads,std::vector<PairResult>& results)
+{
+    results.clear();
+    if(keyframes.size() < 2)
+        return;
+    results.resize(keyframes.size() - 1);
+
+    int next = 0;
+    boost::mutex mutex;
+    boost::thread_group group;
+    for(int i = 0; i < threads; i++)
+        group.create_thread(MatchWorker(&keyframes,&results,&next,&mutex));
+    group.join_all();
+}
+
+/////////////////////////////////////////////求解&残差/////////////////////////////////////////////
+
+static void PrintResidual(const char* name,const std::vector<PairResult>& results,const Eigen::Matrix3d& correct_matrix)
+{
+    Eigen::Vector3d sum_sq = Eigen::Vector3d::Zero();
+    Eigen::Vector3d max_abs = Eigen::Vector3d::Zero();
+    int n = 0;
+
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        if(!results[i].valid)
+            continue;
+
+        Eigen::Vector3d e = results[i].d_point_scan - correct_matrix * results[i].d_point_odom;
+        sum_sq += e.cwiseProduct(e);
+        max_abs = max_abs.cwiseMax(e.cwiseAbs());
+        n++;
+    }
+    if(n == 0)
+        return;
+
+    Eigen::Vector3d rms = (sum_sq / n).cwiseSqrt();
+    printf("%-18s rms x %.5f m  y %.5f m  theta %.5f rad | max x %.5f m  y %.5f m  theta %.5f rad\n",
+           name,rms(0),rms(1),rms(2),max_abs(0),max_abs(1),max_abs(2));
+}
+
+static void PrintUsage(const char* name)
+{
+    std::cerr <<"usage: "<<name<<" [-threads n] [-solver batch_qr|normal_ldlt|incremental_qr|rls]"
+              <<" [-res deg] [-min_dist m] [-min_angle deg] <logfile>"<<std::endl;
+}
+
+int main(int argc,char** argv)
+{
+    OfflineParams params;
+    params.threads = boost::thread::hardware_concurrency();
+    params.solver = "incremental_qr";
+    params.flaser_res = 0.0;
+    params.min_dist = 0.05;
+    params.min_angle = 5.0 * M_PI / 180.0;
+
+    std::string file;
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i],"-threads") && i + 1 < argc)
+            params.threads = atoi(argv[++i]);
+        else if(!strcmp(argv[i],"-solver") && i + 1 < argc)
+            params.solver = argv[++i];
+        else if(!strcmp(argv[i],"-res") && i + 1 < argc)
+            params.flaser_res = atof(argv[++i]);
+        else if(!strcmp(argv[i],"-min_dist") && i + 1 < argc)
+            params.min_dist = atof(argv[++i]);
+        else if(!strcmp(argv[i],"-min_angle") && i + 1 < argc)
+            params.min_angle = atof(argv[++i]) * M_PI / 180.0;
+        else if(argv[i][0] != '-' && file.empty())
+            file = argv[i];
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if(file.empty())
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if(params.threads < 1)
+        params.threads = 1;
+
+    //读取日志
+    double t0 = GetTime();
+    std::vector<LogScan> keyframes;
+    int scan_number;
+    if(!ReadLog(file,params,keyframes,scan_number))
+        return 1;
+    double t1 = GetTime();
+    printf("scans %d  keyframes %d  read %.2f s\n",scan_number,(int)keyframes.size(),t1 - t0);
+
+    if(keyframes.size() < 2)
+    {
+        std::cerr <<"Not enough keyframes for calibration"<<std::endl;
+        return 1;
+    }
+
+    //并行匹配
+    std::vector<PairResult> results;
+    MatchPairs(keyframes,params.threads,results);
+    double t2 = GetTime();
+
+    int failed = 0;
+    for(size_t i = 0; i < results.size(); i++)
+        if(!results[i].valid)
+            failed++;
+    printf("pairs %d  icp failed %d  threads %d  match %.2f s (%.2f ms/pair)\n",
+           (int)results.size(),failed,params.threads,t2 - t1,1000.0 * (t2 - t1) / results.size());
+
+    //按顺序构造最小二乘 匹配失败的帧对不参与标定
+    OdomCalib calib;
+    if(params.solver == "batch_qr")
+        calib.Set_solver(CALIB_SOLVER_BATCH_QR);
+    else if(params.solver == "normal_ldlt")
+        calib.Set_solver(CALIB_SOLVER_NORMAL_LDLT);
+    else if(params.solver == "rls")
+        calib.Set_solver(CALIB_SOLVER_RLS);
+    else
+        calib.Set_solver(CALIB_SOLVER_INCREMENTAL_QR);
+    calib.Set_data_len(results.size());
+    calib.set_data_zero();
+
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        if(results[i].valid)
+            calib.Add_Data(results[i].d_point_odom,results[i].d_point_scan);
+    }
+    Eigen::Matrix3d correct_matrix = calib.Solve();
+    double t3 = GetTime();
+
+    std::cout <<"correct_matrix:"<<std::endl<<correct_matrix<<std::endl;
+    printf("solve %.3f s  total %.2f s\n",t3 - t2,t3 - t0);
+
+    PrintResidual("before calibration",results,Eigen::Matrix3d::Identity());
+    PrintResidual("after calibration",results,correct_matrix);
+
+    return 0;
+}
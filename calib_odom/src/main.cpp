@@ -1,6 +1,7 @@
 #include <string>
 #include "ros/ros.h"
 #include "std_msgs/String.h"
+#include "std_msgs/Float64MultiArray.h"
 #include <sensor_msgs/JointState.h>
 #include <nav_core/recovery_behavior.h>
 #include <tf/transform_broadcaster.h>
@@ -14,6 +15,10 @@
 #include "stdio.h"
 #include "boost/asio.hpp"   //包含boost库函数
 #include "boost/bind.hpp"
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <deque>
 #include "math.h"
 #include <message_filters/subscriber.h>
 #include <message_filters/synchronizer.h>
@@ -33,6 +38,9 @@
 #include <eigen3/Eigen/Dense>
 
 #include "../include/calib_odom/Odom_Calib.hpp"
+#include "../include/calib_odom/LDP_Pool.hpp"
+#include "../include/calib_odom/PIICP.hpp"
+#include "../include/calib_odom/PathPublisher.hpp"
 
 #include <csm/csm_all.h>
 
@@ -54,9 +62,11 @@ class Scan2
 {
 public:
     Scan2();
+    ~Scan2();
 
     //进行PI-ICP需要的变量
     LDP m_prevLDP;
+    LDPPool m_LDPPool;
     sm_params m_PIICPParams;
     sm_result m_OutputResult;
 
@@ -65,7 +75,12 @@ public:
     Eigen::Vector3d odom_pos_cal;
 
 
-    std::vector<Eigen::Vector3d> odom_increments;          //用来储存两帧之间的里程计的增量
+    //离线标定时储存两帧之间的里程计的增量 收到calib_flag的时候用矫正矩阵重新计算路径
+    //只保留最近path_max_length_组 increments_start_为其中第一组增量之前的里程计位姿
+    //在线标定时矫正之后的路径是增量地计算的 不保存增量
+    std::deque<Eigen::Vector3d> odom_increments;
+    Eigen::Vector3d increments_start_;
+    int path_max_length_;
 
     std::string odom_frame_;
     std::string base_frame_;
@@ -75,32 +90,64 @@ public:
 
     ros::Subscriber calib_flag_sub_;
 
-    ros::Publisher odom_path_pub_,scan_path_pub_,calib_path_pub_;
+    //长度有界的路径发布
+    PathPublisher odom_path_,scan_path_,calib_path_;
+    Eigen::Vector3d calib_pos_cal;
+
+    //在线标定 定时发布矫正矩阵和协方差
+    //数据少于min_calib_samples_组或者不满秩的时候不发布 数据没有变化的时候也不重新求解
+    bool online_calib_;
+    int min_calib_samples_;
+    unsigned long calib_data_num_,published_data_num_;
+    ros::Timer calib_timer_;
+    ros::Publisher calib_matrix_pub_,calib_covariance_pub_;
 
-    nav_msgs::Path path_odom,path_scan;
     ros::Time current_time;
 
     //进行时间同步
     message_filters::Subscriber<sensor_msgs::LaserScan>* scan_filter_sub_;
     tf::MessageFilter<sensor_msgs::LaserScan>* scan_filter_;
 
+    //匹配线程 回调函数只查询里程计，PL-ICP、路径积分和发布都在匹配线程中进行
+    struct ScanJob
+    {
+        sensor_msgs::LaserScan::ConstPtr scan;
+        Eigen::Vector3d d_point_odom;
+    };
+    std::deque<ScanJob> match_queue_;
+    int match_queue_size_;
+    boost::mutex match_mutex_;
+    boost::condition_variable match_cond_;
+    bool match_stop_;
+    boost::thread* match_thread_;
+
+    //dropped: 匹配队列满被丢掉的激光(它的里程计增量合并到下一帧中，不会丢失数据)
+    //overrun: 在tf的MessageFilter中就被丢掉的激光
+    unsigned long dropped_num_,overrun_num_,matched_num_;
+
+    //保护Odom_calib和odom_increments
+    boost::mutex calib_mutex_;
+
+    void MatchThread();
+    void processScan(const ScanJob& job);
+    void scanFilterFailure(const sensor_msgs::LaserScan::ConstPtr& scan,
+                           tf::filter_failure_reasons::FilterFailureReason reason);
+    //total为false时每5秒最多输出一次当前的计数 为true时输出总数 在退出的时候调用
+    void printMatchStatistics(bool total = false);
+
     void CalibFlagCallBack(const std_msgs::Empty &msg);
 
+    void PublishCalibCallBack(const ros::TimerEvent& event);
+
     //回调函数
     void scanCallBack(const sensor_msgs::LaserScan::ConstPtr&scan2);
 
     //tf树查询里程计位姿
     bool getOdomPose(Eigen::Vector3d& pose, const ros::Time& t);
 
-    //发布odom & laser path
-    void pub_msg( Eigen::Vector3d& pose,nav_msgs::Path &path,ros::Publisher &mcu_path_pub_);
-
-    //为了发布correct path
-    void publishPathEigen(std::vector<Eigen::Vector3d>& path_eigen,ros::Publisher& path_pub_);
-
     //进行pl-icp的相关函数.
     void SetPIICPParams();
-    void LaserScanToLDP(sensor_msgs::LaserScan *pScan,
+    void LaserScanToLDP(const sensor_msgs::LaserScan *pScan,
                                  LDP& ldp);
     Eigen::Vector3d  PIICPBetweenTwoFrames(LDP& currentLDPScan,
                                            Eigen::Vector3d tmprPose);
@@ -111,59 +158,6 @@ public:
 
 Eigen::Vector3d now_pos,last_pos;
 
-void Scan2:: pub_msg( Eigen::Vector3d& pose,nav_msgs::Path &path,ros::Publisher &mcu_path_pub_)
-{
-
-    current_time = ros::Time::now();
-    geometry_msgs::PoseStamped this_pose_stamped;
-    this_pose_stamped.pose.position.x = pose(0);
-    this_pose_stamped.pose.position.y = pose(1);
-
-    geometry_msgs::Quaternion goal_quat = tf::createQuaternionMsgFromYaw(pose(2));
-    this_pose_stamped.pose.orientation.x = goal_quat.x;
-    this_pose_stamped.pose.orientation.y = goal_quat.y;
-    this_pose_stamped.pose.orientation.z = goal_quat.z;
-    this_pose_stamped.pose.orientation.w = goal_quat.w;
-
-    this_pose_stamped.header.stamp=current_time;
-    this_pose_stamped.header.frame_id="odom";
-    path.poses.push_back(this_pose_stamped);
-    mcu_path_pub_.publish(path);
-
-}
-
-void Scan2::publishPathEigen(std::vector<Eigen::Vector3d>& path_eigen,ros::Publisher& path_pub_)
-{
-    nav_msgs::Path visual_path;
-
-    current_time = ros::Time::now();
-
-    visual_path.header.stamp = ros::Time::now();
-    visual_path.header.frame_id="odom";
-
-    geometry_msgs::PoseStamped tmpPose;
-    tmpPose.header.stamp = current_time;
-    tmpPose.header.frame_id="odom";
-
-    for(int i = 0 ;i < path_eigen.size();i++)
-    {
-        Eigen::Vector3d poseEigen = path_eigen[i];
-
-        tmpPose.pose.position.x = poseEigen(0);
-        tmpPose.pose.position.y = poseEigen(1);
-
-        geometry_msgs::Quaternion goal_quat = tf::createQuaternionMsgFromYaw(poseEigen(2));
-        tmpPose.pose.orientation.x = goal_quat.x;
-        tmpPose.pose.orientation.y = goal_quat.y;
-        tmpPose.pose.orientation.z = goal_quat.z;
-        tmpPose.pose.orientation.w = goal_quat.w;
-
-        visual_path.poses.push_back(tmpPose);
-    }
-
-    path_pub_.publish(visual_path);
-}
-
 /*
  * 得到时刻t时候 机器人在里程计坐标下的坐标
 */
@@ -204,50 +198,119 @@ Scan2::Scan2()
     m_prevLDP = NULL;
     SetPIICPParams();
 
+    //激光缓冲区 按最大的激光数量预先分配
+    int max_beams;
+    private_nh_.param("max_beams",max_beams,2048);
+    m_LDPPool.Init(2,max_beams);
+
     scan_pos_cal.setZero();
     odom_pos_cal.setZero();
     odom_increments.clear();
+    increments_start_.setZero();
 
     if(!private_nh_.getParam("odom_frame", odom_frame_))
         odom_frame_ = "odom";
     if(!private_nh_.getParam("base_frame", base_frame_))
         base_frame_ = "base_link";
 
+    //最小二乘的求解方式 batch_qr / normal_ldlt / incremental_qr / rls
+    std::string solver;
+    double forgetting_factor,publish_rate;
+    private_nh_.param("solver",solver,std::string("incremental_qr"));
+    private_nh_.param("forgetting_factor",forgetting_factor,0.999);
+    private_nh_.param("publish_rate",publish_rate,1.0);
+    private_nh_.param("min_calib_samples",min_calib_samples_,30);
+
+    online_calib_ = false;
+    calib_data_num_ = 0;
+    published_data_num_ = 0;
+    Odom_calib.Set_forgetting_factor(forgetting_factor);
+    if(solver == "batch_qr")
+        Odom_calib.Set_solver(CALIB_SOLVER_BATCH_QR);
+    else if(solver == "normal_ldlt")
+        Odom_calib.Set_solver(CALIB_SOLVER_NORMAL_LDLT);
+    else if(solver == "rls")
+    {
+        Odom_calib.Set_solver(CALIB_SOLVER_RLS);
+        online_calib_ = true;
+    }
+    else
+        Odom_calib.Set_solver(CALIB_SOLVER_INCREMENTAL_QR);
+    std::cout <<"Calibration Solver:"<<solver<<std::endl;
+
+    //按固定频率发布当前的矫正矩阵 不影响数据的采集
+    calib_matrix_pub_ = node_.advertise<std_msgs::Float64MultiArray>("calib_matrix",1,true);
+    calib_covariance_pub_ = node_.advertise<std_msgs::Float64MultiArray>("calib_covariance",1,true);
+    if(publish_rate > 0.0)
+        calib_timer_ = node_.createTimer(ros::Duration(1.0 / publish_rate),&Scan2::PublishCalibCallBack,this);
+
     //订阅对应的topic 接受到这个topic 系统就开始进行最小二乘的解算
     calib_flag_sub_ = node_.subscribe("calib_flag",5,&Scan2::CalibFlagCallBack,this);
 
-    //发布路径
-    odom_path_pub_ = node_.advertise<nav_msgs::Path>("odom_path_pub_",1,true);
-    scan_path_pub_ = node_.advertise<nav_msgs::Path>("scan_path_pub_",1,true);
-    calib_path_pub_ = node_.advertise<nav_msgs::Path>("calib_path_pub_",1,true);
+    //发布路径 最多path_max_length个位姿 相邻位姿之间至少path_min_dist米或path_min_angle度
+    double path_min_dist,path_min_angle;
+    private_nh_.param("path_max_length",path_max_length_,2000);
+    private_nh_.param("path_min_dist",path_min_dist,0.1);
+    private_nh_.param("path_min_angle",path_min_angle,10.0);
+    path_min_angle = tfRadians(path_min_angle);
+    odom_path_.Init(node_,"odom_path_pub_","odom",path_max_length_,path_min_dist,path_min_angle);
+    scan_path_.Init(node_,"scan_path_pub_","odom",path_max_length_,path_min_dist,path_min_angle);
+    calib_path_.Init(node_,"calib_path_pub_","odom",path_max_length_,path_min_dist,path_min_angle);
+    calib_pos_cal.setZero();
     current_time = ros::Time::now();
 
-    path_odom.header.stamp=current_time;
-    path_scan.header.stamp=current_time;
-    path_odom.header.frame_id="odom";
-    path_scan.header.frame_id="odom";
+    //匹配线程 队列长度为match_queue_size
+    private_nh_.param("match_queue_size",match_queue_size_,10);
+    if(match_queue_size_ < 1)
+        match_queue_size_ = 1;
+    match_stop_ = false;
+    dropped_num_ = overrun_num_ = matched_num_ = 0;
+    match_thread_ = new boost::thread(boost::bind(&Scan2::MatchThread,this));
 
     //进行里程计和激光雷达数据的同步
     scan_filter_sub_ = new message_filters::Subscriber<sensor_msgs::LaserScan>(node_, "/sick_scan", 10);
     scan_filter_ = new tf::MessageFilter<sensor_msgs::LaserScan>(*scan_filter_sub_, tf_, odom_frame_, 10);
     scan_filter_->registerCallback(boost::bind(&Scan2::scanCallBack, this, _1));
+    scan_filter_->registerFailureCallback(boost::bind(&Scan2::scanFilterFailure, this, _1, _2));
 
     std::cout <<"Calibration Online,Wait for Data!!!!!!!"<<std::endl;
 }
 
+Scan2::~Scan2()
+{
+    {
+        boost::mutex::scoped_lock lock(match_mutex_);
+        match_stop_ = true;
+    }
+    match_cond_.notify_all();
+    match_thread_->join();
+    delete match_thread_;
+
+    printMatchStatistics(true);
+}
+
 //订阅topic表示开始进行标定.
 void Scan2::CalibFlagCallBack(const std_msgs::Empty &msg)
 {
+    boost::mutex::scoped_lock lock(calib_mutex_);
+
     Eigen::Matrix3d correct_matrix = Odom_calib.Solve();
 
     Eigen::Matrix3d tmp_transform_matrix;
 
     std::cout<<"correct_matrix:"<<std::endl<<correct_matrix<<std::endl;
 
-    //计算矫正之后的路径
-    Eigen::Vector3d calib_pos(0,0,0);                 //矫正之后的位姿
-    std::vector<Eigen::Vector3d> calib_path_eigen;    //矫正之后的路径
-    for(int i = 0; i < odom_increments.size();i++)
+    //在线标定时路径已经用当前的矫正矩阵增量地计算了 采集数据的同时继续增加
+    if(online_calib_)
+    {
+        calib_path_.Publish();
+        return ;
+    }
+
+    //用保存的最近path_max_length_组增量计算矫正之后的路径 从它们之前的里程计位姿开始
+    Eigen::Vector3d calib_pos = increments_start_;    //矫正之后的位姿
+    calib_path_.Clear();
+    for(size_t i = 0; i < odom_increments.size();i++)
     {
         Eigen::Vector3d odom_inc = odom_increments[i];
         Eigen::Vector3d correct_inc = correct_matrix * odom_inc;
@@ -258,11 +321,12 @@ void Scan2::CalibFlagCallBack(const std_msgs::Empty &msg)
 
         calib_pos += tmp_transform_matrix * correct_inc;
 
-        calib_path_eigen.push_back(calib_pos);
+        calib_path_.AddPose(calib_pos,false);
     }
 
     //发布矫正之后的路径
-    publishPathEigen(calib_path_eigen,calib_path_pub_);
+    calib_path_.Publish();
+    calib_pos_cal = calib_pos;
 
     //矫正完毕，退出订阅
     scan_filter_sub_->unsubscribe();
@@ -270,19 +334,63 @@ void Scan2::CalibFlagCallBack(const std_msgs::Empty &msg)
     std::cout <<"calibration over!!!!"<<std::endl;
 }
 
+//定时发布当前的矫正矩阵(按行展开)和协方差(9x9 只有rls有效)
+//锁内只复制数据 求解在锁外进行 不会阻塞匹配线程
+void Scan2::PublishCalibCallBack(const ros::TimerEvent& event)
+{
+    OdomCalib calib;
+    {
+        boost::mutex::scoped_lock lock(calib_mutex_);
+        if(calib_data_num_ == published_data_num_ ||
+           Odom_calib.Data_Num() < min_calib_samples_)
+            return ;
+        calib = Odom_calib;
+        published_data_num_ = calib_data_num_;
+    }
+
+    //不满秩的时候解出来的矩阵没有意义 等待更多的数据
+    if(!calib.Is_full_rank())
+        return ;
+
+    Eigen::Matrix3d correct_matrix = calib.Solve();
+    Eigen::Matrix<double,9,9> covariance = calib.Covariance();
+
+    std_msgs::Float64MultiArray matrix_msg;
+    matrix_msg.layout.dim.resize(2);
+    matrix_msg.layout.dim[0].label = "rows";
+    matrix_msg.layout.dim[0].size = 3;
+    matrix_msg.layout.dim[0].stride = 9;
+    matrix_msg.layout.dim[1].label = "cols";
+    matrix_msg.layout.dim[1].size = 3;
+    matrix_msg.layout.dim[1].stride = 3;
+    for(int i = 0; i < 3; i++)
+        for(int j = 0; j < 3; j++)
+            matrix_msg.data.push_back(correct_matrix(i,j));
+    calib_matrix_pub_.publish(matrix_msg);
+
+    if(!online_calib_)
+        return ;
 
-//激光数据回调函数
+    std_msgs::Float64MultiArray cov_msg;
+    cov_msg.layout.dim.resize(2);
+    cov_msg.layout.dim[0].label = "rows";
+    cov_msg.layout.dim[0].size = 9;
+    cov_msg.layout.dim[0].stride = 81;
+    cov_msg.layout.dim[1].label = "cols";
+    cov_msg.layout.dim[1].size = 9;
+    cov_msg.layout.dim[1].stride = 9;
+    for(int i = 0; i < 9; i++)
+        for(int j = 0; j < 9; j++)
+            cov_msg.data.push_back(covariance(i,j));
+    calib_covariance_pub_.publish(cov_msg);
+}
+
+
+//激光数据回调函数 只查询里程计 然后放入匹配队列
 void Scan2::scanCallBack(const sensor_msgs::LaserScan::ConstPtr &_laserScanMsg)
 {
-    static long int dataCnt = 0;
-    sensor_msgs::LaserScan scan;
     Eigen::Vector3d odom_pose;              //激光对应的里程计位姿
     Eigen::Vector3d d_point_odom;           //里程计计算的dpose
-    Eigen::Vector3d d_point_scan;           //激光的scanmatch计算的dpose
-    Eigen::MatrixXd transform_matrix(3,3);  //临时的变量
-
-    double c,s;
-    scan = *_laserScanMsg;
 
     //得到对应的里程计数据
     if(!getOdomPose(odom_pose, _laserScanMsg->header.stamp))
@@ -298,23 +406,96 @@ void Scan2::scanCallBack(const sensor_msgs::LaserScan::ConstPtr &_laserScanMsg)
     {
         return ;
     }
+
+    {
+        boost::mutex::scoped_lock lock(match_mutex_);
+
+        //队列满了 丢掉这一帧，但是不更新last_pos，
+        //下一帧的里程计增量仍然相对于上一个进入队列的激光，标定数据保持连续
+        if((int)match_queue_.size() >= match_queue_size_)
+        {
+            dropped_num_++;
+            ROS_WARN_THROTTLE(1.0,"Match queue full, scan dropped (dropped:%lu overrun:%lu)",
+                              dropped_num_,overrun_num_);
+            return ;
+        }
+
+        ScanJob job;
+        job.scan = _laserScanMsg;
+        job.d_point_odom = d_point_odom;
+        match_queue_.push_back(job);
+    }
+    match_cond_.notify_one();
+
     last_pos = now_pos;
+}
+
+//tf的MessageFilter丢掉激光(队列溢出或者数据太老)
+void Scan2::scanFilterFailure(const sensor_msgs::LaserScan::ConstPtr& scan,
+                              tf::filter_failure_reasons::FilterFailureReason reason)
+{
+    boost::mutex::scoped_lock lock(match_mutex_);
+    overrun_num_++;
+    ROS_WARN_THROTTLE(1.0,"Scan dropped by tf message filter (dropped:%lu overrun:%lu)",
+                      dropped_num_,overrun_num_);
+}
+
+void Scan2::printMatchStatistics(bool total)
+{
+    boost::mutex::scoped_lock lock(match_mutex_);
+    if(total)
+        ROS_INFO("Match statistics: matched %lu dropped %lu overrun %lu",
+                 matched_num_,dropped_num_,overrun_num_);
+    else
+        ROS_INFO_THROTTLE(5.0,"Matched:%lu Queue:%lu Dropped:%lu Overrun:%lu",
+                          matched_num_,(unsigned long)match_queue_.size(),dropped_num_,overrun_num_);
+}
+
+//匹配线程 按顺序处理队列中的激光
+void Scan2::MatchThread()
+{
+    while(true)
+    {
+        ScanJob job;
+        {
+            boost::mutex::scoped_lock lock(match_mutex_);
+            while(match_queue_.empty() && !match_stop_)
+                match_cond_.wait(lock);
+
+            if(match_stop_)
+                break;
 
-    //记录下里程计的增量数据
-    odom_increments.push_back(d_point_odom);
+            job = match_queue_.front();
+            match_queue_.pop_front();
+        }
 
+        processScan(job);
+    }
+}
+
+//PL-ICP匹配 路径积分和发布 构造超定方程组
+void Scan2::processScan(const ScanJob& job)
+{
+    Eigen::Vector3d d_point_odom = job.d_point_odom;   //里程计计算的dpose
+    Eigen::Vector3d d_point_scan;                      //激光的scanmatch计算的dpose
+    Eigen::MatrixXd transform_matrix(3,3);             //临时的变量
+
+    double c,s;
 
     //把当前的激光数据转换为 pl-icp能识别的数据 & 进行矫正
     //d_point_scan就是用激光计算得到的两帧数据之间的旋转 & 平移
+    //第一帧激光没有可以匹配的数据，只作为参考帧
     LDP currentLDP;
-    if(m_prevLDP != NULL)
+    bool first_scan = (m_prevLDP == NULL);
+    if(!first_scan)
     {
-        LaserScanToLDP(&scan,currentLDP);
+        LaserScanToLDP(job.scan.get(),currentLDP);
         d_point_scan = PIICPBetweenTwoFrames(currentLDP,d_point_odom);
     }
     else
     {
-        LaserScanToLDP(&scan,m_prevLDP);
+        LaserScanToLDP(job.scan.get(),m_prevLDP);
+        d_point_scan = d_point_odom;
     }
 
     // 构造旋转矩阵 生成三种位姿
@@ -336,14 +517,49 @@ void Scan2::scanCallBack(const sensor_msgs::LaserScan::ConstPtr &_laserScanMsg)
     odom_pos_cal+=(transform_matrix*d_point_odom);
 
     //放到路径当中 //for visualization
-    pub_msg(odom_pos_cal,path_odom,odom_path_pub_);
-    pub_msg(scan_pos_cal,path_scan,scan_path_pub_);
+    odom_path_.AddPose(odom_pos_cal);
+    scan_path_.AddPose(scan_pos_cal);
 
-    //构造超定方程组
-    Odom_calib.Add_Data(d_point_odom,d_point_scan);
-    dataCnt++;
+    {
+        boost::mutex::scoped_lock lock(calib_mutex_);
+
+        //离线标定时记录下里程计的增量数据 超过path_max_length_组的时候丢掉最老的一组
+        if(!online_calib_)
+        {
+            odom_increments.push_back(d_point_odom);
+            if((int)odom_increments.size() > path_max_length_)
+            {
+                const Eigen::Vector3d& inc = odom_increments.front();
+                c = cos(increments_start_(2));
+                s = sin(increments_start_(2));
+                increments_start_ += Eigen::Vector3d(c*inc(0) - s*inc(1), s*inc(0) + c*inc(1), inc(2));
+                odom_increments.pop_front();
+            }
+        }
 
-    std::cout <<"Data Cnt:"<<dataCnt<<std::endl;
+        //构造超定方程组
+        if(!first_scan && Odom_calib.Add_Data(d_point_odom,d_point_scan))
+            calib_data_num_++;
+
+        //在线标定 用当前的矫正矩阵增量地计算矫正之后的路径
+        if(online_calib_)
+        {
+            Eigen::Vector3d correct_inc = Odom_calib.Solve() * d_point_odom;
+            c = cos(calib_pos_cal(2));
+            s = sin(calib_pos_cal(2));
+            transform_matrix<<c,-s,0,
+                              s, c,0,
+                              0, 0,1;
+            calib_pos_cal+=(transform_matrix*correct_inc);
+            calib_path_.AddPose(calib_pos_cal);
+        }
+    }
+
+    {
+        boost::mutex::scoped_lock lock(match_mutex_);
+        matched_num_++;
+    }
+    printMatchStatistics();
 }
 
 //TODO:
@@ -391,91 +607,20 @@ Eigen::Vector3d  cal_delta_distence(Eigen::Vector3d odom_pose)
 //设置PI-ICP的参数
 void Scan2::SetPIICPParams()
 {
-    //设置激光的范围
-    m_PIICPParams.min_reading = 0.1;
-    m_PIICPParams.max_reading = 20;
-
-    //设置位姿最大的变化范围
-    m_PIICPParams.max_angular_correction_deg = 20.0;
-    m_PIICPParams.max_linear_correction = 1;
-
-    //设置迭代停止的条件
-    m_PIICPParams.max_iterations = 50;
-    m_PIICPParams.epsilon_xy = 0.000001;
-    m_PIICPParams.epsilon_theta = 0.0000001;
-
-    //设置correspondence相关参数
-    m_PIICPParams.max_correspondence_dist = 1;
-    m_PIICPParams.sigma = 0.01;
-    m_PIICPParams.use_corr_tricks = 1;
-
-    //设置restart过程，因为不需要restart所以可以不管
-    m_PIICPParams.restart = 0;
-    m_PIICPParams.restart_threshold_mean_error = 0.01;
-    m_PIICPParams.restart_dt = 1.0;
-    m_PIICPParams.restart_dtheta = 0.1;
-
-    //设置聚类参数
-    m_PIICPParams.clustering_threshold = 0.2;
-
-    //用最近的10个点来估计方向
-    m_PIICPParams.orientation_neighbourhood = 10;
-
-    //设置使用PI-ICP
-    m_PIICPParams.use_point_to_line_distance = 1;
-
-    //不进行alpha_test
-    m_PIICPParams.do_alpha_test = 0;
-    m_PIICPParams.do_alpha_test_thresholdDeg = 5;
-
-    //设置trimmed参数 用来进行outlier remove
-    m_PIICPParams.outliers_maxPerc = 0.9;
-    m_PIICPParams.outliers_adaptive_order = 0.7;
-    m_PIICPParams.outliers_adaptive_mult = 2.0;
-
-    //进行visibility_test 和 remove double
-    m_PIICPParams.do_visibility_test = 1;
-    m_PIICPParams.outliers_remove_doubles = 1;
-    m_PIICPParams.do_compute_covariance = 0;
-    m_PIICPParams.debug_verify_tricks = 0;
-    m_PIICPParams.use_ml_weights = 0;
-    m_PIICPParams.use_sigma_weights = 0;
+    ::SetPIICPParams(m_PIICPParams);
 }
 
 
 
 //把激光雷达数据 转换为PI-ICP需要的数据
-void Scan2::LaserScanToLDP(sensor_msgs::LaserScan *pScan,
+void Scan2::LaserScanToLDP(const sensor_msgs::LaserScan *pScan,
                            LDP& ldp)
 {
     int nPts = pScan->intensities.size();
-    ldp = ld_alloc_new(nPts);
-
-    for(int i = 0;i < nPts;i++)
-    {
-        double dist = pScan->ranges[i];
-        if(dist > 0.1 && dist < 20)
-        {
-            ldp->valid[i] = 1;
-            ldp->readings[i] = dist;
-        }
-        else
-        {
-            ldp->valid[i] = 0;
-            ldp->readings[i] = -1;
-        }
-        ldp->theta[i] = pScan->angle_min+pScan->angle_increment*i;
-    }
-    ldp->min_theta = ldp->theta[0];
-    ldp->max_theta = ldp->theta[nPts-1];
-
-    ldp->odometry[0] = 0.0;
-    ldp->odometry[1] = 0.0;
-    ldp->odometry[2] = 0.0;
 
-    ldp->true_pose[0] = 0.0;
-    ldp->true_pose[1] = 0.0;
-    ldp->true_pose[2] = 0.0;
+    //从缓冲池中取 不分配内存
+    ldp = m_LDPPool.Get(nPts);
+    RangesToLDP(&pScan->ranges[0],nPts,pScan->angle_min,pScan->angle_increment,ldp);
 }
 
 
@@ -483,56 +628,14 @@ void Scan2::LaserScanToLDP(sensor_msgs::LaserScan *pScan,
 Eigen::Vector3d  Scan2::PIICPBetweenTwoFrames(LDP& currentLDPScan,
                                               Eigen::Vector3d tmprPose)
 {
-    m_prevLDP->odometry[0] = 0.0;
-    m_prevLDP->odometry[1] = 0.0;
-    m_prevLDP->odometry[2] = 0.0;
-
-    m_prevLDP->estimate[0] = 0.0;
-    m_prevLDP->estimate[1] = 0.0;
-    m_prevLDP->estimate[2] = 0.0;
-
-    m_prevLDP->true_pose[0] = 0.0;
-    m_prevLDP->true_pose[1] = 0.0;
-    m_prevLDP->true_pose[2] = 0.0;
-
-    //设置匹配的参数值
-    m_PIICPParams.laser_ref = m_prevLDP;
-    m_PIICPParams.laser_sens = currentLDPScan;
-
-    m_PIICPParams.first_guess[0] = tmprPose(0);
-    m_PIICPParams.first_guess[1] = tmprPose(1);
-    m_PIICPParams.first_guess[2] = tmprPose(2);
-
-    m_OutputResult.cov_x_m = 0;
-    m_OutputResult.dx_dy1_m = 0;
-    m_OutputResult.dx_dy2_m = 0;
-
-    sm_icp(&m_PIICPParams,&m_OutputResult);
-
     //nowPose在lastPose中的坐标
     Eigen::Vector3d  rPose;
-    if(m_OutputResult.valid)
-    {
-        //得到两帧激光之间的相对位姿
-        rPose(0)=(m_OutputResult.x[0]);
-        rPose(1)=(m_OutputResult.x[1]);
-        rPose(2)=(m_OutputResult.x[2]);
-
-//        std::cout <<"Iter:"<<m_OutputResult.iterations<<std::endl;
-//        std::cout <<"Corr:"<<m_OutputResult.nvalid<<std::endl;
-//        std::cout <<"Erro:"<<m_OutputResult.error<<std::endl;
-
-//        std::cout <<"PI ICP GOOD"<<std::endl;
-    }
-    else
+    if(!PIICPMatch(m_PIICPParams,m_prevLDP,currentLDPScan,tmprPose,rPose,&m_OutputResult))
     {
         std::cout <<"PI ICP Failed!!!!!!!"<<std::endl;
-        rPose = tmprPose;
     }
 
-    //更新
-
-    //ld_free(m_prevLDP);
+    //更新 m_prevLDP所在的缓冲区由缓冲池回收
 
     m_prevLDP = currentLDPScan;
 
@@ -548,7 +651,6 @@ int main(int argc,char** argv)
     ros::NodeHandle n;
     Scan2 scan;
 
-
     Odom_calib.Set_data_len(12000);
     Odom_calib.set_data_zero();
     ros::spin();
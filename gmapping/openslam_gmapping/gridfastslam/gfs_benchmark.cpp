@@ -0,0 +1,519 @@
+/*
+ * GridSlamProcessor的离线测试程序 不依赖ROS和carmen
+ * 在一个二维多边形的世界中仿真一个带里程计噪声的机器人和一个激光雷达，
+ * 用.ini文件中的参数运行gmapping，和真值比较，输出轨迹误差、耗时和内存的使用情况。
+ *
+ * 用法: gfs_benchmark [-cfg file.ini] [-steps N] [-odom_noise s] [-range_noise s] [-likelihood_field 0|1]
+ *                     [-particles N] [-corr_window m] [-corr_angle rad] [-slip p]
+ *                     [-min_particles N] [-max_particles N] [-kld_epsilon e] [-tree_depth N] [-seed N]
+ *   -cfg         参数文件 格式和ini目录下的文件一样 只读取[gfs]中用到的参数
+ *   -steps       仿真的步数 每一步机器人移动5cm 默认3000
+ *   -odom_noise  里程计的噪声 每米平移的位置噪声的标准差 角度噪声为其0.5倍 默认0.05
+ *   -range_noise 激光测距噪声的标准差 默认0.01
+ *   -likelihood_field 匹配的时候是否使用似然场缓存 默认0
+ *   -particles   粒子数 覆盖参数文件中的值
+ *   -corr_window 相关性搜索的平移窗口的半径 默认0 不搜索
+ *   -corr_angle  相关性搜索的角度窗口的半径 默认0 不搜索
+ *   -slip        每一步打滑的概率 打滑的时候里程计多算0.1m的平移和0.05rad的旋转 模拟光滑的地面 默认0
+ *   -min_particles/-max_particles KLD-sampling的粒子数的范围 max_particles为0的时候粒子数固定 默认0
+ *   -kld_epsilon KLD-sampling的误差界限 默认使用GridSlamProcessor的默认值
+ *   -tree_depth  每个粒子的轨迹最多保留的节点数 默认0 保留整条轨迹
+ *   -seed        随机数种子 覆盖参数文件中的randseed 用来在多个种子上重复同一个测试
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <map>
+
+#include "../include/gmapping/gridfastslam/gridslamprocessor.h"
+#include "../include/gmapping/sensor/sensor_range/rangesensor.h"
+#include "../include/gmapping/sensor/sensor_range/rangereading.h"
+#include "../include/gmapping/utils/stat.h"
+
+using namespace GMapping;
+using namespace std;
+
+static double nowSec()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double normalizeAngle(double a)
+{
+	return a - 2.0 * M_PI * floor((a + M_PI) / (2.0 * M_PI));
+}
+
+/*读取/proc/self/status中的一项 单位kB*/
+static long readStatus(const char* key)
+{
+	ifstream is("/proc/self/status");
+	string line;
+	size_t len=strlen(key);
+	while (getline(is, line))
+	{
+		if (line.compare(0, len, key)==0)
+			return atol(line.c_str()+len+1);
+	}
+	return -1;
+}
+
+
+//////////////////////////////////////////参数///////////////////////////////////////////////
+
+/*读取ini文件 key value 格式 #后面为注释*/
+static bool readConfig(const string& filename, map<string, string>& cfg)
+{
+	ifstream is(filename.c_str());
+	if (!is)
+		return false;
+	string line;
+	while (getline(is, line))
+	{
+		size_t c=line.find('#');
+		if (c!=string::npos)
+			line=line.substr(0, c);
+		istringstream ls(line);
+		string key, value;
+		if (!(ls >> key >> value) || key[0]=='[')
+			continue;
+		cfg[key]=value;
+	}
+	return true;
+}
+
+static double cfgDouble(const map<string, string>& cfg, const char* key, double def)
+{
+	map<string, string>::const_iterator it=cfg.find(key);
+	return it==cfg.end() ? def : atof(it->second.c_str());
+}
+
+
+//////////////////////////////////////////仿真世界///////////////////////////////////////////////
+
+struct Segment
+{
+	double x0, y0, x1, y1;
+};
+
+static void addBox(vector<Segment>& world, double x0, double y0, double x1, double y1)
+{
+	double c[4][2]={{x0,y0}, {x1,y0}, {x1,y1}, {x0,y1}};
+	for (int i=0; i<4; i++)
+	{
+		Segment s;
+		s.x0=c[i][0];
+		s.y0=c[i][1];
+		s.x1=c[(i+1)%4][0];
+		s.y1=c[(i+1)%4][1];
+		world.push_back(s);
+	}
+}
+
+//一个30m*20m的环形走廊 宽4m 两侧的墙上每隔3m交替有一个柱子 否则沿着走廊的方向是退化的
+static void buildWorld(vector<Segment>& world)
+{
+	world.clear();
+	addBox(world, -15, -10, 15, 10);		//外墙
+	addBox(world, -11, -6, 11, 6);			//内墙
+	int side=0;
+	for (double x=-12; x<=12; x+=3, side^=1)
+	{
+		//上下两条走廊
+		addBox(world, x, side ? -10 : -6.5, x+0.5, side ? -9.5 : -6);
+		addBox(world, x, side ? 9.5 : 6, x+0.5, side ? 10 : 6.5);
+	}
+	for (double y=-5; y<=5; y+=3, side^=1)
+	{
+		//左右两条走廊
+		addBox(world, side ? -15 : -11.5, y, side ? -14.5 : -11, y+0.5);
+		addBox(world, side ? 14.5 : 11, y, side ? 15 : 11.5, y+0.5);
+	}
+}
+
+//射线和世界求交 返回距离 没有交点返回max_range
+static double rayCast(const vector<Segment>& world, double ox, double oy, double angle, double max_range)
+{
+	double dx=cos(angle), dy=sin(angle);
+	double best=max_range;
+	for (size_t i=0; i<world.size(); i++)
+	{
+		const Segment& s=world[i];
+		double ex=s.x1-s.x0, ey=s.y1-s.y0;
+		double denom=dx*ey-dy*ex;
+		if (fabs(denom)<1e-12)
+			continue;
+		double wx=s.x0-ox, wy=s.y0-oy;
+		double t=(wx*ey-wy*ex)/denom;
+		double u=(wx*dy-wy*dx)/denom;
+		if (t>0.0 && u>=0.0 && u<=1.0 && t<best)
+			best=t;
+	}
+	return best;
+}
+
+/*沿着走廊绕圈 每一步前进5cm 到了拐角处原地旋转*/
+static void buildTrajectory(int steps, vector<OrientedPoint>& truth)
+{
+	double wp[][2]={{-13,-8}, {13,-8}, {13,8}, {-13,8}};
+	truth.clear();
+	OrientedPoint p(wp[0][0], wp[0][1], 0);
+	int target=1;
+	while ((int)truth.size()<steps)
+	{
+		truth.push_back(p);
+		double dx=wp[target][0]-p.x, dy=wp[target][1]-p.y;
+		double heading=atan2(dy, dx);
+		double dtheta=normalizeAngle(heading-p.theta);
+		if (fabs(dtheta)>1e-6)
+		{
+			//每一步最多旋转5度
+			double step=0.0873;
+			p.theta=normalizeAngle(p.theta+(fabs(dtheta)<step ? dtheta : (dtheta>0 ? step : -step)));
+			continue;
+		}
+		double dist=sqrt(dx*dx+dy*dy);
+		double step=dist<0.05 ? dist : 0.05;
+		p.x+=step*cos(p.theta);
+		p.y+=step*sin(p.theta);
+		if (dist<=0.05)
+			target=(target+1)%4;
+	}
+}
+
+/*
+ * 记录扫描匹配结束的时间 processScan()返回的时候减去这个时间
+ * 就是更新轨迹树的权重、重采样和更新地图的时间
+ */
+class BenchmarkProcessor: public GridSlamProcessor
+{
+	public:
+		BenchmarkProcessor(std::ostream& infoS): GridSlamProcessor(infoS), scanmatched(0) {}
+		virtual void onScanmatchUpdate() { scanmatched=nowSec(); }
+		double scanmatched;
+};
+
+/*
+ * 扫描匹配的打分速度
+ * 在地图上模拟optimize()中爬山的过程：每一轮对前后左右和左右旋转6个位姿打分。
+ * 逐个计算击中点的score()和使用击中点缓存的score()分别计时，
+ * 使用缓存的时候每一轮只需要计算当前朝向和左右旋转之后的朝向的击中点。
+ */
+static void probeBenchmark(const map<string, string>& cfg, const ScanMatcherMap& smap, const OrientedPoint& pose,
+		unsigned int beams, double* angles, const double* readings, double maxrange, double maxUrange)
+{
+	ScanMatcher matcher;
+	matcher.setLaserParameters(beams, angles, OrientedPoint(0,0,0));
+	matcher.setMatchingParameters(maxUrange, maxrange, cfgDouble(cfg, "sigma", 0.05),
+			(int)cfgDouble(cfg, "kernelSize", 1), cfgDouble(cfg, "lstep", 0.05), cfgDouble(cfg, "astep", 0.05),
+			(int)cfgDouble(cfg, "iterations", 5), cfgDouble(cfg, "lsigma", 0.075),
+			(unsigned int)cfgDouble(cfg, "lskip", 0));
+	double ldelta=cfgDouble(cfg, "lstep", 0.05), adelta=cfgDouble(cfg, "astep", 0.05);
+	const int rounds=2000;
+	const double dx[]={ldelta, -ldelta, 0, 0, 0, 0};
+	const double dy[]={0, 0, -ldelta, ldelta, 0, 0};
+	const double dt[]={0, 0, 0, 0, adelta, -adelta};
+
+	vector<double> ref(rounds*6);
+	double t0=nowSec();
+	for (int k=0; k<rounds; k++)
+	{
+		//每一轮的中心位姿稍微不同 避免每次都是同样的朝向
+		OrientedPoint c(pose.x+0.002*(k%11-5), pose.y+0.002*(k%7-3), pose.theta+0.001*(k%13-6));
+		for (int m=0; m<6; m++)
+			ref[k*6+m]=matcher.score(smap, OrientedPoint(c.x+dx[m], c.y+dy[m], c.theta+dt[m]), readings);
+	}
+	double t_old=nowSec()-t0;
+
+	BeamEndpoints e[3];
+	double max_diff=0;
+	t0=nowSec();
+	for (int k=0; k<rounds; k++)
+	{
+		OrientedPoint c(pose.x+0.002*(k%11-5), pose.y+0.002*(k%7-3), pose.theta+0.001*(k%13-6));
+		matcher.computeEndpoints(e[0], smap, c.theta, readings);
+		matcher.computeEndpoints(e[1], smap, c.theta+adelta, readings);
+		matcher.computeEndpoints(e[2], smap, c.theta-adelta, readings);
+		for (int m=0; m<6; m++)
+		{
+			const BeamEndpoints& em=m<4 ? e[0] : e[m-3];
+			double sc=matcher.score(smap, Point(c.x+dx[m], c.y+dy[m]), em);
+			max_diff=fabs(sc-ref[k*6+m])>max_diff ? fabs(sc-ref[k*6+m]) : max_diff;
+		}
+	}
+	double t_new=nowSec()-t0;
+
+	//同时计算得分和似然的打分 optimize()在不使用似然场的时候每次都这样打分
+	double sum_l=0;
+	t0=nowSec();
+	for (int k=0; k<rounds; k++)
+	{
+		OrientedPoint c(pose.x+0.002*(k%11-5), pose.y+0.002*(k%7-3), pose.theta+0.001*(k%13-6));
+		matcher.computeEndpoints(e[0], smap, c.theta, readings);
+		matcher.computeEndpoints(e[1], smap, c.theta+adelta, readings);
+		matcher.computeEndpoints(e[2], smap, c.theta-adelta, readings);
+		for (int m=0; m<6; m++)
+		{
+			double sc, l;
+			matcher.likelihoodAndScore(sc, l, smap, Point(c.x+dx[m], c.y+dy[m]), m<4 ? e[0] : e[m-3]);
+			sum_l+=l;
+		}
+	}
+	double t_fused=nowSec()-t0;
+
+	printf("score probes      %.0f /s per beam endpoints  %.0f /s with cached endpoints  (max score diff %.2g)\n",
+		rounds*6/t_old, rounds*6/t_new, max_diff);
+	printf("fused probes      %.0f /s score+likelihood with cached endpoints\n", rounds*6/t_fused);
+
+	//一次完整的优化 打分的次数和耗时
+	t0=nowSec();
+	ScoredMove best;
+	int updates=200;
+	for (int k=0; k<updates; k++)
+		matcher.optimize(best, smap, OrientedPoint(pose.x+0.01*(k%5-2), pose.y+0.01*(k%3-1), pose.theta), readings);
+	double t_opt=nowSec()-t0;
+
+	//优化之后单独计算一次似然的耗时 这是原来每个粒子每次更新都要多做的一次遍历
+	t0=nowSec();
+	for (int k=0; k<updates; k++)
+	{
+		double sc, l;
+		matcher.likelihoodAndScore(sc, l, smap, OrientedPoint(pose.x+0.01*(k%5-2), pose.y+0.01*(k%3-1), pose.theta), readings);
+	}
+	double t_pass=nowSec()-t0;
+	printf("optimize          %.3f ms per particle update (likelihood of the best pose included)  separate likelihood pass %.3f ms\n",
+		t_opt/updates*1e3, t_pass/updates*1e3);
+}
+
+
+int main(int argc, char** argv)
+{
+	string cfgfile;
+	int steps=3000;
+	double odom_noise=0.05, range_noise=0.01;
+	bool use_field=false;
+	int particles_arg=0;
+	double corr_window=0, corr_angle=0;
+	int min_particles=0, max_particles=0;
+	double kld_epsilon=0;
+	unsigned int tree_depth=0;
+	double slip=0;
+	int seed_arg=-1;
+	for (int i=1; i<argc-1; i+=2)
+	{
+		if (!strcmp(argv[i], "-cfg"))
+			cfgfile=argv[i+1];
+		else if (!strcmp(argv[i], "-steps"))
+			steps=atoi(argv[i+1]);
+		else if (!strcmp(argv[i], "-odom_noise"))
+			odom_noise=atof(argv[i+1]);
+		else if (!strcmp(argv[i], "-range_noise"))
+			range_noise=atof(argv[i+1]);
+		else if (!strcmp(argv[i], "-likelihood_field"))
+			use_field=atoi(argv[i+1])!=0;
+		else if (!strcmp(argv[i], "-particles"))
+			particles_arg=atoi(argv[i+1]);
+		else if (!strcmp(argv[i], "-corr_window"))
+			corr_window=atof(argv[i+1]);
+		else if (!strcmp(argv[i], "-corr_angle"))
+			corr_angle=atof(argv[i+1]);
+		else if (!strcmp(argv[i], "-slip"))
+			slip=atof(argv[i+1]);
+		else if (!strcmp(argv[i], "-min_particles"))
+			min_particles=atoi(argv[i+1]);
+		else if (!strcmp(argv[i], "-max_particles"))
+			max_particles=atoi(argv[i+1]);
+		else if (!strcmp(argv[i], "-kld_epsilon"))
+			kld_epsilon=atof(argv[i+1]);
+		else if (!strcmp(argv[i], "-tree_depth"))
+			tree_depth=atoi(argv[i+1]);
+		else if (!strcmp(argv[i], "-seed"))
+			seed_arg=atoi(argv[i+1]);
+		else
+		{
+			cerr << "unknown option " << argv[i] << endl;
+			return 1;
+		}
+	}
+
+	map<string, string> cfg;
+	if (cfgfile.length() && !readConfig(cfgfile, cfg))
+	{
+		cerr << "cannot read " << cfgfile << endl;
+		return 1;
+	}
+
+	int particles=particles_arg>0 ? particles_arg : (int)cfgDouble(cfg, "particles", 30);
+	double delta=cfgDouble(cfg, "delta", 0.05);
+	double maxrange=cfgDouble(cfg, "maxrange", 81.0);
+	double maxUrange=cfgDouble(cfg, "maxUrange", 80.0);
+	double xmin=cfgDouble(cfg, "xmin", -100), ymin=cfgDouble(cfg, "ymin", -100);
+	double xmax=cfgDouble(cfg, "xmax", 100), ymax=cfgDouble(cfg, "ymax", 100);
+
+	//激光雷达 181束 1度的解析度
+	const unsigned int beams=181;
+	const double res=M_PI/180.;
+	vector<double> angles(beams);
+	for (unsigned int i=0; i<beams; i++)
+		angles[i]=-.5*res*beams+i*res;
+	RangeSensor* laser=new RangeSensor("FLASER", beams, &angles[0], OrientedPoint(0,0,0), 0, maxrange);
+	SensorMap smap;
+	smap.insert(make_pair(laser->getName(), laser));
+
+	BenchmarkProcessor* gsp=new BenchmarkProcessor(cerr);
+	gsp->setSensorMap(smap);
+	gsp->setMatchingParameters(maxUrange, maxrange, cfgDouble(cfg, "sigma", 0.05),
+			(int)cfgDouble(cfg, "kernelSize", 1), cfgDouble(cfg, "lstep", 0.05), cfgDouble(cfg, "astep", 0.05),
+			(int)cfgDouble(cfg, "iterations", 5), cfgDouble(cfg, "lsigma", 0.075), cfgDouble(cfg, "ogain", 3),
+			(unsigned int)cfgDouble(cfg, "lskip", 0));
+	gsp->setMotionModelParameters(cfgDouble(cfg, "srr", 0.1), cfgDouble(cfg, "srt", 0.2),
+			cfgDouble(cfg, "str", 0.1), cfgDouble(cfg, "stt", 0.2));
+	gsp->setUpdateDistances(cfgDouble(cfg, "linearUpdate", 1.0), cfgDouble(cfg, "angularUpdate", 0.5),
+			cfgDouble(cfg, "resampleThreshold", 0.5));
+	gsp->setUpdatePeriod(-1);
+	gsp->setgenerateMap(false);
+	gsp->setuseLikelihoodField(use_field);
+	gsp->setcorrelativeLinearWindow(corr_window);
+	gsp->setcorrelativeAngularWindow(corr_angle);
+	if (min_particles>0)
+		gsp->setminParticles(min_particles);
+	gsp->setmaxParticles(max_particles);
+	if (kld_epsilon>0)
+		gsp->setkldEpsilon(kld_epsilon);
+	gsp->setmaxTreeDepth(tree_depth);
+
+	vector<Segment> world;
+	buildWorld(world);
+	vector<OrientedPoint> truth;
+	buildTrajectory(steps, truth);
+
+	gsp->init(particles, xmin, ymin, xmax, ymax, delta, truth[0]);
+	gsp->setllsamplerange(cfgDouble(cfg, "llsamplerange", 0.01));
+	gsp->setllsamplestep(cfgDouble(cfg, "llsamplestep", 0.01));
+	gsp->setlasamplerange(cfgDouble(cfg, "lasamplerange", 0.005));
+	gsp->setlasamplestep(cfgDouble(cfg, "lasamplestep", 0.005));
+	unsigned int seed=(unsigned int)cfgDouble(cfg, "randseed", 0);
+	if (seed_arg>=0)
+		seed=seed_arg;
+	sampleGaussian(1, seed);
+	srand(seed);
+	//sampleGaussian()和重采样使用的是drand48 srand()不会改变它的序列
+	srand48(seed);
+
+	long rss_start=readStatus("VmRSS:");
+
+	//里程计的噪声和真值的增量成正比
+	OrientedPoint odom=truth[0];
+	vector<double> ranges(beams);
+	int processed=0;
+	double process_time=0, resample_time=0;
+	int resampled=0;
+	double sum_err=0, max_err=0;
+	double sum_particles=0;
+	unsigned int max_count=0;
+	for (int k=0; k<steps; k++)
+	{
+		if (k>0)
+		{
+			OrientedPoint d=absoluteDifference(truth[k], truth[k-1]);
+			double trans=sqrt(d.x*d.x+d.y*d.y);
+			double rot=fabs(d.theta);
+			d.x+=sampleGaussian(odom_noise*trans);
+			d.y+=sampleGaussian(odom_noise*trans);
+			d.theta+=sampleGaussian(0.5*odom_noise*(trans+rot));
+			if (slip>0 && rand()<slip*RAND_MAX)
+			{
+				d.x+=0.1;
+				d.theta+=rand()%2 ? 0.05 : -0.05;
+			}
+			odom=absoluteSum(odom, d);
+		}
+
+		for (unsigned int i=0; i<beams; i++)
+		{
+			double r=rayCast(world, truth[k].x, truth[k].y, truth[k].theta+angles[i], maxrange);
+			if (r<maxrange)
+				r+=sampleGaussian(range_noise);
+			ranges[i]=r;
+		}
+
+		RangeReading reading(beams, &ranges[0], &angles[0], laser, k);
+		reading.setPose(odom);
+
+		double t0=nowSec();
+		gsp->scanmatched=0;
+		bool done=gsp->processScan(reading);
+		double t1=nowSec();
+		process_time+=t1-t0;
+		if (gsp->scanmatched>0)
+		{
+			resample_time+=t1-gsp->scanmatched;
+			resampled++;
+		}
+		if (!done)
+			continue;
+
+		processed++;
+		sum_particles+=gsp->getParticles().size();
+		if (gsp->getParticles().size()>max_count)
+			max_count=gsp->getParticles().size();
+		const OrientedPoint& best=gsp->getParticles()[gsp->getBestParticleIndex()].pose;
+		double err=sqrt((best.x-truth[k].x)*(best.x-truth[k].x)+(best.y-truth[k].y)*(best.y-truth[k].y));
+		sum_err+=err;
+		if (err>max_err)
+			max_err=err;
+	}
+
+	//最优粒子的整条轨迹和真值比较 节点中激光数据的时间就是仿真的步数
+	double traj_sq=0, traj_max=0;
+	int traj_n=0;
+	for (GridSlamProcessor::TNode* n=gsp->getParticles()[gsp->getBestParticleIndex()].node; n; n=n->parent)
+	{
+		if (!n->reading)
+			continue;
+		const OrientedPoint& t=truth[(int)n->reading->getTime()];
+		double e=sqrt((n->pose.x-t.x)*(n->pose.x-t.x)+(n->pose.y-t.y)*(n->pose.y-t.y));
+		traj_sq+=e*e;
+		traj_n++;
+		if (e>traj_max)
+			traj_max=e;
+	}
+
+	const PatchPool<ScanMatcherCell>& pool=PatchPool<ScanMatcherCell>::instance();
+	long rss_end=readStatus("VmRSS:"), rss_peak=readStatus("VmHWM:");
+
+	printf("config            %s\n", cfgfile.length() ? cfgfile.c_str() : "(default)");
+	printf("cell size         %d bytes\n", (int)sizeof(ScanMatcherCell));
+	printf("particles         %d  kld %d..%d  mean %.1f  max %u\n", particles, max_particles ? (int)gsp->getminParticles() : 0,
+			max_particles, processed ? sum_particles/processed : 0.0, max_count);
+	printf("likelihood field  %s\n", use_field ? "on" : "off");
+	printf("correlative       window %.2f m  %.3f rad\n", corr_window, corr_angle);
+	printf("processed scans   %d / %d\n", processed, steps);
+	printf("time per scan     %.2f ms\n", processed ? process_time/processed*1e3 : 0.0);
+	printf("resample          %.2f ms per update (tree weights, resampling and map update)\n", resampled ? resample_time/resampled*1e3 : 0.0);
+	printf("pose error        mean %.4f m  max %.4f m (best particle at each update)\n",
+		processed ? sum_err/processed : 0.0, max_err);
+	printf("trajectory error  rmse %.4f m  max %.4f m (best particle lineage, %d nodes)\n",
+		traj_n ? sqrt(traj_sq/traj_n) : 0.0, traj_max, traj_n);
+	printf("patches           live %lu  free %lu  recycled %lu  created %lu\n",
+		pool.liveNumber(), pool.freeNumber(), pool.recycledNumber(), pool.createdNumber());
+	const NodePool<GridSlamProcessor::TNode>& nodes=NodePool<GridSlamProcessor::TNode>::instance();
+	printf("tree nodes        live %lu  free %lu  pruned levels %u\n",
+		nodes.liveNumber(), nodes.freeNumber(), gsp->getprunedDepth());
+	printf("rss               start %ld kB  end %ld kB  peak %ld kB\n", rss_start, rss_end, rss_peak);
+
+	const GridSlamProcessor::Particle& bp=gsp->getParticles()[gsp->getBestParticleIndex()];
+	probeBenchmark(cfg, bp.map, bp.pose, beams, &angles[0], &ranges[0], maxrange, maxUrange);
+
+	delete gsp;
+	delete laser;
+	return 0;
+}
@@ -3,6 +3,8 @@
 #include <list>
 #include <map>
 #include <set>
+#include <algorithm>
+#include <functional>
 #include <fstream>
 #include <iomanip>
 #include "../include/gmapping/utils/stat.h"
@@ -25,6 +27,15 @@ using namespace std;
     m_obsSigmaGain=1;
     m_resampleThreshold=0.5;
     m_minimumScore=0.;
+    m_lowResolutionRatio=4;
+    m_minParticles=10;
+    m_maxParticles=0;
+    m_kldEpsilon=0.25;
+    m_kldZ=2.33;
+    m_kldLinearBin=0.5;
+    m_kldAngularBin=0.2;
+    m_maxTreeDepth=0;
+    m_prunedDepth=0;
   }
   
   GridSlamProcessor::GridSlamProcessor(const GridSlamProcessor& gsp) 
@@ -36,6 +47,15 @@ using namespace std;
     m_obsSigmaGain=gsp.m_obsSigmaGain;
     m_resampleThreshold=gsp.m_resampleThreshold;
     m_minimumScore=gsp.m_minimumScore;
+    m_lowResolutionRatio=gsp.m_lowResolutionRatio;
+    m_minParticles=gsp.m_minParticles;
+    m_maxParticles=gsp.m_maxParticles;
+    m_kldEpsilon=gsp.m_kldEpsilon;
+    m_kldZ=gsp.m_kldZ;
+    m_kldLinearBin=gsp.m_kldLinearBin;
+    m_kldAngularBin=gsp.m_kldAngularBin;
+    m_maxTreeDepth=gsp.m_maxTreeDepth;
+    m_prunedDepth=gsp.m_prunedDepth;
     
     m_beams=gsp.m_beams;
     m_indexes=gsp.m_indexes;
@@ -96,6 +116,15 @@ using namespace std;
     m_obsSigmaGain=1;
     m_resampleThreshold=0.5;
     m_minimumScore=0.;
+    m_lowResolutionRatio=4;
+    m_minParticles=10;
+    m_maxParticles=0;
+    m_kldEpsilon=0.25;
+    m_kldZ=2.33;
+    m_kldLinearBin=0.5;
+    m_kldAngularBin=0.2;
+    m_maxTreeDepth=0;
+    m_prunedDepth=0;
 	
   }
 
@@ -103,14 +132,14 @@ using namespace std;
   {
 # ifdef MAP_CONSISTENCY_CHECK
     cerr << __PRETTY_FUNCTION__ << ": performing preclone_fit_test" << endl;
-    typedef std::map<autoptr< Array2D<PointAccumulator> >::reference* const, int> PointerMap;
+    typedef std::map<patchptr<ScanMatcherCell>::reference* const, int> PointerMap;
     PointerMap pmap;
 	for (ParticleVector::const_iterator it=m_particles.begin(); it!=m_particles.end(); it++){
 	  const ScanMatcherMap& m1(it->map);
-	  const HierarchicalArray2D<PointAccumulator>& h1(m1.storage());
+	  const HierarchicalArray2D<ScanMatcherCell>& h1(m1.storage());
  	  for (int x=0; x<h1.getXSize(); x++){
 	    for (int y=0; y<h1.getYSize(); y++){
-	      const autoptr< Array2D<PointAccumulator> >& a1(h1.m_cells[x][y]);
+	      const patchptr<ScanMatcherCell>& a1(h1.m_cells[x][y]);
 	      if (a1.m_reference){
 		PointerMap::iterator f=pmap.find(a1.m_reference);
 		if (f==pmap.end())
@@ -136,13 +165,13 @@ using namespace std;
 	for (ParticleVector::const_iterator it=m_particles.begin(); it!=m_particles.end(); it++){
 	  const ScanMatcherMap& m1(it->map);
 	  const ScanMatcherMap& m2(jt->map);
-	  const HierarchicalArray2D<PointAccumulator>& h1(m1.storage());
-	  const HierarchicalArray2D<PointAccumulator>& h2(m2.storage());
+	  const HierarchicalArray2D<ScanMatcherCell>& h1(m1.storage());
+	  const HierarchicalArray2D<ScanMatcherCell>& h2(m2.storage());
 	  jt++;
  	  for (int x=0; x<h1.getXSize(); x++){
 	    for (int y=0; y<h1.getYSize(); y++){
-	      const autoptr< Array2D<PointAccumulator> >& a1(h1.m_cells[x][y]);
-	      const autoptr< Array2D<PointAccumulator> >& a2(h2.m_cells[x][y]);
+	      const patchptr<ScanMatcherCell>& a1(h1.m_cells[x][y]);
+	      const patchptr<ScanMatcherCell>& a2(h2.m_cells[x][y]);
 	      assert(a1.m_reference==a2.m_reference);
 	      assert((!a1.m_reference) || !(a1.m_reference->shares%2));
 	    }
@@ -171,14 +200,14 @@ using namespace std;
     
 # ifdef MAP_CONSISTENCY_CHECK
     cerr << __PRETTY_FUNCTION__ << ": performing predestruction_fit_test" << endl;
-    typedef std::map<autoptr< Array2D<PointAccumulator> >::reference* const, int> PointerMap;
+    typedef std::map<patchptr<ScanMatcherCell>::reference* const, int> PointerMap;
     PointerMap pmap;
     for (ParticleVector::const_iterator it=m_particles.begin(); it!=m_particles.end(); it++){
       const ScanMatcherMap& m1(it->map);
-      const HierarchicalArray2D<PointAccumulator>& h1(m1.storage());
+      const HierarchicalArray2D<ScanMatcherCell>& h1(m1.storage());
       for (int x=0; x<h1.getXSize(); x++){
 	for (int y=0; y<h1.getYSize(); y++){
-	  const autoptr< Array2D<PointAccumulator> >& a1(h1.m_cells[x][y]);
+	  const patchptr<ScanMatcherCell>& a1(h1.m_cells[x][y]);
 	  if (a1.m_reference){
 	    PointerMap::iterator f=pmap.find(a1.m_reference);
 	    if (f==pmap.end())
@@ -266,6 +295,24 @@ void GridSlamProcessor::setMotionModelParameters
   }
   
   
+  /*
+   * 交换两个粒子 地图只交换patch数组的指针 重采样的时候用来代替粒子的复制
+   */
+  void GridSlamProcessor::Particle::swap(Particle& p)
+  {
+    map.swap(p.map);
+    running_scans.swap(p.running_scans);
+    lowResolutionMap.swap(p.lowResolutionMap);
+    std::swap(pose, p.pose);
+    std::swap(previousPose, p.previousPose);
+    std::swap(weight, p.weight);
+    std::swap(weightSum, p.weightSum);
+    std::swap(gweight, p.gweight);
+    std::swap(previousIndex, p.previousIndex);
+    std::swap(node, p.node);
+  }
+  
+  
   void GridSlamProcessor::setSensorMap(const SensorMap& smap)
   {
     
@@ -315,9 +362,9 @@ void GridSlamProcessor::setMotionModelParameters
     TNode* node=new TNode(initialPose, 0, 0, 0);
 
     //粒子对应的地图进行初始化 用两个地图来进行初始化 一个高分辨率地图 一个低分辨率地图
-    //高分辨率地图由自己指定 低分辨率地图固定为0.1m
+    //高分辨率地图由自己指定 低分辨率地图的分辨率为delta*lowResolutionRatio
     ScanMatcherMap lmap(Point(xmin+xmax, ymin+ymax)*.5, xmax-xmin, ymax-ymin, delta);
-    ScanMatcherMap lowMap(Point(xmin+xmax,ymin+ymax)*0.5,xmax-xmin,ymax-ymin,0.1);
+    ScanMatcherMap lowMap(Point(xmin+xmax,ymin+ymax)*0.5,xmax-xmin,ymax-ymin,delta*(m_lowResolutionRatio>1 ? m_lowResolutionRatio : 1));
     for (unsigned int i=0; i<size; i++)
 	{
       m_particles.push_back(Particle(lmap,lowMap));
@@ -499,6 +546,9 @@ void GridSlamProcessor::setMotionModelParameters
                                    static_cast<const RangeSensor*>(reading.getSensor()),
                                    reading.getTime());
           }
+          //所有粒子的新节点共享这一份激光数据 没有节点引用的时候自动删除
+          readingptr shared_reading(reading_copy);
+
           /*如果不是第一帧数据*/
           if (m_count>0)
           {
@@ -524,7 +574,15 @@ void GridSlamProcessor::setMotionModelParameters
              * GridSlamProcessor::resample 函数在gridslamprocessor.hxx里面实现
              */
             std::cerr<<"plainReading:"<<m_beams<<std::endl;
-            resample(plainReading, adaptParticles, reading_copy);
+            resample(plainReading, adaptParticles, shared_reading);
+
+            //地图patch内存池的使用情况
+            if (m_infoStream)
+            {
+              const PatchPool<ScanMatcherCell>& pool=PatchPool<ScanMatcherCell>::instance();
+              m_infoStream << "Patches live=" << pool.liveNumber() << " free=" << pool.freeNumber()
+                           << " recycled=" << pool.recycledNumber() << " created=" << pool.createdNumber() << std::endl;
+            }
           }
           /*如果是第一帧激光数据*/
           else
@@ -535,16 +593,24 @@ void GridSlamProcessor::setMotionModelParameters
                 m_matcher.invalidateActiveArea();
                 m_matcher.computeActiveArea(it->map, it->pose, plainReading);
                 m_matcher.registerScan(it->map, it->pose, plainReading);
-                //m_matcher.registerScan(it->lowResolutionMap,it->pose,plainReading);
+                if (m_matcher.correlativeSearchEnabled())
+                {
+                    //低分辨率地图要重新计算activeArea 否则地图不会扩充 共享的patch也不会被复制
+                    m_matcher.invalidateActiveArea();
+                    m_matcher.registerScan(it->lowResolutionMap, it->pose, plainReading);
+                }
 
                 //为每个粒子创建路径的第一个节点。该节点的权重为0,父节点为it->node(这个时候为NULL)。
                 //因为第一个节点就是轨迹的根，所以没有父节点
                 TNode* node=new	TNode(it->pose, 0., it->node,  0);
-                node->reading = reading_copy;
+                node->reading = shared_reading;
                 it->node=node;
             }
          }
           //		cerr  << "Tree: normalizing, resetting and propagating weights at the end..." ;
+         //轨迹太长的时候把最老的节点剪掉 之后的遍历只需要访问maxTreeDepth个节点
+         pruneTree();
+
          //进行重采样之后，粒子的权重又会发生变化，因此需要再次更新粒子轨迹的累计权重
          //GridSlamProcessor::updateTreeWeights(bool weightsAlreadyNormalized) 函数在gridslamprocessor_tree.cpp里面实现
          updateTreeWeights(false);
@@ -601,6 +667,99 @@ void GridSlamProcessor::setMotionModelParameters
     return (int) bi;
   }
 
+  /*
+  KLD-sampling 决定重采样之后的粒子数
+  按照权重依次抽取粒子 用位姿直方图统计抽到的粒子占据了多少个bin，
+  抽到的粒子数达到bin的数量对应的KLD界限的时候停止，结果限制在[minParticles, maxParticles]之间。
+  粒子集中在一起的时候(比如在走廊里定位得很好)粒子数减少，粒子分散的时候(比如回环的时候)粒子数增加。
+  */
+  unsigned int GridSlamProcessor::kldParticleNumber() const
+  {
+    //低方差采样得到的下标是有序的 打乱之后就相当于依次独立地抽取
+    uniform_resampler<double, double> resampler;
+    std::vector<unsigned int> indexes=resampler.resampleIndexes(m_weights, m_maxParticles);
+    for (int i=(int)indexes.size()-1; i>0; i--)
+      std::swap(indexes[i], indexes[(int)(drand48()*(i+1))%(i+1)]);
+
+    unsigned int minimum=m_minParticles>0 ? m_minParticles : 1;
+    std::set< std::pair<std::pair<int,int>,int> > bins;
+    unsigned int n=0;
+    while (n<indexes.size())
+    {
+      const OrientedPoint& p=m_particles[indexes[n]].pose;
+      int bx=(int)floor(p.x/m_kldLinearBin);
+      int by=(int)floor(p.y/m_kldLinearBin);
+      int bt=(int)floor(atan2(sin(p.theta), cos(p.theta))/m_kldAngularBin);
+      bins.insert(std::make_pair(std::make_pair(bx, by), bt));
+      n++;
+      if (n>=minimum && n>=resampler.kldSize(bins.size(), m_kldEpsilon, m_kldZ))
+        break;
+    }
+
+    if (m_infoStream)
+      m_infoStream << "KLD bins=" << bins.size() << " particles=" << n << std::endl;
+    return n;
+  }
+
+  /*
+  不重采样 直接把粒子数调整到size 在没有触发重采样的更新中使用
+  减少粒子的时候删掉权重最小的粒子 它们的叶子节点也一起删除
+  增加粒子的时候把权重最大的粒子分成两个权重各一半的粒子 每个粒子最多分一次 所以一次最多增加一倍
+  其它粒子和它们的权重都不变 不会像重采样那样让粒子失去多样性
+  */
+  void GridSlamProcessor::adaptParticleNumber(unsigned int size)
+  {
+    unsigned int number=m_particles.size();
+    std::vector<std::pair<double, unsigned int> > order(number);
+    for (unsigned int i=0; i<number; i++)
+      order[i]=std::make_pair(m_weights[i], i);
+    std::sort(order.begin(), order.end(), std::greater<std::pair<double, unsigned int> >());
+
+    if (size<number)
+    {
+      ParticleVector temp;
+      temp.reserve(size);
+      const ScanMatcherMap emptyMap(Point(0,0), 0., 0., m_particles[0].map.getDelta());
+      const Particle emptyParticle(emptyMap, emptyMap);
+
+      //保留的粒子按原来的顺序排列
+      std::vector<bool> keep(number, false);
+      for (unsigned int i=0; i<size; i++)
+        keep[order[i].second]=true;
+      for (unsigned int i=0; i<number; i++)
+      {
+        if (keep[i])
+        {
+          temp.push_back(emptyParticle);
+          temp.back().swap(m_particles[i]);
+        }
+        else
+        {
+          delete m_particles[i].node;
+          m_particles[i].node=0;
+        }
+      }
+      m_particles.swap(temp);
+    }
+    else
+    {
+      //权重是对数似然 归一化的时候乘以gain 减去log(2)/gain就是权重减半
+      double gain=1./(m_obsSigmaGain*number);
+      unsigned int split=std::min(size, 2*number)-number;
+      m_particles.reserve(number+split);
+      for (unsigned int i=0; i<split; i++)
+      {
+        Particle& p=m_particles[order[i].second];
+        p.weight-=log(2.)/gain;
+        m_particles.push_back(p);
+      }
+    }
+
+    if (m_infoStream)
+      m_infoStream << "KLD particles " << number << " -> " << m_particles.size() << std::endl;
+    normalize();
+  }
+
   void GridSlamProcessor::onScanmatchUpdate(){}
   void GridSlamProcessor::onResampleUpdate(){}
   void GridSlamProcessor::onOdometryUpdate(){}
@@ -26,7 +26,6 @@ GridSlamProcessor::TNode::TNode(const OrientedPoint& p, double w, TNode* n, unsi
 	weight=w;
 	childs=c;
 	parent=n;
-	reading=0;
 	gweight=0;
 
 	if (n)
@@ -44,6 +43,17 @@ GridSlamProcessor::TNode::~TNode()
 	assert(!childs);
 }
 
+void* GridSlamProcessor::TNode::operator new(size_t size)
+{
+	assert(size==sizeof(TNode));
+	return NodePool<TNode>::instance().alloc();
+}
+
+void GridSlamProcessor::TNode::operator delete(void* p)
+{
+	NodePool<TNode>::instance().release(p);
+}
+
 
 //BEGIN State Save/Restore
 /*
@@ -249,6 +259,44 @@ void  GridSlamProcessor::updateTreeWeights(bool weightsAlreadyNormalized)
   propagateWeights();
 }
 
+/*
+把轨迹的长度限制在maxTreeDepth个节点以内
+每次更新每个粒子都增加一个节点 所以所有的叶子节点到根节点的距离都是一样的，
+从叶子节点往上数maxTreeDepth个节点，把这一层节点和父节点断开，
+父节点没有子节点之后会被删除，它的父节点也会依次被删除，节点引用的激光数据也随之释放。
+被剪掉的部分对粒子的权重没有影响，但是不能保证已经被所有的粒子共享了：
+粒子的祖先可能还没有汇合到同一个节点，剪过之后轨迹树会变成多棵树，各个分支在剪枝边界之前的部分就丢掉了。
+使用轨迹建图的代码(slam_gmapping的updateMap())要自己保存被剪掉的部分。
+轨迹的起点变了 prunedDepth记录一共剪掉了多少层，用来计算节点到原来的根节点的深度。
+*/
+void GridSlamProcessor::pruneTree()
+{
+	if (!m_maxTreeDepth || m_particles.empty())
+		return;
+
+	//轨迹的长度 剪过之后最多是maxTreeDepth+1
+	unsigned int depth=0;
+	for (TNode* n=m_particles[0].node; n; n=n->parent)
+		depth++;
+	if (depth<=m_maxTreeDepth)
+		return;
+
+	for (ParticleVector::iterator it=m_particles.begin(); it!=m_particles.end(); it++)
+	{
+		TNode* n=it->node;
+		for (unsigned int d=1; n && d<m_maxTreeDepth; d++)
+			n=n->parent;
+		//多个粒子共享同一个节点的时候 第一次已经断开了
+		if (!n || !n->parent)
+			continue;
+		TNode* parent=n->parent;
+		n->parent=0;
+		if ((--parent->childs)<=0)
+			delete parent;
+	}
+	m_prunedDepth+=depth-m_maxTreeDepth;
+}
+
 /*把所有粒子的所有的轨迹中各个节点的accWeight清零*/
 void GridSlamProcessor::resetTree()
 {
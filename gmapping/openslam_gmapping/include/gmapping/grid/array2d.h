@@ -6,6 +6,7 @@
 #include "accessstate.h"
 
 #include <iostream>
+#include <algorithm>
 
 #ifndef __PRETTY_FUNCTION__
 #define __FUNCDNAME__
@@ -30,6 +31,9 @@ template<class Cell, const bool debug=false> class Array2D
 		Array2D(const Array2D<Cell,debug> &);
 		~Array2D();
 		
+		/*交换两个数组的数据 不复制cell*/
+		inline void swap(Array2D& g);
+
 		/*清除和重定义大小*/
 		void clear();
 		void resize(int xmin, int ymin, int xmax, int ymax);
@@ -170,6 +174,14 @@ Array2D<Cell,debug>::~Array2D()
   m_cells=0;
 }
 
+template <class Cell, const bool debug>
+void Array2D<Cell,debug>::swap(Array2D<Cell,debug>& g)
+{
+	std::swap(m_cells, g.m_cells);
+	std::swap(m_xsize, g.m_xsize);
+	std::swap(m_ysize, g.m_ysize);
+}
+
 /*
 @desc 清除函数，清除所有的数据
 */
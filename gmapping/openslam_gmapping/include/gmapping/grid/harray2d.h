@@ -2,8 +2,8 @@
 #define HARRAY2D_H
 #include <set>
 #include <gmapping/utils/point.h>
-#include <gmapping/utils/autoptr.h>
 #include "array2d.h"
+#include "patchpool.h"
 
 namespace GMapping
 {
@@ -29,7 +29,7 @@ patch的实际大小表示一个patch里面包含有m_patchSize*m_patchSize的ce
 
 */
 template <class Cell>
-class HierarchicalArray2D: public Array2D<autoptr< Array2D<Cell> > >
+class HierarchicalArray2D: public Array2D<patchptr<Cell> >
 {
 	public:
 		typedef std::set< point<int>, pointcomparator<int> > PointSet;
@@ -38,6 +38,9 @@ class HierarchicalArray2D: public Array2D<autoptr< Array2D<Cell> > >
 		HierarchicalArray2D(int xsize, int ysize, int patchMagnitude=5);
 		HierarchicalArray2D(const HierarchicalArray2D& hg);
 		HierarchicalArray2D& operator=(const HierarchicalArray2D& hg);
+
+		/*交换两个地图的patch数组 不改变patch的引用计数*/
+		inline void swap(HierarchicalArray2D& hg);
 		
 		virtual ~HierarchicalArray2D(){}
 		
@@ -63,7 +66,7 @@ class HierarchicalArray2D: public Array2D<autoptr< Array2D<Cell> > >
 		const PointSet& getActiveArea() const {return m_activeArea; }
 		inline void allocActiveArea();
 	protected:
-		virtual Array2D<Cell> * createPatch(const IntPoint& p) const;
+		virtual patchptr<Cell> createPatch(const IntPoint& p) const;
 		PointSet m_activeArea;  //存储地图中使用到的Cell的坐标
 		
 		int m_patchMagnitude;   //patch的大小等级  
@@ -76,7 +79,7 @@ class HierarchicalArray2D: public Array2D<autoptr< Array2D<Cell> > >
 */
 template <class Cell>
 HierarchicalArray2D<Cell>::HierarchicalArray2D(int xsize, int ysize, int patchMagnitude) 
-  :Array2D<autoptr< Array2D<Cell> > >::Array2D((xsize>>patchMagnitude), (ysize>>patchMagnitude))
+  :Array2D<patchptr<Cell> >::Array2D((xsize>>patchMagnitude), (ysize>>patchMagnitude))
 {
 	m_patchMagnitude=patchMagnitude;
 	m_patchSize=1<<m_patchMagnitude;
@@ -84,13 +87,14 @@ HierarchicalArray2D<Cell>::HierarchicalArray2D(int xsize, int ysize, int patchMa
 
 template <class Cell>
 HierarchicalArray2D<Cell>::HierarchicalArray2D(const HierarchicalArray2D& hg)
-  :Array2D<autoptr< Array2D<Cell> > >::Array2D((hg.m_xsize>>hg.m_patchMagnitude), (hg.m_ysize>>hg.m_patchMagnitude))  // added by cyrill: if you have a resize error, check this again
+  :Array2D<patchptr<Cell> >::Array2D(0, 0)
 {
+	//基类不分配内存 数组按照hg的大小在下面分配
 	this->m_xsize=hg.m_xsize;
 	this->m_ysize=hg.m_ysize;
-	this->m_cells=new autoptr< Array2D<Cell> >*[this->m_xsize];
+	this->m_cells=new patchptr<Cell>*[this->m_xsize];
 	for (int x=0; x<this->m_xsize; x++){
-		this->m_cells[x]=new autoptr< Array2D<Cell> >[this->m_ysize];
+		this->m_cells[x]=new patchptr<Cell>[this->m_ysize];
 		for (int y=0; y<this->m_ysize; y++)
 			this->m_cells[x][y]=hg.m_cells[x][y];
 	}
@@ -98,6 +102,15 @@ HierarchicalArray2D<Cell>::HierarchicalArray2D(const HierarchicalArray2D& hg)
 	this->m_patchSize=hg.m_patchSize;
 }
 
+template <class Cell>
+void HierarchicalArray2D<Cell>::swap(HierarchicalArray2D& hg)
+{
+	Array2D<patchptr<Cell> >::swap(hg);
+	m_activeArea.swap(hg.m_activeArea);
+	std::swap(m_patchMagnitude, hg.m_patchMagnitude);
+	std::swap(m_patchSize, hg.m_patchSize);
+}
+
 /**
  *重新扩充地图的大小
  */
@@ -107,13 +120,13 @@ void HierarchicalArray2D<Cell>::resize(int xmin, int ymin, int xmax, int ymax)
 	int xsize=xmax-xmin;
 	int ysize=ymax-ymin;
     //分配一个xsize*ysize大小的patch的内存
-	autoptr< Array2D<Cell> > ** newcells=new autoptr< Array2D<Cell> > *[xsize];
+	patchptr<Cell> ** newcells=new patchptr<Cell> *[xsize];
 	for (int x=0; x<xsize; x++)
 	{
-		newcells[x]=new autoptr< Array2D<Cell> >[ysize];
+		newcells[x]=new patchptr<Cell>[ysize];
 		for (int y=0; y<ysize; y++)
 		{
-			newcells[x][y]=autoptr< Array2D<Cell> >(0);
+			newcells[x][y]=patchptr<Cell>();
 		}
 	}
 	
@@ -143,7 +156,7 @@ void HierarchicalArray2D<Cell>::resize(int xmin, int ymin, int xmax, int ymax)
 template <class Cell>
 HierarchicalArray2D<Cell>& HierarchicalArray2D<Cell>::operator=(const HierarchicalArray2D& hg)
 {
-//	Array2D<autoptr< Array2D<Cell> > >::operator=(hg);
+//	Array2D<patchptr<Cell> >::operator=(hg);
     //如果复制的两个地图的大小不一样 则需要把目前的地图删除，然后重新复制为新的地图
 
     //删除当前地图 并且分配内存
@@ -155,9 +168,9 @@ HierarchicalArray2D<Cell>& HierarchicalArray2D<Cell>::operator=(const Hierarchic
 
 		this->m_xsize=hg.m_xsize;
 		this->m_ysize=hg.m_ysize;
-		this->m_cells=new autoptr< Array2D<Cell> >*[this->m_xsize];
+		this->m_cells=new patchptr<Cell>*[this->m_xsize];
 		for (int i=0; i<this->m_xsize; i++)
-			this->m_cells[i]=new autoptr< Array2D<Cell> > [this->m_ysize];
+			this->m_cells[i]=new patchptr<Cell> [this->m_ysize];
 	}
 
     //赋值为新的地图
@@ -203,11 +216,12 @@ void HierarchicalArray2D<Cell>::setActiveArea(const typename HierarchicalArray2D
 /*
 @一个patch表示一个Array2D
 patch的大小有m_patchMagnitude指定
+patch从内存池中分配 见patchpool.h
 */
 template <class Cell>
-Array2D<Cell>* HierarchicalArray2D<Cell>::createPatch(const IntPoint& ) const
+patchptr<Cell> HierarchicalArray2D<Cell>::createPatch(const IntPoint& ) const
 {
-	return new Array2D<Cell>(1<<m_patchMagnitude, 1<<m_patchMagnitude);
+	return patchptr<Cell>(PatchPool<Cell>::instance().alloc(1<<m_patchMagnitude));
 }
 
 
@@ -242,19 +256,18 @@ void HierarchicalArray2D<Cell>::allocActiveArea()
 {
 	for (PointSet::const_iterator it= m_activeArea.begin(); it!=m_activeArea.end(); ++it)
 	{
-		const autoptr< Array2D<Cell> >& ptr=this->m_cells[it->x][it->y];
-		Array2D<Cell>* patch=0;
+		patchptr<Cell>& ptr=this->m_cells[it->x][it->y];
         //如果对应的active没有被分配内存 则进行内存分配
 		if (!ptr)
 		{
-			patch=createPatch(*it);
+			ptr=createPatch(*it);
 		} 
-        //如果已经分配了还是赋原值
-		else
+        //如果已经分配了并且和别的地图共享 则复制一份 复制的patch也是从内存池中分配的
+        //只被这个地图使用的patch不需要复制
+		else if (ptr.m_reference->shares>1)
 		{	
-			patch=new Array2D<Cell>(*ptr);
+			ptr=patchptr<Cell>(PatchPool<Cell>::instance().clone(ptr.m_reference));
 		}
-		this->m_cells[it->x][it->y]=autoptr< Array2D<Cell> >(patch);
 	}
 }
 
@@ -265,7 +278,7 @@ template <class Cell>
 bool HierarchicalArray2D<Cell>::isAllocated(int x, int y) const
 {
 	IntPoint c=patchIndexes(x,y);
-	autoptr< Array2D<Cell> >& ptr=this->m_cells[c.x][c.y];
+	patchptr<Cell>& ptr=this->m_cells[c.x][c.y];
 	return (ptr != 0);
 }
 
@@ -292,11 +305,10 @@ Cell& HierarchicalArray2D<Cell>::cell(int x, int y)
 	assert(this->isInside(c.x, c.y));
 	if (!this->m_cells[c.x][c.y])
 	{
-		Array2D<Cell>* patch=createPatch(IntPoint(x,y));
-		this->m_cells[c.x][c.y]=autoptr< Array2D<Cell> >(patch);
+		this->m_cells[c.x][c.y]=createPatch(IntPoint(x,y));
 		//cerr << "!!! FATAL: your dick is going to fall down" << endl;
 	}
-	autoptr< Array2D<Cell> >& ptr=this->m_cells[c.x][c.y];
+	patchptr<Cell>& ptr=this->m_cells[c.x][c.y];
 	return (*ptr).cell(IntPoint(x-(c.x<<m_patchMagnitude),y-(c.y<<m_patchMagnitude)));
 }
 
@@ -306,7 +318,7 @@ const Cell& HierarchicalArray2D<Cell>::cell(int x, int y) const
 {
 	assert(isAllocated(x,y));
 	IntPoint c=patchIndexes(x,y);
-	const autoptr< Array2D<Cell> >& ptr=this->m_cells[c.x][c.y];
+	const patchptr<Cell>& ptr=this->m_cells[c.x][c.y];
 	return (*ptr).cell(IntPoint(x-(c.x<<m_patchMagnitude),y-(c.y<<m_patchMagnitude)));
 }
 
@@ -30,6 +30,9 @@ class Map
 		//Map(const Map& g);
 		//Map& operator =(const Map& g);
 		
+		/*交换两个地图 只交换存储的指针 不复制数据*/
+		inline void swap(Map& g);
+
 		void resize(double xmin, double ymin, double xmax, double ymax);
 		void grow(double xmin, double ymin, double xmax, double ymax);
 		
@@ -119,6 +122,20 @@ class Map
 
 typedef Map<double, DoubleArray2D, false> DoubleMap;	//浮点数地图
 
+template <class Cell, class Storage, const bool isClass>
+void Map<Cell,Storage,isClass>::swap(Map& g)
+{
+	std::swap(m_center, g.m_center);
+	std::swap(m_worldSizeX, g.m_worldSizeX);
+	std::swap(m_worldSizeY, g.m_worldSizeY);
+	std::swap(m_delta, g.m_delta);
+	m_storage.swap(g.m_storage);
+	std::swap(m_mapSizeX, g.m_mapSizeX);
+	std::swap(m_mapSizeY, g.m_mapSizeY);
+	std::swap(m_sizeX2, g.m_sizeX2);
+	std::swap(m_sizeY2, g.m_sizeY2);
+}
+
 template <class Cell, class Storage, const bool isClass>
   const Cell  Map<Cell,Storage,isClass>::m_unknown = Cell(-1);
 
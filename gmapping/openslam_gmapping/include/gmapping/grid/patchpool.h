@@ -0,0 +1,236 @@
+#ifndef PATCHPOOL_H
+#define PATCHPOOL_H
+
+#include <vector>
+#include <assert.h>
+#include "array2d.h"
+
+namespace GMapping {
+
+/*
+ * HierarchicalArray2D中patch的内存池
+ *
+ * 原来每个patch都是用new分配的一个Array2D<Cell>，每一列都要单独new一次，
+ * 另外autoptr还要为每个patch分配一个引用计数的结构体。
+ * 重采样的时候每个粒子都要复制activeArea里面的patch，因此内存分配非常频繁。
+ *
+ * 这里把引用计数放在patch的头部，patch的头部按照slab的方式成批分配，
+ * patch不再使用之后放回空闲链表，下次分配的时候直接使用，cell的内存也一起保留下来。
+ * 内存池中的内存在程序结束之前不会还给系统。
+ *
+ * 粒子的地图是在多个线程中更新的 因此分配和回收用一个自旋锁保护
+ */
+template <class Cell>
+class PatchPool
+{
+	public:
+		struct Patch
+		{
+			volatile unsigned int shares;	//引用计数
+			Patch* next;					//在空闲链表中的时候指向下一个空闲的patch
+			Array2D<Cell> data;				//patch中的cell
+		};
+
+		/*每种cell类型一个内存池*/
+		static PatchPool& instance();
+
+		/*分配一个size*size的patch 所有的cell都是初始值 引用计数为1*/
+		Patch* alloc(int size);
+
+		/*复制一个patch 引用计数为1*/
+		Patch* clone(const Patch* p);
+
+		/*引用计数变为0的时候调用 把patch放回空闲链表*/
+		void release(Patch* p);
+
+		/*正在使用的patch的数量*/
+		inline unsigned long liveNumber() const {return m_live;}
+		/*空闲链表中的patch的数量*/
+		inline unsigned long freeNumber() const {return m_free;}
+		/*从空闲链表中重复使用patch的次数*/
+		inline unsigned long recycledNumber() const {return m_recycled;}
+		/*一共创建的patch的数量*/
+		inline unsigned long createdNumber() const {return m_created;}
+
+		~PatchPool();
+
+	protected:
+		PatchPool();
+
+		/*从空闲链表中取出一个patch 空闲链表为空的时候分配一个新的slab*/
+		Patch* take();
+
+		inline void lock() { while (__sync_lock_test_and_set(&m_lock, 1)) ; }
+		inline void unlock() { __sync_lock_release(&m_lock); }
+
+		static const int SlabSize=64;
+
+		std::vector<Patch*> m_slabs;
+		Patch* m_freeList;
+		volatile int m_lock;
+
+		unsigned long m_live, m_free, m_recycled, m_created;
+};
+
+template <class Cell>
+PatchPool<Cell>& PatchPool<Cell>::instance()
+{
+	static PatchPool<Cell> pool;
+	return pool;
+}
+
+template <class Cell>
+PatchPool<Cell>::PatchPool():
+	m_freeList(0), m_lock(0), m_live(0), m_free(0), m_recycled(0), m_created(0)
+{
+}
+
+template <class Cell>
+PatchPool<Cell>::~PatchPool()
+{
+	for (unsigned int i=0; i<m_slabs.size(); i++)
+		delete [] m_slabs[i];
+}
+
+template <class Cell>
+typename PatchPool<Cell>::Patch* PatchPool<Cell>::take()
+{
+	lock();
+	if (!m_freeList)
+	{
+		Patch* slab=new Patch[SlabSize];
+		m_slabs.push_back(slab);
+		for (int i=0; i<SlabSize; i++)
+		{
+			slab[i].next=m_freeList;
+			m_freeList=slab+i;
+		}
+		m_free+=SlabSize;
+	}
+	else if (m_freeList->data.getXSize())
+	{
+		//cell的内存已经分配过 是重复使用的patch
+		m_recycled++;
+	}
+	Patch* p=m_freeList;
+	m_freeList=p->next;
+	m_free--;
+	m_live++;
+	unlock();
+
+	p->next=0;
+	p->shares=1;
+	return p;
+}
+
+template <class Cell>
+typename PatchPool<Cell>::Patch* PatchPool<Cell>::alloc(int size)
+{
+	Patch* p=take();
+	if (p->data.getXSize()!=size || p->data.getYSize()!=size)
+	{
+		//第一次使用 分配cell的内存
+		p->data.clear();
+		p->data.resize(0, 0, size, size);
+		lock();
+		m_created++;
+		unlock();
+	}
+	else
+	{
+		//重复使用的patch 把cell恢复为初始值
+		Cell** cells=p->data.cells();
+		for (int x=0; x<size; x++)
+			for (int y=0; y<size; y++)
+				cells[x][y]=Cell();
+	}
+	return p;
+}
+
+template <class Cell>
+typename PatchPool<Cell>::Patch* PatchPool<Cell>::clone(const Patch* q)
+{
+	Patch* p=take();
+	if (p->data.getXSize()!=q->data.getXSize() || p->data.getYSize()!=q->data.getYSize())
+	{
+		lock();
+		m_created++;
+		unlock();
+	}
+	//大小相同的时候Array2D的赋值不会重新分配内存
+	p->data=q->data;
+	return p;
+}
+
+template <class Cell>
+void PatchPool<Cell>::release(Patch* p)
+{
+	assert(!p->shares);
+	lock();
+	p->next=m_freeList;
+	m_freeList=p;
+	m_free++;
+	m_live--;
+	unlock();
+}
+
+
+/*
+ * 指向内存池中的patch的智能指针 替换原来的autoptr< Array2D<Cell> >
+ * 引用计数保存在patch的头部，用原子操作增减，引用计数为0的时候patch回到内存池中。
+ */
+template <class Cell>
+class patchptr
+{
+	public:
+		typedef typename PatchPool<Cell>::Patch reference;
+
+		inline patchptr(): m_reference(0) {}
+		/*接管一个从内存池中分配出来的patch 引用计数已经为1*/
+		inline explicit patchptr(reference* r): m_reference(r) {}
+		inline patchptr(const patchptr& ap);
+		inline patchptr& operator=(const patchptr& ap);
+		inline ~patchptr() { release(); }
+
+		inline operator int() const { return m_reference!=0; }
+		inline Array2D<Cell>& operator*() { assert(m_reference); return m_reference->data; }
+		inline const Array2D<Cell>& operator*() const { assert(m_reference); return m_reference->data; }
+
+		reference* m_reference;
+
+	protected:
+		inline void release();
+};
+
+template <class Cell>
+patchptr<Cell>::patchptr(const patchptr& ap)
+{
+	m_reference=ap.m_reference;
+	if (m_reference)
+		__sync_add_and_fetch(&m_reference->shares, 1);
+}
+
+template <class Cell>
+patchptr<Cell>& patchptr<Cell>::operator=(const patchptr& ap)
+{
+	if (m_reference==ap.m_reference)
+		return *this;
+	//先增加新的引用再释放旧的引用
+	if (ap.m_reference)
+		__sync_add_and_fetch(&ap.m_reference->shares, 1);
+	release();
+	m_reference=ap.m_reference;
+	return *this;
+}
+
+template <class Cell>
+void patchptr<Cell>::release()
+{
+	if (m_reference && __sync_sub_and_fetch(&m_reference->shares, 1)==0)
+		PatchPool<Cell>::instance().release(m_reference);
+	m_reference=0;
+}
+
+};
+
+#endif
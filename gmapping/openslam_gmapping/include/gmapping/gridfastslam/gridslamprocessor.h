@@ -15,10 +15,77 @@
 #include "../include/gmapping/sensor/sensor_range/rangereading.h"
 #include "../include/gmapping/scanmatcher/scanmatcher.h"
 #include "motionmodel.h"
+#include "nodepool.h"
 
 
 namespace GMapping {
 
+  /*
+   * 轨迹树节点中保存的激光数据的引用计数指针
+   * 一帧激光数据被这一次更新中所有粒子的节点共享 只保存一份
+   * 最后一个引用它的节点被删除的时候激光数据也被删除 原来的激光数据永远不会被删除
+   * 可以像const RangeReading*一样使用
+   */
+  class readingptr
+  {
+  public:
+    inline readingptr(): m_shared(0) {}
+    /*接管一帧new出来的激光数据*/
+    inline explicit readingptr(RangeReading* r);
+    inline readingptr(const readingptr& rp);
+    inline readingptr& operator=(const readingptr& rp);
+    inline ~readingptr() { release(); }
+
+    inline operator const RangeReading*() const { return m_shared ? m_shared->reading : 0; }
+    inline const RangeReading* operator->() const { return m_shared->reading; }
+
+  protected:
+    struct Shared
+    {
+      RangeReading* reading;
+      volatile unsigned int shares;
+    };
+    inline void release();
+    Shared* m_shared;
+  };
+
+  readingptr::readingptr(RangeReading* r): m_shared(0)
+  {
+    if (r)
+    {
+      m_shared=new Shared;
+      m_shared->reading=r;
+      m_shared->shares=1;
+    }
+  }
+
+  readingptr::readingptr(const readingptr& rp): m_shared(rp.m_shared)
+  {
+    if (m_shared)
+      __sync_add_and_fetch(&m_shared->shares, 1);
+  }
+
+  readingptr& readingptr::operator=(const readingptr& rp)
+  {
+    if (m_shared==rp.m_shared)
+      return *this;
+    if (rp.m_shared)
+      __sync_add_and_fetch(&rp.m_shared->shares, 1);
+    release();
+    m_shared=rp.m_shared;
+    return *this;
+  }
+
+  void readingptr::release()
+  {
+    if (m_shared && __sync_sub_and_fetch(&m_shared->shares, 1)==0)
+    {
+      delete m_shared->reading;
+      delete m_shared;
+    }
+    m_shared=0;
+  }
+
   /**This class defines the basic GridFastSLAM algorithm.  It
      implements a rao blackwellized particle filter. Each particle
      has its own map and robot pose.<br> This implementation works
@@ -77,6 +144,10 @@ namespace GMapping {
        also the parent node is deleted. This because the parent will not be reacheable anymore in the trajectory tree.*/
       ~TNode();
 
+      /**nodes are allocated from a NodePool*/
+      static void* operator new(size_t size);
+      static void operator delete(void* p);
+
       /**The pose of the robot*/
 	  //该节点机器人的位姿
       OrientedPoint pose; 
@@ -96,8 +167,8 @@ namespace GMapping {
       TNode* parent;
 
       /**The range reading to which this node is associated*/
-      // 该节点激光雷达的读数
-      const RangeReading* reading;
+      // 该节点激光雷达的读数 同一次更新的所有节点共享一份
+      readingptr reading;
 
       /**The number of childs*/
       // 该节点的子节点的数量
@@ -136,13 +207,16 @@ namespace GMapping {
 	  @param w the weight
       */
       inline void setWeight(double w) {weight=w;}
+
+      /** exchanges two particles without copying the maps */
+      void swap(Particle& p);
       /** The map  地图 高分辨率地图*/
       ScanMatcherMap map;
 
       /*存储最近的N帧激光雷达的数据 用来生成临时地图 从而进行CSM*/
       std::vector<GMapping::RangeReading*> running_scans;
 
-      /*低分辨率地图 用来进行CSM*/
+      /*低分辨率地图 用来进行相关性搜索 只有在打开相关性搜索的时候才会更新*/
       ScanMatcherMap lowResolutionMap;
 
 
@@ -228,6 +302,10 @@ namespace GMapping {
     /**the scanmatcher algorithm*/
     ScanMatcher m_matcher;
 
+    /**每个线程使用的scanmatcher 只在线程数变化的时候分配 m_matcher的参数变化的时候用copyParameters()复制参数
+       scanmatcher里面有activeArea的状态和画线的缓冲区 不能在多个线程中共享*/
+    std::vector<ScanMatcher> m_threadMatchers;
+
     /**the stream used for writing the output of the algorithm*/
     std::ofstream& outputStream();
     /**the stream used for writing the info/debug messages*/
@@ -291,6 +369,18 @@ namespace GMapping {
     /**enlarge the map when the robot goes out of the boundaries [scanmatcher]*/
     MEMBER_PARAM_SET_GET(m_matcher, bool, enlargeStep, protected, public, public);
 
+    /**use the cached likelihood field in the hill climbing of the scanmatcher [scanmatcher]*/
+    MEMBER_PARAM_SET_GET(m_matcher, bool, useLikelihoodField, protected, public, public);
+
+    /**half size of the translational window of the correlative search on the low resolution map, 0 disables it [scanmatcher]*/
+    MEMBER_PARAM_SET_GET(m_matcher, double, correlativeLinearWindow, protected, public, public);
+
+    /**half size of the angular window of the correlative search, 0 disables it [scanmatcher]*/
+    MEMBER_PARAM_SET_GET(m_matcher, double, correlativeAngularWindow, protected, public, public);
+
+    /**angular step of the correlative search [scanmatcher]*/
+    MEMBER_PARAM_SET_GET(m_matcher, double, correlativeAngularStep, protected, public, public);
+
     /**pose of the laser wrt the robot [scanmatcher]*/
     MEMBER_PARAM_SET_GET(m_matcher, OrientedPoint, laserPose, protected, public, public);
 
@@ -310,6 +400,9 @@ namespace GMapping {
     /**minimum score for considering the outcome of the scanmatching good*/
     PARAM_SET_GET(double, minimumScore, protected, public, public);
 
+    /**resolution of the low resolution map as a multiple of delta, must be set before init()*/
+    PARAM_SET_GET(int, lowResolutionRatio, protected, public, public);
+
   protected:
     /**Copy constructor*/
     GridSlamProcessor(const GridSlamProcessor& gsp);
@@ -339,6 +432,18 @@ namespace GMapping {
 
     /**this sets the neff based resampling threshold*/
     PARAM_SET_GET(double, resampleThreshold, protected, public, public);
+
+    /**bounds of the KLD adaptive number of particles, maxParticles=0 keeps the number given to init()*/
+    PARAM_SET_GET(unsigned int, minParticles, protected, public, public);
+    PARAM_SET_GET(unsigned int, maxParticles, protected, public, public);
+
+    /**KLD error bound and upper standard normal quantile of the adaptive number of particles*/
+    PARAM_SET_GET(double, kldEpsilon, protected, public, public);
+    PARAM_SET_GET(double, kldZ, protected, public, public);
+
+    /**size of the pose histogram bins used to count the support of the particle distribution*/
+    PARAM_SET_GET(double, kldLinearBin, protected, public, public);
+    PARAM_SET_GET(double, kldAngularBin, protected, public, public);
       
     //state
     int  m_count, m_readingCount;
@@ -347,6 +452,12 @@ namespace GMapping {
     OrientedPoint m_pose;
     double m_linearDistance, m_angularDistance;
     PARAM_GET(double, neff, protected, public);
+
+    /**maximum number of nodes kept in the trajectory of each particle, older nodes are pruned (0 keeps the whole tree)*/
+    PARAM_SET_GET(unsigned int, maxTreeDepth, protected, public, public);
+
+    /**number of levels removed from the root side of the trajectory tree by the pruning*/
+    PARAM_GET(unsigned int, prunedDepth, protected, public);
       
     //processing parameters (size of the map)
     PARAM_GET(double, xmin, protected, public);
@@ -390,13 +501,24 @@ namespace GMapping {
     
     // return if a resampling occured or not
     inline bool resample(const double* plainReading, int adaptParticles, 
-			 const RangeReading* rr=0);
+			 const readingptr& rr=readingptr());
+
+    /**registers the scan in the maps of all the particles, in parallel*/
+    inline void registerScans(const double* plainReading);
+
+    /**number of particles after resampling given by KLD-sampling*/
+    unsigned int kldParticleNumber() const;
+
+    /**changes the number of particles towards size without resampling*/
+    void adaptParticleNumber(unsigned int size);
     
     //tree utilities
     
     void updateTreeWeights(bool weightsAlreadyNormalized = false);
     void resetTree();
     double propagateWeights();
+    /**cuts the trajectories to maxTreeDepth nodes*/
+    void pruneTree();
     
   };
 
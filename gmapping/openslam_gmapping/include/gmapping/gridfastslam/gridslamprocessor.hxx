@@ -27,34 +27,44 @@ inline void GridSlamProcessor::scanMatch(const double* plainReading)
   double sumScore=0;
   int particle_number = m_particles.size();
 
-  //用openMP的方式来进行并行化，因此这里不能用迭代器 只能用下标的方式进行访问
-  //并行话之后会把里面的循环均匀的分到各个不同的核里面去。
+  //每个线程一个scanmatcher 参数和m_matcher完全一样
+  //只在线程数变化的时候重新分配 参数变化的时候才复制参数 缓冲区和缓存都保留
+  int thread_number = 1;
+#ifdef _OPENMP
+  thread_number = omp_get_max_threads();
+#endif
+  if ((int)m_threadMatchers.size() != thread_number)
+    m_threadMatchers.resize(thread_number);
+  for (int i = 0; i < thread_number; i++)
+    m_threadMatchers[i].copyParameters(m_matcher);
 
-//#pragma omp parallel for
+  //每个粒子的得分单独保存 循环结束之后再按粒子的顺序求和和输出信息
+  //这样求和的顺序和线程的调度无关 结果是可以复现的
+  std::vector<double> scores(particle_number);
+  std::vector<double> likelihoods(particle_number);
+
+  //用openMP的方式来进行并行化，因此这里不能用迭代器 只能用下标的方式进行访问
+  //每个粒子的计算量不一样(地图的大小不同) 因此用dynamic的方式进行分配
+#pragma omp parallel for schedule(dynamic)
   for (int i = 0; i < particle_number;i++)
   {
-    OrientedPoint corrected;
+    int thread_id = 0;
+#ifdef _OPENMP
+    thread_id = omp_get_thread_num();
+#endif
+    ScanMatcher& matcher = m_threadMatchers[thread_id];
+
+    ScoredMove best;
     double score, l, s;
 
-    /*进行scan-match 计算粒子的最优位姿 调用scanmatcher.cpp里面的函数 --这是gmapping本来的做法*/
-    score=m_matcher.optimize(corrected, m_particles[i].map, m_particles[i].pose, plainReading);
+    /*打开相关性搜索的时候 先在低分辨率地图上搜索一个比较好的初始位姿*/
+    OrientedPoint seed=m_particles[i].pose;
+    if (matcher.correlativeSearchEnabled())
+      seed=matcher.correlativeSearch(m_particles[i].lowResolutionMap, m_particles[i].map, m_particles[i].pose, plainReading);
 
-    /*矫正成功则更新位姿*/
-    if (score>m_minimumScore)
-    {
-      m_particles[i].pose = corrected;
-    }
-    /*扫描匹配不上 则使用里程计的数据 使用里程计数据不进行更新  因为在进行扫描匹配之前 里程计已经更新过了*/
-    else
-    {
-        //输出信息 这个在并行模式下可以会出现错位
-        if (m_infoStream)
-        {
-            m_infoStream << "Scan Matching Failed, using odometry. Likelihood=" << l <<std::endl;
-            m_infoStream << "lp:" << m_lastPartPose.x << " "  << m_lastPartPose.y << " "<< m_lastPartPose.theta <<std::endl;
-            m_infoStream << "op:" << m_odoPose.x << " " << m_odoPose.y << " "<< m_odoPose.theta <<std::endl;
-        }
-    }
+    /*进行scan-match 计算粒子的最优位姿 调用scanmatcher.cpp里面的函数 --这是gmapping本来的做法*/
+    /*最优位姿的似然在优化的时候已经一起计算出来了*/
+    score=matcher.optimize(best, m_particles[i].map, seed, plainReading);
 
     //粒子的最优位姿计算了之后，重新计算粒子的权重(相当于粒子滤波器中的观测步骤，计算p(z|x,m))，粒子的权重由粒子的似然来表示。
     /*
@@ -62,9 +72,19 @@ inline void GridSlamProcessor::scanMatch(const double* plainReading)
      * 在论文中 例子的权重不是用最有位姿的似然值来表示的。
      * 是用所有的似然值的和来表示的。
      */
-    m_matcher.likelihoodAndScore(s, l, m_particles[i].map, m_particles[i].pose, plainReading);
+    /*矫正成功则更新位姿 权重使用最优位姿的似然*/
+    /*扫描匹配不上 则使用里程计的数据 使用里程计数据不进行更新  因为在进行扫描匹配之前 里程计已经更新过了
+     *这时候要计算里程计位姿的似然 匹配失败的情况很少 多计算一次影响不大*/
+    if (score>m_minimumScore)
+    {
+      m_particles[i].pose = best.pose;
+      l = best.likelihood;
+    }
+    else
+      matcher.likelihoodAndScore(s, l, m_particles[i].map, m_particles[i].pose, plainReading);
 
-    sumScore+=score;
+    scores[i] = score;
+    likelihoods[i] = l;
     m_particles[i].weight+=l;
     m_particles[i].weightSum+=l;
 
@@ -72,11 +92,28 @@ inline void GridSlamProcessor::scanMatch(const double* plainReading)
     //by detaching the areas that will be updated
     /*计算出来最优的位姿之后，进行地图的扩充  这里不会进行内存分配
      *不进行内存分配的原因是这些粒子进行重采样之后有可能会消失掉，因此在后面进行冲采样的时候统一进行内存分配。
-     *理论上来说，这里的操作是没有必要的，因为后面的重采样的时候还会进行一遍
+     *地图扩充的时候会拷贝共享的patch的指针 patch的引用计数是原子操作 因此可以并行
      */
-    m_matcher.invalidateActiveArea();
-    m_matcher.computeActiveArea(m_particles[i].map, m_particles[i].pose, plainReading);
+    matcher.invalidateActiveArea();
+    matcher.computeActiveArea(m_particles[i].map, m_particles[i].pose, plainReading);
+  }
+
+  //按照粒子的顺序求和 输出匹配失败的信息
+  for (int i = 0; i < particle_number;i++)
+  {
+    sumScore+=scores[i];
+    if (scores[i]<=m_minimumScore && m_infoStream)
+    {
+      m_infoStream << "Scan Matching Failed, using odometry. Likelihood=" << likelihoods[i] <<std::endl;
+      m_infoStream << "lp:" << m_lastPartPose.x << " "  << m_lastPartPose.y << " "<< m_lastPartPose.theta <<std::endl;
+      m_infoStream << "op:" << m_odoPose.x << " " << m_odoPose.y << " "<< m_odoPose.theta <<std::endl;
+    }
   }
+
+  //m_matcher没有参与匹配 它的activeArea的状态是上一次更新地图时候的状态
+  //重采样之后更新地图的时候需要重新计算activeArea
+  m_matcher.invalidateActiveArea();
+
   if (m_infoStream)
     m_infoStream << "Average Scan Matching Score=" << sumScore/m_particles.size() << std::endl;
 }
@@ -126,6 +163,44 @@ inline void GridSlamProcessor::normalize()
   
 }
 
+/*
+@desc 用这一帧激光数据更新所有粒子的地图
+每个粒子的地图是独立的 共享的patch在allocActiveArea()中复制 引用计数和内存池都是线程安全的
+因此可以并行 每个线程使用自己的scanmatcher 因为计算activeArea的时候会修改scanmatcher中的数据
+*/
+inline void GridSlamProcessor::registerScans(const double* plainReading)
+{
+  int thread_number = 1;
+#ifdef _OPENMP
+  thread_number = omp_get_max_threads();
+#endif
+  if ((int)m_threadMatchers.size() != thread_number)
+    m_threadMatchers.resize(thread_number);
+  for (int i = 0; i < thread_number; i++)
+    m_threadMatchers[i].copyParameters(m_matcher);
+
+  int particle_number = m_particles.size();
+#pragma omp parallel for schedule(dynamic)
+  for (int i = 0; i < particle_number; i++)
+  {
+    int thread_id = 0;
+#ifdef _OPENMP
+    thread_id = omp_get_thread_num();
+#endif
+    ScanMatcher& matcher = m_threadMatchers[thread_id];
+
+    //粒子拷贝的时候activeArea不会被拷贝 因此每个粒子都要重新计算
+    matcher.invalidateActiveArea();
+    matcher.registerScan(m_particles[i].map, m_particles[i].pose, plainReading);
+    if (matcher.correlativeSearchEnabled())
+    {
+      //低分辨率地图要重新计算activeArea 否则地图不会扩充 共享的patch也不会被复制
+      matcher.invalidateActiveArea();
+      matcher.registerScan(m_particles[i].lowResolutionMap, m_particles[i].pose, plainReading);
+    }
+  }
+}
+
 /*
 @desc 粒子滤波器重采样。
 
@@ -135,7 +210,7 @@ inline void GridSlamProcessor::normalize()
 
 在重采样完毕之后，会调用registerScan函数来更新地图
 */
-inline bool GridSlamProcessor::resample(const double* plainReading, int adaptSize, const RangeReading* reading)
+inline bool GridSlamProcessor::resample(const double* plainReading, int adaptSize, const readingptr& reading)
 {
   
   bool hasResampled = false;
@@ -147,6 +222,15 @@ inline bool GridSlamProcessor::resample(const double* plainReading, int adaptSiz
     oldGeneration.push_back(m_particles[i].node);
   }
   
+  /*
+   * 打开KLD-sampling的时候 每次更新都由粒子分布占据的bin的数量计算需要的粒子数
+   * neff触发重采样的时候直接重采样到这个粒子数
+   * 否则只有相差超过25%的时候才调整粒子数 见adaptParticleNumber() 不为了改变粒子数而重采样
+   */
+  unsigned int kldSize=0;
+  if (!adaptSize && m_maxParticles>0)
+    kldSize=kldParticleNumber();
+
   /*如果需要进行重采样*/
   if (m_neff<m_resampleThreshold*m_particles.size())
   {		
@@ -154,6 +238,9 @@ inline bool GridSlamProcessor::resample(const double* plainReading, int adaptSiz
     if (m_infoStream)
       m_infoStream  << "*************RESAMPLE***************" << std::endl;
     
+    if (kldSize)
+      adaptSize=kldSize;
+
     //采取重采样方法决定，哪些粒子会保留  保留的粒子会返回下标.里面的下标可能会重复，因为有些粒子会重复采样
     //而另外的一些粒子会消失掉
     uniform_resampler<double, double> resampler;
@@ -174,7 +261,13 @@ inline bool GridSlamProcessor::resample(const double* plainReading, int adaptSiz
 
 
     //重采样之后的粒子
+    //粒子第一次被选中的时候直接和原来的粒子交换 不复制地图
+    //同一个粒子被重复选中的时候才复制一份 复制的地图和原来的地图共享所有的patch 每个patch的引用计数只增加一次
+    //registerScan()的时候只有被修改的patch才会真正复制
     ParticleVector temp;
+    temp.reserve(m_indexes.size());
+    const ScanMatcherMap emptyMap(Point(0,0), 0., 0., m_particles[0].map.getDelta());
+    const Particle emptyParticle(emptyMap, emptyMap);
     unsigned int j=0;
 	
 	//要删除的粒子下标
@@ -192,24 +285,29 @@ inline bool GridSlamProcessor::resample(const double* plainReading, int adaptSiz
       if (j==m_indexes[i])
 	  j++;
   
-      //得到当前的保留的粒子
-      Particle & p=m_particles[m_indexes[i]];
+      //下标是有序的 重复的粒子一定紧跟在第一次被选中的粒子后面
+      if (i>0 && m_indexes[i-1]==m_indexes[i])
+        temp.push_back(temp.back());
+      else
+      {
+        temp.push_back(emptyParticle);
+        temp.back().swap(m_particles[m_indexes[i]]);
+      }
 	  
       //每一个需要保留下来的粒子都需要在路径中增加一个新的节点
-      TNode* node=0;
+      //创建一个新的节点 改节点的父节点为oldNode
       TNode* oldNode=oldGeneration[m_indexes[i]];
-	  
-	  //创建一个新的节点 改节点的父节点为oldNode
-      node=new	TNode(p.pose, 0, oldNode, 0);
+      TNode* node=new TNode(temp.back().pose, 0, oldNode, 0);
       node->reading=reading;
       
 	  //这个要保留下来的粒子，要保留的粒子的下标为m_indexs
-      temp.push_back(p);
       temp.back().node=node;
       temp.back().previousIndex=m_indexes[i];
+      temp.back().setWeight(0);
     }
 
-    while(j<m_indexes.size())
+    //粒子数可以变化 剩下的粒子要按照原来的粒子数来删除
+    while(j<m_particles.size())
 	{
       deletedParticles.push_back(j);
       j++;
@@ -228,33 +326,13 @@ inline bool GridSlamProcessor::resample(const double* plainReading, int adaptSiz
     std::cerr << "Deleting old particles..." ;
     std::cerr << "Done" << std::endl;
 	
-    //清楚全部的粒子 然后从tmp中读取保留下来的粒子
-    m_particles.clear();
+    //保留下来的粒子换到m_particles中 被删除的粒子的地图随temp一起释放
+    m_particles.swap(temp);
+    temp.clear();
 	
-    //枚举要保留下来的所有的粒子 每个粒子都需要更新地图
+    //保留下来的粒子 每个粒子都需要更新地图
     std::cerr << "Copying Particles and  Registering  scans...";
-
-    //对于保留下来的粒子进行更新 这里是可以并行化操作的。
-    //在并行化操作里面 m_particles.push_back()会报错 因此并行化 需要把push_back()提出来。
-    //在外面的的for循环进行
-    int tmp_size = temp.size();
-//#pragma omp parallel for
-    for(int i = 0; i<tmp_size;i++)
-    {
-        //对保留下来的粒子数据进行更新
-        //每个粒子的权重都设置为相同的值
-        temp[i].setWeight(0);
-
-        //为每个粒子更新running_scans
-
-        //增加了一帧激光数据 因此需要更新地图
-        m_matcher.registerScan(temp[i].map,temp[i].pose,plainReading);
-        //m_matcher.registerScan(temp[i].lowResolutionMap,temp[i].pose,plainReading);
-    }
-
-    //提取出来 防止并行优化时报错
-    for(int i = 0; i< tmp_size;i++)
-        m_particles.push_back(temp[i]);
+    registerScans(plainReading);
 
     std::cerr  << " Done" <<std::endl;
     hasResampled = true;
@@ -263,25 +341,28 @@ inline bool GridSlamProcessor::resample(const double* plainReading, int adaptSiz
   else 
   {
 	//不进行重采样的话，权值不变。只为轨迹创建一个新的节点
+    for(unsigned int i = 0; i < m_particles.size();i++)
+        m_particles[i].previousIndex = i;
+
+    //粒子数变化的时候粒子的叶子节点(新节点的父节点)跟着粒子一起移动
+    //相差不到25%的时候不调整 避免KLD粒子数的随机波动让粒子数来回变化
+    if (kldSize && (4*kldSize<3*m_particles.size() || 4*kldSize>5*m_particles.size()))
+      adaptParticleNumber(kldSize);
 
-    //为每个粒子更新地图 同样可以并行化
-    int particle_size = m_particles.size();
-//#pragma omp parallel for
-    for(int i = 0; i < particle_size;i++)
+    //TNode的构造函数会修改父节点的计数 因此创建节点不能并行
+    for(unsigned int i = 0; i < m_particles.size();i++)
     {
         //创建一个新的树节点
         TNode* node = 0;
-        node = new TNode(m_particles[i].pose,0.0,oldGeneration[i],0);
+        node = new TNode(m_particles[i].pose,0.0,m_particles[i].node,0);
 
         //把这个节点接入到树中
         node->reading = reading;
         m_particles[i].node = node;
-
-        //更新各个例子的地图
-        m_matcher.invalidateActiveArea();
-        m_matcher.registerScan(m_particles[i].map, m_particles[i].pose, plainReading);
-        m_particles[i].previousIndex = i;
     }
+
+    //更新各个粒子的地图
+    registerScans(plainReading);
     std::cerr<<std::endl;
 
 //    int index=0;
@@ -0,0 +1,123 @@
+#ifndef NODEPOOL_H
+#define NODEPOOL_H
+
+#include <vector>
+#include <cstddef>
+
+namespace GMapping {
+
+/*
+ * 轨迹树节点的内存池
+ *
+ * 每次更新每个粒子都要new一个TNode，重采样的时候被淘汰的分支又会被一次性delete掉，
+ * 节点在堆上是分散的，resetTree()和propagateWeights()沿着parent指针遍历的时候缓存命中率很低。
+ *
+ * 这里按照slab的方式成批分配节点的内存，删除的节点放回空闲链表，下次分配的时候优先使用。
+ * 同一次更新创建的节点在内存中基本上是连续的。内存池中的内存在程序结束之前不会还给系统。
+ *
+ * 和PatchPool一样 分配和回收用一个自旋锁保护
+ */
+template <class T>
+class NodePool
+{
+	public:
+		/*每种节点类型一个内存池*/
+		static NodePool& instance();
+
+		/*分配一个节点的内存 不调用构造函数*/
+		void* alloc();
+
+		/*回收一个节点的内存 不调用析构函数*/
+		void release(void* p);
+
+		/*正在使用的节点的数量*/
+		inline unsigned long liveNumber() const {return m_live;}
+		/*空闲链表中的节点的数量*/
+		inline unsigned long freeNumber() const {return m_free;}
+
+		~NodePool();
+
+	protected:
+		NodePool();
+
+		/*空闲的时候保存链表指针 使用的时候保存节点 double保证对齐*/
+		union Slot
+		{
+			Slot* next;
+			double align;
+			char data[sizeof(T)];
+		};
+
+		inline void lock() { while (__sync_lock_test_and_set(&m_lock, 1)) ; }
+		inline void unlock() { __sync_lock_release(&m_lock); }
+
+		static const int SlabSize=1024;
+
+		std::vector<Slot*> m_slabs;
+		Slot* m_freeList;
+		volatile int m_lock;
+
+		unsigned long m_live, m_free;
+};
+
+template <class T>
+NodePool<T>& NodePool<T>::instance()
+{
+	static NodePool<T> pool;
+	return pool;
+}
+
+template <class T>
+NodePool<T>::NodePool():
+	m_freeList(0), m_lock(0), m_live(0), m_free(0)
+{
+}
+
+template <class T>
+NodePool<T>::~NodePool()
+{
+	for (unsigned int i=0; i<m_slabs.size(); i++)
+		delete [] m_slabs[i];
+}
+
+template <class T>
+void* NodePool<T>::alloc()
+{
+	lock();
+	if (!m_freeList)
+	{
+		//倒着放进空闲链表 这样分配的顺序和地址的顺序相同
+		Slot* slab=new Slot[SlabSize];
+		m_slabs.push_back(slab);
+		for (int i=SlabSize-1; i>=0; i--)
+		{
+			slab[i].next=m_freeList;
+			m_freeList=slab+i;
+		}
+		m_free+=SlabSize;
+	}
+	Slot* s=m_freeList;
+	m_freeList=s->next;
+	m_free--;
+	m_live++;
+	unlock();
+	return s->data;
+}
+
+template <class T>
+void NodePool<T>::release(void* p)
+{
+	if (!p)
+		return;
+	Slot* s=reinterpret_cast<Slot*>(p);
+	lock();
+	s->next=m_freeList;
+	m_freeList=s;
+	m_free++;
+	m_live--;
+	unlock();
+}
+
+};
+
+#endif
@@ -155,6 +155,7 @@ struct uniform_resampler
 	std::vector<unsigned int> resampleIndexes(const std::vector<Particle> & particles, int nparticles=0) const;
 	std::vector<Particle> resample(const std::vector<Particle> & particles, int nparticles=0) const;
 	Numeric neff(const std::vector<Particle> & particles) const;
+	unsigned int kldSize(unsigned int bins, Numeric epsilon, Numeric z) const;
 };
 
 /*Implementation of the above stuff*/
@@ -262,6 +263,24 @@ Numeric uniform_resampler<Particle,Numeric>::neff(const std::vector<Particle> &
 	return sum*sum/cum;
 }
 
+/*
+KLD采样(Fox 2003)需要的粒子数
+粒子分布在bins个非空的bin中的时候，要使得粒子表示的分布和真实分布之间的KL距离以1-delta的概率小于epsilon，
+粒子数至少为 (k-1)/(2*epsilon) * (1 - 2/(9(k-1)) + sqrt(2/(9(k-1)))*z)^3
+z为标准正态分布的1-delta分位数 比如delta=0.01的时候z=2.33
+只有一个bin的时候返回0 由调用者决定最少的粒子数
+*/
+template <class Particle, class Numeric>
+unsigned int uniform_resampler<Particle,Numeric>::kldSize(unsigned int bins, Numeric epsilon, Numeric z) const
+{
+	if (bins<2)
+		return 0;
+	Numeric k=bins-1;
+	Numeric a=2./(9.*k);
+	Numeric b=1.-a+sqrt(a)*z;
+	return (unsigned int)ceil(k/(2.*epsilon)*b*b*b);
+}
+
 
 /*
 
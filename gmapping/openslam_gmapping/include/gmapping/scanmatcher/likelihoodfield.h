@@ -0,0 +1,99 @@
+#ifndef LIKELIHOODFIELD_H
+#define LIKELIHOODFIELD_H
+
+#include <vector>
+#include "smmap.h"
+
+namespace GMapping {
+
+/*
+ * ScanMatcher::score()使用的似然场缓存
+ *
+ * score()对每一束激光都要在(2*kernelSize+1)^2的窗口里面查找离击中点最近的被占用的cell，
+ * 每个位置都要通过HierarchicalArray2D的patch间接访问两次地图。
+ * optimize()爬山的每一步都要对所有的激光束调用score()，同一个cell会被反复查找。
+ *
+ * 这里把每个cell的查找结果缓存起来：对于cell c，保存窗口中离c的中心最近的被占用的cell的均值，
+ * score()里面每一束激光只需要查一次表。
+ * 缓存按照8*8的block组织，block第一次被访问的时候才计算，block的数据在内存中是连续的。
+ *
+ * 和原来的查找相比有两点近似：
+ * 1.最近的cell是相对于cell的中心选出来的，而不是相对于激光击中的点
+ * 2.不检查沿着激光方向的前一个cell是不是空闲
+ *
+ * 缓存只对一个粒子的地图有效：optimize()开始的时候对这个粒子的地图调用reset()，
+ * registerScan()修改地图的时候调用invalidate()。
+ */
+class LikelihoodField
+{
+	public:
+		struct Entry
+		{
+			float dx, dy;	//最近的被占用的cell的均值 相对于这个cell的中心的偏移
+			inline bool hit() const {return dx<NoHit;}
+		};
+
+		/*窗口里面没有被占用的cell的时候dx的值*/
+		static const float NoHit;
+
+		LikelihoodField();
+
+		/*
+		 * 为map建立一个新的缓存 之前的缓存全部失效
+		 * center为窗口中心的地图坐标 radius为窗口的半径 单位为栅格
+		 */
+		void reset(const ScanMatcherMap& map, const IntPoint& center, int radius, int kernelSize, double fullnessThreshold);
+
+		inline void invalidate() { m_map=0; }
+
+		/*缓存是不是为map建立的*/
+		inline bool valid(const ScanMatcherMap& map) const { return m_map==&map; }
+
+		/*返回cell p的缓存 p在窗口外面的时候返回0 这时候需要用原来的方法查找*/
+		inline const Entry* entry(const IntPoint& p);
+
+		/*从上一次reset()开始计算过的block的数量*/
+		inline unsigned int computedBlocks() const {return m_entries.size()/(BlockSize*BlockSize);}
+
+	protected:
+		static const int BlockMagnitude=3;
+		static const int BlockSize=1<<BlockMagnitude;
+
+		/*计算一个block里面所有的cell bx by为block的坐标*/
+		void computeBlock(Entry* e, int bx, int by);
+
+		const ScanMatcherMap* m_map;
+		int m_kernelSize;
+		double m_fullnessThreshold;
+
+		int m_bx0, m_by0;						//窗口左下角的block
+		int m_blocks;							//窗口每条边上block的数量
+		unsigned int m_stamp;					//当前缓存的编号 block的编号和它不一样表示没有计算过
+		std::vector<unsigned int> m_blockStamp;
+		std::vector<int> m_blockOffset;			//block的数据在m_entries中的位置
+		std::vector<Entry> m_entries;
+
+		/*computeBlock()中用来保存block及其周围的cell的均值*/
+		std::vector<Point> m_means;
+		std::vector<char> m_occupied;
+};
+
+inline const LikelihoodField::Entry* LikelihoodField::entry(const IntPoint& p)
+{
+	int bx=(p.x>>BlockMagnitude)-m_bx0, by=(p.y>>BlockMagnitude)-m_by0;
+	if (bx<0 || by<0 || bx>=m_blocks || by>=m_blocks)
+		return 0;
+	int b=bx*m_blocks+by;
+	if (m_blockStamp[b]!=m_stamp)
+	{
+		m_blockStamp[b]=m_stamp;
+		m_blockOffset[b]=m_entries.size();
+		m_entries.resize(m_entries.size()+BlockSize*BlockSize);
+		computeBlock(&m_entries[m_blockOffset[b]], bx+m_bx0, by+m_by0);
+	}
+	return &m_entries[m_blockOffset[b]+((p.x&(BlockSize-1))<<BlockMagnitude)+(p.y&(BlockSize-1))];
+}
+
+};
+
+#endif
@@ -3,17 +3,49 @@
 
 #include "icp.h"
 #include "smmap.h"
+#include "likelihoodfield.h"
 #include "eigen3/Eigen/Core"
 #include "../include/gmapping/utils/macro_params.h"
 #include "../include/gmapping/utils/stat.h"
 #include <iostream>
+#include <vector>
 #include "../include/gmapping/utils/gvalues.h"
 #include "../include/gmapping/sensor/sensor_range/rangereading.h"
 
 #define LASER_MAXBEAMS 2048
 
+//让编译器把下一个循环向量化 没有OpenMP 4.0的时候为空
+#if defined(_OPENMP) && _OPENMP>=201307
+#define GMAPPING_SIMD _Pragma("omp simd")
+#else
+#define GMAPPING_SIMD
+#endif
+
 namespace GMapping {
 
+/*
+ * 机器人朝向为theta的时候 所有参与打分的激光束的击中点
+ * 击中点保存为相对于机器人位置的偏移 平移之后的位姿可以直接使用，不需要重新计算sin和cos
+ * 按照SoA的方式保存 方便向量化
+ */
+struct BeamEndpoints
+{
+    double theta;               //机器人的朝向
+    std::vector<double> x, y;   //击中点相对于机器人位置的偏移
+    std::vector<int> fx, fy;    //score()中的ipfree 沿着激光方向前一个空闲点相对于击中点的栅格偏移
+    unsigned int scored;        //前scored个激光束参与打分 后面距离为0的激光束只用来计算似然
+    inline unsigned int size() const { return x.size(); }
+};
+
+/*表示一个位姿和这个位姿的得分、似然 以及匹配上的激光束的数量*/
+struct ScoredMove
+{
+    OrientedPoint pose;
+    double score;
+    double likelihood;
+    unsigned int matched;
+};
+
 class ScanMatcher{
 public:
     typedef Covariance3 CovarianceMatrix;   //协方差
@@ -41,6 +73,24 @@ public:
         */
     double optimize(OrientedPoint& pnew, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const;
 
+    /*和上面的函数一样 同时返回最优位姿的似然和匹配上的激光束的数量 不需要再调用likelihoodAndScore()*/
+    double optimize(ScoredMove& best, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const;
+
+    /*
+        @desc       在低分辨率地图上进行相关性搜索 得到的位姿作为optimize()的初始位姿
+                    optimize()是从初始位姿开始的贪心搜索 初始位姿离真实位姿比较远的时候会陷入局部最优
+                    这里在初始位姿周围的窗口中穷举低分辨率地图上所有的平移和角度 找到和地图最一致的位姿
+        @param lowMap   低分辨率地图
+        @param map      高分辨率地图 用来检查搜索的结果
+        @param p        初始位姿
+        @param readings 激光数据
+        @return         搜索到的位姿 在高分辨率地图上的得分不如初始位姿的时候返回初始位姿
+        */
+    OrientedPoint correlativeSearch(const ScanMatcherMap& lowMap, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const;
+
+    /*是否在optimize()之前进行相关性搜索*/
+    inline bool correlativeSearchEnabled() const { return m_correlativeLinearWindow>0. || m_correlativeAngularWindow>0.; }
+
     //这个函数的功能跟上面的函数差不多 不过不是取最优的粒子，然后认为经过的路径服从高斯分布，因此最终的位姿是高斯分布的加权和
     //并且还能计算出来方差。
     double optimize(OrientedPoint& mean, CovarianceMatrix& cov, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const;
@@ -62,6 +112,15 @@ public:
     void setMatchingParameters
     (double urange, double range, double sigma, int kernsize, double lopt, double aopt, int iterations, double likelihoodSigma=1, unsigned int likelihoodSkip=0 );
 
+    /*
+        参数的版本号和other不同的时候复制other 清空缓存 返回true
+        版本号相同的时候什么都不做 保留m_linePoints和各种缓存
+        */
+    bool copyParameters(const ScanMatcher& other);
+
+    /*参数的版本号 每次设置参数都会换一个新的版本号 版本号相同的两个ScanMatcher参数一定相同*/
+    inline unsigned long parametersVersion() const { return m_parametersVersion; }
+
     void invalidateActiveArea();
 
     void computeActiveArea(ScanMatcherMap& map, const OrientedPoint& p, const double* readings);
@@ -70,6 +129,18 @@ public:
 
     inline double score(const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const;
 
+    /*计算朝向为theta时参与打分的激光束的击中点 和score()使用同样的激光束*/
+    void computeEndpoints(BeamEndpoints& e, const ScanMatcherMap& map, double theta, const double* readings) const;
+
+    /*
+        和score()的结果相同 机器人的位置为p 朝向为e.theta
+        击中点的栅格坐标是批量计算的 可以向量化
+        */
+    double score(const ScanMatcherMap& map, const Point& p, const BeamEndpoints& e) const;
+
+    /*一次遍历激光束同时计算得分、似然和匹配上的激光束的数量 机器人的位置为p 朝向为e.theta*/
+    unsigned int likelihoodAndScore(double& s, double& l, const ScanMatcherMap& map, const Point& p, const BeamEndpoints& e) const;
+
     inline unsigned int likelihoodAndScore(double& s, double& l, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings) const;
 
     double likelihood(double& lmax, OrientedPoint& mean, CovarianceMatrix& cov, const ScanMatcherMap& map, const OrientedPoint& p, const double* readings);
@@ -91,37 +162,75 @@ protected:
     //state of the matcher
     bool m_activeAreaComputed;
 
+    /*
+        设置了参数 换一个新的版本号
+        版本号在所有的ScanMatcher中都是唯一的 只在设置参数的线程中调用
+        */
+    inline void parametersChanged() { m_parametersVersion=++s_parametersVersions; }
+    unsigned long m_parametersVersion;
+    static unsigned long s_parametersVersions;
+
     /*机器人的m_laser储存这激光雷达(base_laser)在base_link坐标系中的坐标*/
 
     /**laser parameters*/
     unsigned int m_laserBeams;														//激光束的数量
     double       m_laserAngles[LASER_MAXBEAMS];										//各个激光束的角度
     //OrientedPoint m_laserPose;
-    PARAM_SET_GET(OrientedPoint, laserPose, protected, public, public)				//激光的位置
-    PARAM_SET_GET(double, laserMaxRange, protected, public, public)					//激光的最大测距范围
+    PARAM_SET_GET_NOTIFY(OrientedPoint, laserPose, protected, public, public, parametersChanged)				//激光的位置
+    PARAM_SET_GET_NOTIFY(double, laserMaxRange, protected, public, public, parametersChanged)					//激光的最大测距范围
     /**scan_matcher parameters*/
-    PARAM_SET_GET(double, usableRange, protected, public, public)					//使用的激光的最大范围
-    PARAM_SET_GET(double, gaussianSigma, protected, public, public)
-    PARAM_SET_GET(double, likelihoodSigma, protected, public, public)
-    PARAM_SET_GET(int,    kernelSize, protected, public, public)
-    PARAM_SET_GET(double, optAngularDelta, protected, public, public)				//优化时的角度增量
-    PARAM_SET_GET(double, optLinearDelta, protected, public, public)				//优化时的长度增量
-    PARAM_SET_GET(unsigned int, optRecursiveIterations, protected, public, public)	//优化时的迭代次数
-    PARAM_SET_GET(unsigned int, likelihoodSkip, protected, public, public)
-    PARAM_SET_GET(double, llsamplerange, protected, public, public)
-    PARAM_SET_GET(double, llsamplestep, protected, public, public)
-    PARAM_SET_GET(double, lasamplerange, protected, public, public)
-    PARAM_SET_GET(double, lasamplestep, protected, public, public)
-    PARAM_SET_GET(bool, generateMap, protected, public, public)
-    PARAM_SET_GET(double, enlargeStep, protected, public, public)
-    PARAM_SET_GET(double, fullnessThreshold, protected, public, public)				//被认为是占用的阈值
-    PARAM_SET_GET(double, angularOdometryReliability, protected, public, public)	//里程计的角度可靠性
-    PARAM_SET_GET(double, linearOdometryReliability, protected, public, public)		//里程计的长度可靠性
-    PARAM_SET_GET(double, freeCellRatio, protected, public, public)					//free和occupany的阈值
-    PARAM_SET_GET(unsigned int, initialBeamsSkip, protected, public, public)		//去掉初始的几个激光束的数量
+    PARAM_SET_GET_NOTIFY(double, usableRange, protected, public, public, parametersChanged)					//使用的激光的最大范围
+    PARAM_SET_GET_NOTIFY(double, gaussianSigma, protected, public, public, parametersChanged)
+    PARAM_SET_GET_NOTIFY(double, likelihoodSigma, protected, public, public, parametersChanged)
+    PARAM_SET_GET_NOTIFY(int,    kernelSize, protected, public, public, parametersChanged)
+    PARAM_SET_GET_NOTIFY(double, optAngularDelta, protected, public, public, parametersChanged)				//优化时的角度增量
+    PARAM_SET_GET_NOTIFY(double, optLinearDelta, protected, public, public, parametersChanged)				//优化时的长度增量
+    PARAM_SET_GET_NOTIFY(unsigned int, optRecursiveIterations, protected, public, public, parametersChanged)	//优化时的迭代次数
+    PARAM_SET_GET_NOTIFY(unsigned int, likelihoodSkip, protected, public, public, parametersChanged)
+    PARAM_SET_GET_NOTIFY(double, llsamplerange, protected, public, public, parametersChanged)
+    PARAM_SET_GET_NOTIFY(double, llsamplestep, protected, public, public, parametersChanged)
+    PARAM_SET_GET_NOTIFY(double, lasamplerange, protected, public, public, parametersChanged)
+    PARAM_SET_GET_NOTIFY(double, lasamplestep, protected, public, public, parametersChanged)
+    PARAM_SET_GET_NOTIFY(bool, generateMap, protected, public, public, parametersChanged)
+    PARAM_SET_GET_NOTIFY(double, enlargeStep, protected, public, public, parametersChanged)
+    PARAM_SET_GET_NOTIFY(double, fullnessThreshold, protected, public, public, parametersChanged)				//被认为是占用的阈值
+    PARAM_SET_GET_NOTIFY(double, angularOdometryReliability, protected, public, public, parametersChanged)	//里程计的角度可靠性
+    PARAM_SET_GET_NOTIFY(double, linearOdometryReliability, protected, public, public, parametersChanged)		//里程计的长度可靠性
+    PARAM_SET_GET_NOTIFY(double, freeCellRatio, protected, public, public, parametersChanged)					//free和occupany的阈值
+    PARAM_SET_GET_NOTIFY(unsigned int, initialBeamsSkip, protected, public, public, parametersChanged)		//去掉初始的几个激光束的数量
+    PARAM_SET_GET_NOTIFY(bool, useLikelihoodField, protected, public, public, parametersChanged)				//optimize()中score()是否使用似然场缓存
+    PARAM_SET_GET_NOTIFY(double, correlativeLinearWindow, protected, public, public, parametersChanged)		//相关性搜索的平移窗口的半径 为0表示不搜索平移
+    PARAM_SET_GET_NOTIFY(double, correlativeAngularWindow, protected, public, public, parametersChanged)		//相关性搜索的角度窗口的半径 为0表示不搜索角度
+    PARAM_SET_GET_NOTIFY(double, correlativeAngularStep, protected, public, public, parametersChanged)		//相关性搜索的角度步长
 
     // allocate this large array only once
-    IntPoint* m_linePoints;
+    // 用vector保存 拷贝ScanMatcher的时候每个拷贝都有自己的缓冲区 可以在不同的线程中同时使用
+    std::vector<IntPoint> m_linePoints;
+
+    // score()使用的似然场缓存 在optimize()开始的时候为当前粒子的地图重新建立
+    // 和m_linePoints一样每个ScanMatcher的拷贝有自己的缓存
+    mutable LikelihoodField m_likelihoodField;
+
+    /*为map建立似然场缓存 窗口覆盖以p为中心usableRange范围内的激光*/
+    void resetLikelihoodField(const ScanMatcherMap& map, const OrientedPoint& p) const;
+
+    // optimize()中爬山的时候使用的击中点 缓存当前的朝向和左右旋转之后的朝向
+    // 平移的时候朝向不变 可以直接使用缓存的击中点
+    static const int EndpointsCacheSize=3;
+    mutable BeamEndpoints m_endpoints[EndpointsCacheSize];
+    mutable int m_endpointsUsed, m_endpointsNext;
+    mutable std::vector<int> m_hitX, m_hitY;     //score()中击中点的栅格坐标
+
+    /*返回朝向为theta时的击中点 缓存中没有的时候计算并替换最老的一个*/
+    const BeamEndpoints& endpoints(const ScanMatcherMap& map, double theta, const double* readings) const;
+
+    mutable BeamEndpoints m_correlativeEndpoints;  //相关性搜索中使用的击中点
+
+    /*计算所有击中点的栅格坐标 保存在m_hitX m_hitY中*/
+    void computeHitCells(const ScanMatcherMap& map, const Point& p, const BeamEndpoints& e) const;
+
+    /*在击中点周围kernelSize的窗口中查找匹配的cell 返回击中点和cell的均值的差*/
+    inline bool bestMatch(Point& bestMu, const ScanMatcherMap& map, const Point& phit, const IntPoint& iphit, const IntPoint& ipfree) const;
 };
 
 /*
@@ -182,15 +291,15 @@ inline double ScanMatcher::icpStep(OrientedPoint & pret, const ScanMatcherMap& m
                 IntPoint pf=pr+ipfree;
 
                 //如果期望的击中是击中 期望的空闲是空闲 则说明合法
-                const PointAccumulator& cell=map.cell(pr);
-                const PointAccumulator& fcell=map.cell(pf);
+                const ScanMatcherCell& cell=map.cell(pr);
+                const ScanMatcherCell& fcell=map.cell(pf);
                 if (((double)cell )> m_fullnessThreshold && ((double)fcell )<m_fullnessThreshold)
                 {
-                    Point mu=phit-cell.mean();
+                    Point mu=phit-cell.mean(map.map2world(pr));
                     if (!found)
                     {
                         bestMu=mu;
-                        bestCell=cell.mean();
+                        bestCell=cell.mean(map.map2world(pr));
                         found=true;
                     }
                     else
@@ -198,7 +307,7 @@ inline double ScanMatcher::icpStep(OrientedPoint & pret, const ScanMatcherMap& m
                         if((mu*mu)<(bestMu*bestMu))
                         {
                             bestMu=mu;
-                            bestCell=cell.mean();
+                            bestCell=cell.mean(map.map2world(pr));
                         }
                     }
                 }
@@ -270,6 +379,43 @@ inline double ScanMatcher::icpStep(OrientedPoint & pret, const ScanMatcherMap& m
     return score(map, pret, readings);
 }
 
+/*
+@desc	score()和likelihoodAndScore()中对一束激光的查找
+在击中点周围kernelSize的窗口中找被占用、并且沿着激光方向的前一个cell空闲的cell 取均值离击中点最近的一个
+@param	bestMu	击中点减去找到的cell的均值
+@param	phit	击中点的世界坐标
+@param	iphit	击中点的栅格坐标
+@param	ipfree	沿着激光方向的前一个cell相对于击中点的偏移
+@return			是否找到
+*/
+inline bool ScanMatcher::bestMatch(Point& bestMu, const ScanMatcherMap& map, const Point& phit, const IntPoint& iphit, const IntPoint& ipfree) const
+{
+    bool found=false;
+    bestMu=Point(0.,0.);
+    for (int xx=-m_kernelSize; xx<=m_kernelSize; xx++)
+        for (int yy=-m_kernelSize; yy<=m_kernelSize; yy++)
+        {
+            IntPoint pr=iphit+IntPoint(xx,yy);
+            IntPoint pf=pr+ipfree;
+            const ScanMatcherCell& cell=map.cell(pr);
+            const ScanMatcherCell& fcell=map.cell(pf);
+            if (((double)cell )> m_fullnessThreshold && ((double)fcell )<m_fullnessThreshold)
+            {
+                Point mu=phit-cell.mean(map.map2world(pr));
+                if (!found)
+                {
+                    bestMu=mu;
+                    found=true;
+                }
+                else
+                {
+                    bestMu=(mu*mu)<(bestMu*bestMu)?mu:bestMu;
+                }
+            }
+        }
+    return found;
+}
+
 /*
 @desc 		根据地图、机器人位置、激光雷达数据，计算出一个得分：原理为likelihood_field_range_finder_model
 这个函数被scanmatcher.cpp里面的optimize(OrientedPoint& pnew, const ScanMatcherMap& map, const OrientedPoint& init, const double* readings)
@@ -314,6 +460,22 @@ inline double ScanMatcher::score(const ScanMatcherMap& map, const OrientedPoint&
         phit.y+=*r*sin(lp.theta+*angle);
         IntPoint iphit=map.world2map(phit);
 
+        /*有似然场缓存的时候直接查表 击中的点在缓存的窗口外面的时候还是用下面的方法查找*/
+        if (m_useLikelihoodField && m_likelihoodField.valid(map))
+        {
+            const LikelihoodField::Entry* e=m_likelihoodField.entry(iphit);
+            if (e)
+            {
+                if (e->hit())
+                {
+                    Point c=map.map2world(iphit);
+                    Point mu(phit.x-c.x-e->dx, phit.y-c.y-e->dy);
+                    s += exp(-1.0/m_gaussianSigma*mu*mu);
+                }
+                continue;
+            }
+        }
+
         /*该束激光的最后一个空闲坐标，即紧贴hitCell的freeCell 原理为：假设phit是被激光击中的点，这样的话沿着激光方向的前面一个点必定的空闲的*/
         Point pfree=lp;
         //理论上来说 这个应该是一个bug。修改成下面的之后，改善不大。
@@ -337,8 +499,8 @@ inline double ScanMatcher::score(const ScanMatcherMap& map, const OrientedPoint&
                 IntPoint pf=pr+ipfree;
 
                 /*得到各自对应的Cell*/
-                const PointAccumulator& cell=map.cell(pr);
-                const PointAccumulator& fcell=map.cell(pf);
+                const ScanMatcherCell& cell=map.cell(pr);
+                const ScanMatcherCell& fcell=map.cell(pf);
                 /*
             (double)cell返回的是该cell被占用的概率
             这束激光要合法必须要满足cell是被占用的，而fcell是空闲的
@@ -347,7 +509,7 @@ inline double ScanMatcher::score(const ScanMatcherMap& map, const OrientedPoint&
                 if (((double)cell )> m_fullnessThreshold && ((double)fcell )<m_fullnessThreshold)
                 {
                     /*计算出被击中的点与对应的cell的currentScore距离*/
-                    Point mu=phit-cell.mean();
+                    Point mu=phit-cell.mean(map.map2world(pr));
                     if (!found)
                     {
                         bestMu=mu;
@@ -437,13 +599,13 @@ inline unsigned int ScanMatcher::likelihoodAndScore(double& s, double& l, const
             {
                 IntPoint pr=iphit+IntPoint(xx,yy);
                 IntPoint pf=pr+ipfree;
-                const PointAccumulator& cell=map.cell(pr);
-                const PointAccumulator& fcell=map.cell(pf);
+                const ScanMatcherCell& cell=map.cell(pr);
+                const ScanMatcherCell& fcell=map.cell(pf);
 
                 /*如果cell(pr)被占用 而cell(pf)没有被占用 则说明找到了一个合法的点*/
                 if (((double)cell )>m_fullnessThreshold && ((double)fcell )<m_fullnessThreshold)
                 {
-                    Point mu=phit-cell.mean();
+                    Point mu=phit-cell.mean(map.map2world(pr));
                     if (!found)
                     {
                         bestMu=mu;
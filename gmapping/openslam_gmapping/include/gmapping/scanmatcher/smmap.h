@@ -19,8 +19,11 @@ struct PointAccumulator
 	PointAccumulator(int i): acc(0,0), n(0), visits(0){assert(i==-1);}
 	/*after end*/
     inline void update(bool value, const Point& p=Point(0,0));
+	/*和CompactPointAccumulator的接口一致 center为cell中心的世界坐标 这里不需要*/
+	inline void update(bool value, const Point& p, const Point& ) {update(value, p);}
 	
 	inline Point mean() const {return 1./n*Point(acc.x, acc.y);}
+	inline Point mean(const Point& ) const {return mean();}
 	
 	/*返回被占用的概率*/
 	inline operator double() const { return visits?(double)n*SIGHT_INC/(double)visits:-1; }
@@ -78,8 +81,153 @@ double PointAccumulator::entropy() const
 	return -( x*log(x)+ (1-x)*log(1-x) );
 }
 
-//定义最终使用的地图数据类型 cell类型为PointAccumulator 存储数据类型为HierarchicalArray2D<PointAccumulator>
-typedef Map<PointAccumulator,HierarchicalArray2D<PointAccumulator> > ScanMatcherMap;
+/*
+ * 紧凑的cell 每个cell 8个字节 PointAccumulator为16个字节
+ * 每个粒子都有自己的地图 重采样之后被修改的patch都要复制 因此cell的大小决定了每个粒子占用的内存
+ *
+ * 击中点相对于cell中心的偏移量化为单位为OffsetUnit的整数，保存它们的和(24位)，均值为sx/n。
+ * 不保存量化之后的均值 否则每次更新都要舍入，击中次数多了之后小的修正会被舍掉，均值就不再变化了。
+ * 击中次数和访问次数用8位无符号整数保存，访问次数达到上限的时候两个计数和偏移量的和同时减半，占用概率和均值不变。
+ * 每个击中点的偏移最多32767个单位 255个击中点的和不会超过24位。
+ * cell本身不知道自己的坐标，因此更新和读取均值的时候都要给出cell中心的世界坐标。
+ */
+struct CompactPointAccumulator
+{
+	CompactPointAccumulator(): sx(0), n(0), sy(0), visits(0){}
+	CompactPointAccumulator(int i): sx(0), n(0), sy(0), visits(0){assert(i==-1);}
+
+	/*p为击中点的世界坐标 center为这个cell中心的世界坐标 没有击中的时候p和center都不需要*/
+	inline void update(bool value, const Point& p=Point(0,0), const Point& center=Point(0,0));
+
+	inline Point mean(const Point& center) const
+	{
+		if (!n)
+			return center;
+		double k=OffsetUnit/n;
+		return Point(center.x+sx*k, center.y+sy*k);
+	}
+
+	/*返回被占用的概率*/
+	inline operator double() const { return visits?(double)n*SIGHT_INC/(double)visits:-1; }
+
+	inline void add(const CompactPointAccumulator& p);
+
+	static const CompactPointAccumulator& Unknown();
+
+	static CompactPointAccumulator* unknown_ptr;
+
+	/*偏移量的单位 0.1mm 每个击中点最大可以表示3.2m的偏移*/
+	static const double OffsetUnit;
+	static const unsigned int MaxCount=255;
+
+	/*击中点相对于cell中心的偏移的和 n表示被hit中的次数  visits表示访问的次数*/
+	signed int sx:24;
+	unsigned int n:8;
+	signed int sy:24;
+	unsigned int visits:8;
+	inline double entropy() const;
+
+	protected:
+		static inline int quantize(double v);
+		/*计数达到上限之前减半*/
+		inline void halve();
+		/*击中次数变为count 偏移量的和按比例缩放 均值不变*/
+		inline void rescale(unsigned int count);
+};
+
+int CompactPointAccumulator::quantize(double v)
+{
+	v=floor(v+.5);
+	if (v>32767.)
+		return 32767;
+	if (v<-32767.)
+		return -32767;
+	return (int)v;
+}
+
+void CompactPointAccumulator::rescale(unsigned int count)
+{
+	if (n)
+	{
+		double k=(double)count/n;
+		sx=(int)floor(sx*k+.5);
+		sy=(int)floor(sy*k+.5);
+	}
+	n=count;
+}
+
+void CompactPointAccumulator::halve()
+{
+	if ((unsigned int)visits+SIGHT_INC>MaxCount)
+	{
+		rescale(n>>1);
+		visits>>=1;
+	}
+}
+
+/*
+@desc 更新某个Cell的状态 击中的时候把量化之后的偏移加到和中
+*/
+void CompactPointAccumulator::update(bool value, const Point& p, const Point& center)
+{
+	halve();
+	if (value)
+	{
+		n++;
+		sx+=quantize((p.x-center.x)/OffsetUnit);
+		sy+=quantize((p.y-center.y)/OffsetUnit);
+		visits+=SIGHT_INC;
+	}
+	else
+		visits++;
+}
+
+void CompactPointAccumulator::add(const CompactPointAccumulator& p)
+{
+	//先在32位整数中求和 再减半到8位计数的范围内
+	int tx=sx+p.sx, ty=sy+p.sy;
+	unsigned int tn=(unsigned int)n+p.n;
+	unsigned int tv=(unsigned int)visits+p.visits;
+	unsigned int cn=tn;
+	while (tv>MaxCount)
+	{
+		cn>>=1;
+		tv>>=1;
+	}
+	if (tn)
+	{
+		double k=(double)cn/tn;
+		tx=(int)floor(tx*k+.5);
+		ty=(int)floor(ty*k+.5);
+	}
+	sx=tx;
+	sy=ty;
+	n=cn;
+	visits=tv;
+}
+
+double CompactPointAccumulator::entropy() const
+{
+	if (!visits)
+		return -log(.5);
+	if (n==visits || n==0)
+		return 0;
+
+	double x=(double)n*SIGHT_INC/(double)visits;
+	return -( x*log(x)+ (1-x)*log(1-x) );
+}
+
+//地图使用的cell的类型
+//默认为PointAccumulator 定义GMAPPING_COMPACT_CELL则使用CompactPointAccumulator
+//openslam_gmapping和slam_gmapping必须用同样的定义编译 用cmake的GMAPPING_COMPACT_CELL选项打开 会通过catkin导出给slam_gmapping
+#ifdef GMAPPING_COMPACT_CELL
+typedef CompactPointAccumulator ScanMatcherCell;
+#else
+typedef PointAccumulator ScanMatcherCell;
+#endif
+
+//定义最终使用的地图数据类型 cell类型为ScanMatcherCell 存储数据类型为HierarchicalArray2D<ScanMatcherCell>
+typedef Map<ScanMatcherCell,HierarchicalArray2D<ScanMatcherCell> > ScanMatcherMap;
 
 };
 
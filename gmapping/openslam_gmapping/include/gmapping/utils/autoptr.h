@@ -4,6 +4,11 @@
 
 namespace GMapping{
 
+/*
+ * 引用计数的智能指针 地图的patch在多个粒子之间共享
+ * 粒子的扫描匹配和地图更新是在多个线程中进行的，不同线程中的地图可能会共享同一个patch，
+ * 因此引用计数的增减用原子操作来完成。
+ */
 template <class X>
 class autoptr{
 	protected:
@@ -11,8 +16,10 @@ class autoptr{
 	public:
 	struct reference{
 		X* data;
-		unsigned int shares;
+		volatile unsigned int shares;
 	};
+		static inline void addShare(reference* ref);
+		static inline bool releaseShare(reference* ref);
 		inline autoptr(X* p=(X*)(0));
 		inline autoptr(const autoptr<X>& ap);
 		inline autoptr& operator=(const autoptr<X>& ap);
@@ -41,7 +48,7 @@ autoptr<X>::autoptr(const autoptr<X>& ap){
 	reference* ref=ap.m_reference;
 	if (ap.m_reference){
 		m_reference=ref;
-		m_reference->shares++;
+		addShare(m_reference);
 	}
 }
 
@@ -51,14 +58,14 @@ autoptr<X>& autoptr<X>::operator=(const autoptr<X>& ap){
 	if (m_reference==ref){
 		return *this;
 	}
-	if (m_reference && !(--m_reference->shares)){
+	if (m_reference && releaseShare(m_reference)){
 		delete m_reference->data;
 		delete m_reference;
 		m_reference=0;
 	}	
 	if (ref){
 		m_reference=ref;
-		m_reference->shares++;
+		addShare(m_reference);
 	} 
 //20050802 nasty changes begin
 	else
@@ -69,13 +76,24 @@ autoptr<X>& autoptr<X>::operator=(const autoptr<X>& ap){
 
 template <class X>
 autoptr<X>::~autoptr(){
-	if (m_reference && !(--m_reference->shares)){
+	if (m_reference && releaseShare(m_reference)){
 		delete m_reference->data;
 		delete m_reference;
 		m_reference=0;
 	}	
 }
 
+template <class X>
+void autoptr<X>::addShare(reference* ref){
+	__sync_add_and_fetch(&ref->shares, 1);
+}
+
+//返回true表示这是最后一个引用 需要释放内存
+template <class X>
+bool autoptr<X>::releaseShare(reference* ref){
+	return __sync_sub_and_fetch(&ref->shares, 1)==0;
+}
+
 template <class X>
 autoptr<X>::operator int() const{
 	return m_reference && m_reference->shares && m_reference->data;
@@ -6,6 +6,12 @@ qualifier: type m_##name;\
 getqualifier: inline type get##name() const {return m_##name;}\
 setqualifier: inline void set##name(type name) {m_##name=name;}
 
+/*和PARAM_SET_GET一样 setter中还会调用notify()通知参数改变了*/
+#define PARAM_SET_GET_NOTIFY(type, name, qualifier, setqualifier, getqualifier, notify)\
+qualifier: type m_##name;\
+getqualifier: inline type get##name() const {return m_##name;}\
+setqualifier: inline void set##name(type name) {m_##name=name; notify();}
+
 #define PARAM_SET(type, name, qualifier, setqualifier)\
 qualifier: type m_##name;\
 setqualifier: inline void set##name(type name) {m_##name=name;}
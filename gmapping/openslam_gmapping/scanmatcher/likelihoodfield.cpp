@@ -0,0 +1,84 @@
+#include <gmapping/scanmatcher/likelihoodfield.h>
+
+namespace GMapping {
+
+const float LikelihoodField::NoHit=1e30f;
+
+LikelihoodField::LikelihoodField():
+	m_map(0), m_kernelSize(1), m_fullnessThreshold(0.1), m_bx0(0), m_by0(0), m_blocks(0), m_stamp(0)
+{
+}
+
+void LikelihoodField::reset(const ScanMatcherMap& map, const IntPoint& center, int radius, int kernelSize, double fullnessThreshold)
+{
+	m_map=&map;
+	m_kernelSize=kernelSize;
+	m_fullnessThreshold=fullnessThreshold;
+
+	m_bx0=(center.x-radius)>>BlockMagnitude;
+	m_by0=(center.y-radius)>>BlockMagnitude;
+	int blocks=((center.x+radius)>>BlockMagnitude)-m_bx0+1;
+
+	//窗口大小变化的时候重新分配 否则只需要改变编号
+	if (blocks!=m_blocks)
+	{
+		m_blocks=blocks;
+		m_blockStamp.assign(m_blocks*m_blocks, 0);
+		m_blockOffset.resize(m_blocks*m_blocks);
+		m_stamp=0;
+	}
+	m_stamp++;
+	if (!m_stamp)
+	{
+		//编号溢出了 把所有的block都标记为没有计算过
+		m_blockStamp.assign(m_blockStamp.size(), 0);
+		m_stamp=1;
+	}
+	m_entries.clear();
+}
+
+void LikelihoodField::computeBlock(Entry* e, int bx, int by)
+{
+	//先把block及其周围kernelSize范围内的cell读出来 避免重复访问地图
+	const ScanMatcherMap& map=*m_map;
+	int x0=(bx<<BlockMagnitude)-m_kernelSize, y0=(by<<BlockMagnitude)-m_kernelSize;
+	int w=BlockSize+2*m_kernelSize;
+	m_means.resize(w*w);
+	m_occupied.resize(w*w);
+	for (int x=0; x<w; x++)
+		for (int y=0; y<w; y++)
+		{
+			IntPoint pr(x0+x, y0+y);
+			const ScanMatcherCell& cell=map.cell(pr);
+			bool occupied=((double)cell)>m_fullnessThreshold;
+			m_occupied[x*w+y]=occupied;
+			if (occupied)
+				m_means[x*w+y]=cell.mean(map.map2world(pr));
+		}
+
+	//每个cell在窗口中找离中心最近的被占用的cell
+	for (int x=0; x<BlockSize; x++)
+		for (int y=0; y<BlockSize; y++, e++)
+		{
+			Point c=map.map2world(IntPoint(x0+m_kernelSize+x, y0+m_kernelSize+y));
+			bool found=false;
+			Point best(0.,0.);
+			for (int xx=0; xx<=2*m_kernelSize; xx++)
+				for (int yy=0; yy<=2*m_kernelSize; yy++)
+				{
+					int i=(x+xx)*w+y+yy;
+					if (!m_occupied[i])
+						continue;
+					Point d=m_means[i]-c;
+					if (!found || d*d<best*best)
+					{
+						best=d;
+						found=true;
+					}
+				}
+			e->dx=found ? (float)best.x : NoHit;
+			e->dy=found ? (float)best.y : NoHit;
+		}
+}
+
+};
@@ -16,6 +16,7 @@ namespace GMapping {
 using namespace std;
 
 const double ScanMatcher::nullLikelihood=-.5;
+unsigned long ScanMatcher::s_parametersVersions=0;
 
 ScanMatcher::ScanMatcher(): m_laserPose(0,0,0)
 {
@@ -36,6 +37,7 @@ ScanMatcher::ScanMatcher(): m_laserPose(0,0,0)
 
     //地图进行拓展的大小
 	m_enlargeStep=10.;
+	m_generateMap=false;
 
 	m_fullnessThreshold=0.1;
 
@@ -50,6 +52,17 @@ ScanMatcher::ScanMatcher(): m_laserPose(0,0,0)
 
     //跳过一帧激光数据的开始几束激光
 	m_initialBeamsSkip=0;	
+
+    //默认不使用似然场缓存 和原来的匹配结果完全一致
+    m_useLikelihoodField=false;
+
+    m_endpointsUsed=0;
+    m_endpointsNext=0;
+
+    //默认不进行相关性搜索
+    m_correlativeLinearWindow=0.;
+    m_correlativeAngularWindow=0.;
+    m_correlativeAngularStep=0.02;
 /*	
 	// This  are the dafault settings for a grid map of 10 cm
 	m_llsamplerange=0.1;
@@ -66,12 +79,33 @@ ScanMatcher::ScanMatcher(): m_laserPose(0,0,0)
 	m_generateMap=false;
 */
 
-   m_linePoints = new IntPoint[20000];
+   m_linePoints.resize(20000);
+
+   //默认参数也是一个版本 和其他的ScanMatcher都不同
+   parametersChanged();
 }
 
 ScanMatcher::~ScanMatcher()
 {
-	delete [] m_linePoints;
+}
+
+/*
+@desc 复制other的参数 每个线程的scanmatcher用它和GridSlamProcessor::m_matcher保持一致
+参数的版本号相同的时候什么都不做 m_linePoints、似然场和击中点的缓存都保留 不需要每一帧都重新分配
+版本号不同的时候复制整个other 不需要在这里逐个列出参数 新加的参数也会被复制
+*/
+bool ScanMatcher::copyParameters(const ScanMatcher& other)
+{
+    if (m_parametersVersion==other.m_parametersVersion)
+        return false;
+
+    *this=other;
+
+    //缓存是用原来的参数或者other的地图计算的
+    m_likelihoodField.invalidate();
+    m_endpointsUsed=0;
+    m_activeAreaComputed=false;
+    return true;
 }
 
 /**
@@ -163,7 +197,7 @@ void ScanMatcher::computeActiveArea(ScanMatcherMap& map, const OrientedPoint& p,
 	}
 	
 	/*地图的有效区域(地图坐标系)*/
-	HierarchicalArray2D<PointAccumulator>::PointSet activeArea;
+	HierarchicalArray2D<ScanMatcherCell>::PointSet activeArea;
 
 	/*allocate the active area*/
 	angle=m_laserAngles+m_initialBeamsSkip;
@@ -187,7 +221,7 @@ void ScanMatcher::computeActiveArea(ScanMatcherMap& map, const OrientedPoint& p,
 			
             /*bresenham算法来计算激光起点到终点要经过的路径*/
 			GridLineTraversalLine line;
-			line.points=m_linePoints;
+			line.points=&m_linePoints[0];
 			GridLineTraversal::gridLine(p0, p1, &line);
 			
             /*更新地图 把画线算法计算出来的值都算进去*/
@@ -233,6 +267,9 @@ void ScanMatcher::computeActiveArea(ScanMatcherMap& map, const OrientedPoint& p,
 */
 double ScanMatcher::registerScan(ScanMatcherMap& map, const OrientedPoint& p, const double* readings)
 {
+    //地图要被修改了 之前建立的似然场缓存不能再使用
+    m_likelihoodField.invalidate();
+
     if (!m_activeAreaComputed)
         computeActiveArea(map, p, readings);
 
@@ -272,13 +309,13 @@ double ScanMatcher::registerScan(ScanMatcherMap& map, const OrientedPoint& p, co
 			
 			/*bresenham画线算法来计算 激光位置和被激光击中的位置之间的空闲位置*/
 			GridLineTraversalLine line;
-			line.points=m_linePoints;
+			line.points=&m_linePoints[0];
 			GridLineTraversal::gridLine(p0, p1, &line);
 			
 			/*更新空闲位置*/
 			for (int i=0; i<line.num_points-1; i++)
 			{
-				PointAccumulator& cell=map.cell(line.points[i]);
+				ScanMatcherCell& cell=map.cell(line.points[i]);
 				/*更新前的熵的负数*/
 				double e=-cell.entropy();       
 				cell.update(false, Point(0,0));
@@ -291,7 +328,7 @@ double ScanMatcher::registerScan(ScanMatcherMap& map, const OrientedPoint& p, co
 			if (d<m_usableRange)
 			{
 				double e=-map.cell(p1).entropy();
-				map.cell(p1).update(true, phit);
+				map.cell(p1).update(true, phit, map.map2world(p1));
 				e+=map.cell(p1).entropy();
 				esum+=e;
 			}
@@ -307,7 +344,7 @@ double ScanMatcher::registerScan(ScanMatcherMap& map, const OrientedPoint& p, co
 			assert(p1.x>=0 && p1.y>=0);
 			
 			/*更新对应的cell的值*/
-			map.cell(p1).update(true,phit);
+			map.cell(p1).update(true, phit, map.map2world(p1));
 		}
 	}
 	return esum;
@@ -325,6 +362,7 @@ double ScanMatcher::registerScan(ScanMatcherMap& map, const OrientedPoint& p, co
 
 double ScanMatcher::icpOptimize(OrientedPoint& pnew, const ScanMatcherMap& map, const OrientedPoint& init, const double* readings) const
 {
+	resetLikelihoodField(map, init);
 	double currentScore;
     double sc=score(map, init, readings);
 	OrientedPoint start=init;
@@ -361,11 +399,40 @@ double ScanMatcher::icpOptimize(OrientedPoint& pnew, const ScanMatcherMap& map,
 @param  readings	激光数据
 */
 double ScanMatcher::optimize(OrientedPoint& pnew, const ScanMatcherMap& map, const OrientedPoint& init, const double* readings) const
+{
+    ScoredMove best;
+    double bestScore=optimize(best, map, init, readings);
+    pnew=best.pose;
+    return bestScore;
+}
+
+/*
+@desc	和上面的函数一样进行scan-match 同时返回最优位姿的似然和匹配上的激光束的数量
+不使用似然场缓存的时候 每次打分都用likelihoodAndScore()同时计算得分和似然
+最优位姿的似然在爬山的过程中已经计算好了 不需要再遍历一次激光束
+使用似然场缓存的时候 打分是近似的 最后对最优位姿精确地计算一次似然
+@param	best		最优的位姿 得分(乘了里程计的增益) 似然 匹配上的激光束的数量
+@param  map			地图
+@param	init		初始位置
+@param  readings	激光数据
+*/
+double ScanMatcher::optimize(ScoredMove& best, const ScanMatcherMap& map, const OrientedPoint& init, const double* readings) const
 {
     double bestScore=-1;
-    /*计算当前位置的得分*/
+    resetLikelihoodField(map, init);
+    bool useField=m_useLikelihoodField && m_likelihoodField.valid(map);
+
+    //击中点的缓存只在这一次优化中有效
+    m_endpointsUsed=0;
+
+    /*计算当前位置的得分 current中保存当前位置的得分和似然*/
     OrientedPoint currentPose=init;
-    double currentScore=score(map, currentPose, readings);
+    ScoredMove current={currentPose, 0, 0, 0};
+    if (useField)
+        current.score=score(map, currentPose, endpoints(map, currentPose.theta, readings));
+    else
+        current.matched=likelihoodAndScore(current.score, current.likelihood, map, currentPose, endpoints(map, currentPose.theta, readings));
+    double currentScore=current.score;
 	
     /*所有时的步进增量*/
     double adelta=m_optAngularDelta, ldelta=m_optLinearDelta;
@@ -389,6 +456,7 @@ double ScanMatcher::optimize(OrientedPoint& pnew, const ScanMatcherMap& map, con
         bestScore=currentScore;
         OrientedPoint bestLocalPose=currentPose;
         OrientedPoint localPose=currentPose;
+        ScoredMove bestLocal=current;
 
         /*把8个方向都搜索一次  得到这8个方向里面最好的一个位姿和对应的得分*/
         Move move=Front;
@@ -442,36 +510,41 @@ double ScanMatcher::optimize(OrientedPoint& pnew, const ScanMatcherMap& map, con
                 double drho=dx*dx+dy*dy;
                 odo_gain*=exp(-m_linearOdometryReliability*drho);
             }
-            /*计算得分=增益*score*/
-            double localScore=odo_gain*score(map, localPose, readings);
+            /*计算得分=增益*score 平移的时候朝向不变 击中点从缓存中取出来*/
+            ScoredMove local={localPose, 0, 0, 0};
+            if (useField)
+                local.score=score(map, localPose, endpoints(map, localPose.theta, readings));
+            else
+                local.matched=likelihoodAndScore(local.score, local.likelihood, map, localPose, endpoints(map, localPose.theta, readings));
+            double localScore=odo_gain*local.score;
 			
             /*如果得分更好，则更新*/
             if (localScore>currentScore)
             {
                 currentScore=localScore;
                 bestLocalPose=localPose;
+                bestLocal=local;
             }
             c_iterations++;
         } while(move!=Done);
 		
         /* 把当前位置设置为目前最优的位置  如果8个值都被差了的话，那么这个值不会更新*/
         currentPose=bestLocalPose;
+        current=bestLocal;
     }while (currentScore>bestScore || refinement<m_optRecursiveIterations);
 	
+    /*似然场的打分是近似的 最优位姿的似然要精确地计算*/
+    if (useField)
+        current.matched=likelihoodAndScore(current.score, current.likelihood, map, currentPose, endpoints(map, currentPose.theta, readings));
+
     /*返回最优位置和得分*/
-    pnew=currentPose;
+    best=current;
+    best.pose=currentPose;
+    best.score=bestScore;
     return bestScore;
 }
 
 
-//表示一个位姿和这个位姿的似然+得分
-struct ScoredMove
-{
-	OrientedPoint pose;
-	double score;
-	double likelihood;
-};
-
 //用来存储在scan-match的过程中 机器人的优化的路径的节点
 //主要在下面的optimize()函数里面被调用
 typedef std::list<ScoredMove> ScoredMoveList;
@@ -497,7 +570,7 @@ double ScanMatcher::optimize(OrientedPoint& _mean, ScanMatcher::CovarianceMatrix
 	
 	/*计算当前位置的得分score和似然likehood*/
 	OrientedPoint currentPose=init;
-	ScoredMove sm={currentPose,0,0};
+	ScoredMove sm={currentPose,0,0,0};
 	unsigned int matched=likelihoodAndScore(sm.score, sm.likelihood, map, currentPose, readings);
 	double currentScore=sm.score;
 	moveList.push_back(sm);
@@ -850,6 +923,319 @@ void ScanMatcher::setLaserParameters
     m_laserBeams=beams;
     //m_laserAngles=new double[beams];
     memcpy(m_laserAngles, angles, sizeof(double)*m_laserBeams);
+    parametersChanged();
+}
+
+
+/*
+@desc	计算朝向为theta时参与打分的激光束的击中点 激光束的选择和score()以及likelihoodAndScore()一样
+距离为0的激光束只在计算似然的时候使用 放在最后面
+@param	e			保存击中点
+@param	map			地图 用来计算ipfree
+@param	theta		机器人的朝向
+@param	readings	激光数据
+*/
+void ScanMatcher::computeEndpoints(BeamEndpoints& e, const ScanMatcherMap& map, double theta, const double* readings) const
+{
+	e.theta=theta;
+	e.x.clear();
+	e.y.clear();
+	e.fx.clear();
+	e.fy.clear();
+
+	/*激光雷达相对于机器人位置的偏移*/
+	double c=cos(theta), s=sin(theta);
+	double lx=c*m_laserPose.x-s*m_laserPose.y;
+	double ly=s*m_laserPose.x+c*m_laserPose.y;
+	double ltheta=theta+m_laserPose.theta;
+
+	unsigned int skip=0;
+	unsigned int zeros=0;
+	double freeDelta=map.getDelta()*m_freeCellRatio;
+	const double * angle=m_laserAngles+m_initialBeamsSkip;
+	for (const double* r=readings+m_initialBeamsSkip; r<readings+m_laserBeams; r++, angle++)
+	{
+		skip++;
+		skip=skip>m_likelihoodSkip?0:skip;
+		if (skip||*r>m_usableRange) continue;
+		if (*r==0.0)
+		{
+			zeros++;
+			continue;
+		}
+
+		double bc=cos(ltheta+*angle), bs=sin(ltheta+*angle);
+		e.x.push_back(lx+*r*bc);
+		e.y.push_back(ly+*r*bs);
+		IntPoint ipfree=map.world2map(Point(-freeDelta*bc, -freeDelta*bs));
+		e.fx.push_back(ipfree.x);
+		e.fy.push_back(ipfree.y);
+	}
+
+	/*距离为0的激光束击中点就是激光雷达的位置*/
+	e.scored=e.x.size();
+	angle=m_laserAngles+m_initialBeamsSkip;
+	skip=0;
+	for (const double* r=readings+m_initialBeamsSkip; zeros && r<readings+m_laserBeams; r++, angle++)
+	{
+		skip++;
+		skip=skip>m_likelihoodSkip?0:skip;
+		if (skip||*r!=0.0) continue;
+
+		double bc=cos(ltheta+*angle), bs=sin(ltheta+*angle);
+		e.x.push_back(lx);
+		e.y.push_back(ly);
+		IntPoint ipfree=map.world2map(Point(-freeDelta*bc, -freeDelta*bs));
+		e.fx.push_back(ipfree.x);
+		e.fy.push_back(ipfree.y);
+		zeros--;
+	}
+}
+
+const BeamEndpoints& ScanMatcher::endpoints(const ScanMatcherMap& map, double theta, const double* readings) const
+{
+	for (int i=0; i<m_endpointsUsed; i++)
+		if (m_endpoints[i].theta==theta)
+			return m_endpoints[i];
+
+	BeamEndpoints& e=m_endpoints[m_endpointsNext];
+	m_endpointsNext=(m_endpointsNext+1)%EndpointsCacheSize;
+	if (m_endpointsUsed<EndpointsCacheSize)
+		m_endpointsUsed++;
+	computeEndpoints(e, map, theta, readings);
+	return e;
+}
+
+/*
+@desc	批量计算机器人在p的时候所有击中点的栅格坐标 保存在m_hitX m_hitY中
+这一步没有分支 可以向量化
+*/
+void ScanMatcher::computeHitCells(const ScanMatcherMap& map, const Point& p, const BeamEndpoints& e) const
+{
+	int n=e.size();
+	if ((int)m_hitX.size()<n)
+	{
+		m_hitX.resize(n);
+		m_hitY.resize(n);
+	}
+	if (!n)
+		return;
+
+	/*
+	 * world2map()为round((x-center)/delta)+size/2
+	 * 先算出机器人所在的栅格，只对相对于机器人的偏移取整
+	 * 偏移和计算都用double 用float的时候栅格边界附近的击中点会落到相邻的栅格 得分和score(map, p, readings)不一样
+	 */
+	double inv=1./map.getDelta();
+	IntPoint ip=map.world2map(p);
+	Point op=map.map2world(ip);
+	double ox=(p.x-op.x)*inv+.5, oy=(p.y-op.y)*inv+.5;
+	const double* ex=&e.x[0];
+	const double* ey=&e.y[0];
+	int* hx=&m_hitX[0];
+	int* hy=&m_hitY[0];
+	GMAPPING_SIMD
+	for (int i=0; i<n; i++)
+	{
+		//向下取整 (int)是向零取整 负数的时候要减一
+		double tx=ox+ex[i]*inv, ty=oy+ey[i]*inv;
+		int kx=(int)tx, ky=(int)ty;
+		hx[i]=ip.x+kx-(tx<(double)kx);
+		hy[i]=ip.y+ky-(ty<(double)ky);
+	}
+}
+
+/*
+@desc	和score(map, p, readings)一样的打分 击中点使用预先计算好的e
+先批量计算所有击中点的栅格坐标 然后对每一束激光在地图中查找匹配的点
+@param	map		地图
+@param	p		机器人的位置 朝向为e.theta
+@param	e		击中点
+*/
+double ScanMatcher::score(const ScanMatcherMap& map, const Point& p, const BeamEndpoints& e) const
+{
+	computeHitCells(map, p, e);
+
+	bool useField=m_useLikelihoodField && m_likelihoodField.valid(map);
+	double s=0;
+	for (unsigned int i=0; i<e.scored; i++)
+	{
+		Point phit(p.x+e.x[i], p.y+e.y[i]);
+		IntPoint iphit(m_hitX[i], m_hitY[i]);
+
+		if (useField)
+		{
+			const LikelihoodField::Entry* f=m_likelihoodField.entry(iphit);
+			if (f)
+			{
+				if (f->hit())
+				{
+					Point c=map.map2world(iphit);
+					Point mu(phit.x-c.x-f->dx, phit.y-c.y-f->dy);
+					s+=exp(-1.0/m_gaussianSigma*mu*mu);
+				}
+				continue;
+			}
+		}
+
+		Point bestMu;
+		if (bestMatch(bestMu, map, phit, iphit, IntPoint(e.fx[i], e.fy[i])))
+			s+=exp(-1.0/m_gaussianSigma*bestMu*bestMu);
+	}
+	return s;
+}
+
+/*
+@desc	和likelihoodAndScore(s, l, map, p, readings)一样 一次遍历激光束同时计算得分和似然
+得分s只包括距离不为0的激光束 和score()的结果相同 似然l包括所有的激光束
+不使用似然场缓存 结果总是精确的
+@param	s		得分
+@param	l		似然
+@param	map		地图
+@param	p		机器人的位置 朝向为e.theta
+@param	e		击中点
+@return			匹配上的激光束的数量
+*/
+unsigned int ScanMatcher::likelihoodAndScore(double& s, double& l, const ScanMatcherMap& map, const Point& p, const BeamEndpoints& e) const
+{
+	computeHitCells(map, p, e);
+
+	double noHit=nullLikelihood/(m_likelihoodSigma);
+	unsigned int c=0;
+	s=0;
+	l=0;
+	for (unsigned int i=0; i<e.size(); i++)
+	{
+		Point phit(p.x+e.x[i], p.y+e.y[i]);
+		Point bestMu;
+		if (bestMatch(bestMu, map, phit, IntPoint(m_hitX[i], m_hitY[i]), IntPoint(e.fx[i], e.fy[i])))
+		{
+			if (i<e.scored)
+				s+=exp(-1.0/m_gaussianSigma*bestMu*bestMu);
+			l+=(-1./m_likelihoodSigma)*(bestMu*bestMu);
+			c++;
+		}
+		else
+			l+=noHit;
+	}
+	return c;
+}
+
+/*
+@desc	低分辨率地图上一个位置的占用概率 用周围4个cell的占用概率双线性插值 没有被观测过的cell为0
+插值之后得分随着位姿连续变化 可以用比栅格更小的步长搜索
+*/
+static inline double interpolatedOccupancy(const ScanMatcherMap& lowMap, const Point& o, double inv, const Point& p)
+{
+	double u=(p.x-o.x)*inv, v=(p.y-o.y)*inv;
+	int x=(int)floor(u), y=(int)floor(v);
+	double fu=u-x, fv=v-y;
+	double c00=lowMap.cell(IntPoint(x,y)), c10=lowMap.cell(IntPoint(x+1,y));
+	double c01=lowMap.cell(IntPoint(x,y+1)), c11=lowMap.cell(IntPoint(x+1,y+1));
+	c00=c00>0. ? c00 : 0.;
+	c10=c10>0. ? c10 : 0.;
+	c01=c01>0. ? c01 : 0.;
+	c11=c11>0. ? c11 : 0.;
+	return (1-fv)*((1-fu)*c00+fu*c10)+fv*((1-fu)*c01+fu*c11);
+}
+
+/*
+@desc	在低分辨率地图上进行由粗到细的相关性搜索
+第一层：枚举窗口内的每一个角度 击中点只计算一次 平移就是击中点的栅格坐标加上一个整数的偏移
+        得分为击中点所在的cell的占用概率的和 步长为低分辨率地图的栅格大小
+第二层：在第一层的结果周围半个栅格的范围内 用半个栅格的步长和相邻的角度搜索 得分用双线性插值计算
+两层中得分相同的时候都选择离初始位姿最近的位姿 后面optimize()在高分辨率地图上继续细化
+@param	lowMap		低分辨率地图
+@param	map			高分辨率地图
+@param	init		初始位姿
+@param	readings	激光数据
+*/
+OrientedPoint ScanMatcher::correlativeSearch(const ScanMatcherMap& lowMap, const ScanMatcherMap& map, const OrientedPoint& init, const double* readings) const
+{
+	double lowDelta=lowMap.getDelta();
+	int r=(int)ceil(m_correlativeLinearWindow/lowDelta);
+	int na=m_correlativeAngularStep>0. ? (int)ceil(m_correlativeAngularWindow/m_correlativeAngularStep) : 0;
+	BeamEndpoints& e=m_correlativeEndpoints;
+
+	/*第一层 整数栅格的平移*/
+	double bestScore=-1;
+	int bestDist=0, bestA=0, bestI=0, bestJ=0;
+	for (int a=-na; a<=na; a++)
+	{
+		computeEndpoints(e, lowMap, init.theta+a*m_correlativeAngularStep, readings);
+		computeHitCells(lowMap, init, e);
+		for (int i=-r; i<=r; i++)
+			for (int j=-r; j<=r; j++)
+			{
+				double s=0;
+				for (unsigned int b=0; b<e.scored; b++)
+				{
+					double occ=lowMap.cell(IntPoint(m_hitX[b]+i, m_hitY[b]+j));
+					if (occ>0.)
+						s+=occ;
+				}
+				int dist=i*i+j*j+a*a;
+				if (s>bestScore || (s==bestScore && dist<bestDist))
+				{
+					bestScore=s;
+					bestDist=dist;
+					bestA=a;
+					bestI=i;
+					bestJ=j;
+				}
+			}
+	}
+
+	/*第二层 半个栅格的平移 双线性插值*/
+	Point o=lowMap.map2world(IntPoint(0,0));
+	double inv=1./lowDelta;
+	double step=.5*lowDelta;
+	OrientedPoint best=init;
+	bestScore=-1;
+	double bestDist2=0;
+	for (int a=bestA-1; a<=bestA+1; a++)
+	{
+		if (a<-na || a>na)
+			continue;
+		double theta=init.theta+a*m_correlativeAngularStep;
+		computeEndpoints(e, lowMap, theta, readings);
+		for (int i=-1; i<=1; i++)
+			for (int j=-1; j<=1; j++)
+			{
+				Point p(init.x+bestI*lowDelta+i*step, init.y+bestJ*lowDelta+j*step);
+				double s=0;
+				for (unsigned int b=0; b<e.scored; b++)
+					s+=interpolatedOccupancy(lowMap, o, inv, Point(p.x+e.x[b], p.y+e.y[b]));
+				double dx=p.x-init.x, dy=p.y-init.y, dth=(a*m_correlativeAngularStep)*lowDelta;
+				double dist=dx*dx+dy*dy+dth*dth;
+				if (s>bestScore || (s==bestScore && dist<bestDist2))
+				{
+					bestScore=s;
+					bestDist2=dist;
+					best=OrientedPoint(p.x, p.y, theta);
+				}
+			}
+	}
+
+	/*低分辨率地图上的结果可能是错的 在高分辨率地图上不如初始位姿的时候不使用*/
+	if (score(map, best, readings)>score(map, init, readings))
+		return best;
+	return init;
+}
+
+/*
+@desc	为map建立似然场缓存
+窗口覆盖以p为中心、usableRange为半径的范围，再留出1m给优化过程中位姿的移动。
+窗口的半径最大为1024个栅格 更远的激光在score()中还是用原来的方法查找
+*/
+void ScanMatcher::resetLikelihoodField(const ScanMatcherMap& map, const OrientedPoint& p) const
+{
+	if (!m_useLikelihoodField)
+		return;
+	int radius=(int)ceil((m_usableRange+1.)/map.getDelta())+m_kernelSize;
+	if (radius>1024)
+		radius=1024;
+	m_likelihoodField.reset(map, map.world2map(p), radius, m_kernelSize, m_fullnessThreshold);
 }
 
 
@@ -866,6 +1252,7 @@ void ScanMatcher::setMatchingParameters
 	m_gaussianSigma=sigma;						//计算socre时的方差
 	m_likelihoodSigma=likelihoodSigma;			//计算似然时的方差	
 	m_likelihoodSkip=likelihoodSkip;			//计算似然时，跳过的激光束
+	parametersChanged();
 }
 
 };
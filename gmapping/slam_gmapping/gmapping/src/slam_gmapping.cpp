@@ -58,6 +58,10 @@ Parameters used by our GMapping wrapper:
 - @b "~map_frame": @b [string] the tf frame_id where the robot pose on the map is published
 - @b "~odom_frame": @b [string] the tf frame_id from which odometry is read
 - @b "~map_update_interval": @b [double] time in seconds between two recalculations of the map
+- @b "~map_checkpoint_interval": @b [int] 可视化地图每插入这么多个轨迹节点保存一个检查点 最优粒子的轨迹变化的时候从检查点开始重新建图 (0 = 不保存检查点)
+- @b "~map_max_checkpoints": @b [int] 最多保存的检查点的数量 打开maxTreeDepth的时候比被剪掉的节点还老的检查点会被删除
+- @b "~scan_queue_size": @b [int] 等待滤波线程处理的激光数据的最大数量 队列满了的时候丢掉最老的一帧 (0 = 不使用滤波线程和建图线程 在回调函数中直接处理)
+- @b "~map_thread_nice": @b [int] 建图线程的nice值 建图线程的优先级比滤波线程低 (0 = 不改变优先级)
 
 
 Parameters used by GMapping itself:
@@ -79,6 +83,13 @@ likelihood是指高斯分布的指数项的系数，即e的指数系数
 因此需要在一个激光击中的点的邻域内进行查找，这个参数定义邻域的范围
 这个数值表示单位表示cell的单位 也就是说这个值应该是整数
 - @b "~/kernelSize" @b [double] search window for the scan matching process
+- @b "~/useLikelihoodField" @b [bool] 爬山优化的时候每个cell的匹配结果只计算一次并缓存起来 每束激光只需要查一次表 匹配结果是近似的 (default: false)
+
+爬山优化之前在低分辨率地图上进行由粗到细的相关性搜索 作为爬山的初始位姿 里程计误差比较大的时候不容易陷入局部最优 可以使用更少的粒子
+- @b "~/correlativeLinearWindow" @b [double] 相关性搜索的平移窗口的半径 (default: 0 不搜索)
+- @b "~/correlativeAngularWindow" @b [double] 相关性搜索的角度窗口的半径 (default: 0 不搜索)
+- @b "~/correlativeAngularStep" @b [double] 相关性搜索的角度步长 (default: 0.02)
+- @b "~/lowResolutionRatio" @b [int] 低分辨率地图的分辨率是delta的多少倍 (default: 4)
 
 scan-matching的过程中的初始的搜索步长和迭代次数
 - @b "~/lstep" @b [double] initial search step for scan matching (linear)
@@ -118,6 +129,16 @@ Others:
 - @b "~/resampleThreshold" @b [double] threshold at which the particles get resampled. Higher means more frequent resampling.
 - @b "~/particles" @b [int] (fixed) number of particles. Each particle represents a possible trajectory that the robot has traveled
 
+KLD-sampling 根据粒子分布占据的位姿直方图的bin的数量调整粒子数 定位好的时候粒子数减少 粒子分散的时候增加
+- @b "~/minParticles" @b [int] 最少的粒子数 (default: 10)
+- @b "~/maxParticles" @b [int] 最多的粒子数 (default: 0 粒子数固定为particles)
+- @b "~/kldEpsilon" @b [double] 粒子分布和真实分布之间KL距离的上界 越小粒子越多 (default: 0.25)
+- @b "~/kldZ" @b [double] 标准正态分布的1-delta分位数 (default: 2.33 即delta=0.01)
+- @b "~/kldLinearBin" @b [double] 直方图的bin的边长 (default: 0.5)
+- @b "~/kldAngularBin" @b [double] 直方图的bin的角度 (default: 0.2)
+
+- @b "~/maxTreeDepth" @b [int] 每个粒子的轨迹最多保留的节点数 更老的节点和激光数据被释放 长时间运行的时候内存不再增长 可视化地图中被剪掉的部分单独保存 (default: 0 保留整条轨迹)
+
 Likelihood sampling (used in scan matching)
 - @b "~/llsamplerange" @b [double] linear range
 - @b "~/lasamplerange" @b [double] linear step size
@@ -139,8 +160,12 @@ Initial map dimensions and resolution:
 #include "slam_gmapping.h"
 
 #include <iostream>
+#include <algorithm>
 
 #include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 #include "ros/ros.h"
 #include "ros/console.h"
@@ -200,6 +225,19 @@ void SlamGMapping::init()
 
     got_first_scan_ = false;
     got_map_ = false;
+    smap_ = NULL;
+    smap_pruned_ = NULL;
+    smap_base_ = 0;
+
+    scans_received_ = 0;
+    scans_dropped_ = 0;
+    scan_queue_max_depth_ = 0;
+    map_snapshot_pending_ = false;
+    map_snapshots_skipped_ = 0;
+    threads_stop_ = false;
+    filter_thread_ = NULL;
+    map_thread_ = NULL;
+    last_map_update_ = ros::Time(0,0);
 
 
 
@@ -226,6 +264,18 @@ void SlamGMapping::init()
         tmp = 5.0;
     map_update_interval_.fromSec(tmp);
 
+    //增量建图的检查点
+    if(!private_nh_.getParam("map_checkpoint_interval", map_checkpoint_interval_))
+        map_checkpoint_interval_ = 50;
+    if(!private_nh_.getParam("map_max_checkpoints", map_max_checkpoints_))
+        map_max_checkpoints_ = 10;
+
+    //激光数据队列和建图线程
+    if(!private_nh_.getParam("scan_queue_size", scan_queue_size_))
+        scan_queue_size_ = 5;
+    if(!private_nh_.getParam("map_thread_nice", map_thread_nice_))
+        map_thread_nice_ = 10;
+
     // Parameters used by GMapping itself     GMapping算法本身使用的参数
     maxUrange_ = 0.0;  maxRange_ = 0.0; // preliminary default, will be set in initMapper()
     if(!private_nh_.getParam("minimumScore", minimum_score_))
@@ -246,6 +296,16 @@ void SlamGMapping::init()
         ogain_ = 3.0;
     if(!private_nh_.getParam("lskip", lskip_))
         lskip_ = 0;
+    if(!private_nh_.getParam("useLikelihoodField", use_likelihood_field_))
+        use_likelihood_field_ = false;
+    if(!private_nh_.getParam("correlativeLinearWindow", correlative_linear_window_))
+        correlative_linear_window_ = 0.0;
+    if(!private_nh_.getParam("correlativeAngularWindow", correlative_angular_window_))
+        correlative_angular_window_ = 0.0;
+    if(!private_nh_.getParam("correlativeAngularStep", correlative_angular_step_))
+        correlative_angular_step_ = 0.02;
+    if(!private_nh_.getParam("lowResolutionRatio", low_resolution_ratio_))
+        low_resolution_ratio_ = 4;
     if(!private_nh_.getParam("srr", srr_))
         srr_ = 0.1;
     if(!private_nh_.getParam("srt", srt_))
@@ -264,6 +324,20 @@ void SlamGMapping::init()
         resampleThreshold_ = 0.5;
     if(!private_nh_.getParam("particles", particles_))
         particles_ = 30;
+    if(!private_nh_.getParam("minParticles", min_particles_))
+        min_particles_ = 10;
+    if(!private_nh_.getParam("maxParticles", max_particles_))
+        max_particles_ = 0;
+    if(!private_nh_.getParam("kldEpsilon", kld_epsilon_))
+        kld_epsilon_ = 0.25;
+    if(!private_nh_.getParam("kldZ", kld_z_))
+        kld_z_ = 2.33;
+    if(!private_nh_.getParam("kldLinearBin", kld_linear_bin_))
+        kld_linear_bin_ = 0.5;
+    if(!private_nh_.getParam("kldAngularBin", kld_angular_bin_))
+        kld_angular_bin_ = 0.2;
+    if(!private_nh_.getParam("maxTreeDepth", max_tree_depth_))
+        max_tree_depth_ = 0;
     if(!private_nh_.getParam("xmin", xmin_))
         xmin_ = -100.0;
     if(!private_nh_.getParam("ymin", ymin_))
@@ -298,6 +372,13 @@ void SlamGMapping::startLiveSlam()
     sstm_ = node_.advertise<nav_msgs::MapMetaData>("map_metadata", 1, true);
     ss_ = node_.advertiseService("dynamic_map", &SlamGMapping::mapCallback, this);
 
+    /*处理激光数据的滤波线程和生成可视化地图的建图线程*/
+    if(scan_queue_size_ > 0)
+    {
+        filter_thread_ = new boost::thread(boost::bind(&SlamGMapping::filterLoop, this));
+        map_thread_ = new boost::thread(boost::bind(&SlamGMapping::mapLoop, this));
+    }
+
     {
         //订阅激光数据 同时和odom_frame之间的转换同步
         scan_filter_sub_ = new message_filters::Subscriber<sensor_msgs::LaserScan>(node_, "scan", 5);
@@ -402,6 +483,32 @@ void SlamGMapping::publishLoop(double transform_publish_period)
 /*析构函数*/
 SlamGMapping::~SlamGMapping()
 {
+    //先停止滤波线程 再停止建图线程
+    {
+        boost::mutex::scoped_lock queue_lock(scan_queue_mutex_);
+        boost::mutex::scoped_lock snapshot_lock(map_snapshot_mutex_);
+        threads_stop_ = true;
+    }
+    scan_queue_cond_.notify_all();
+    map_snapshot_cond_.notify_all();
+    if(filter_thread_)
+    {
+        filter_thread_->join();
+        delete filter_thread_;
+    }
+    if(map_thread_)
+    {
+        map_thread_->join();
+        delete map_thread_;
+    }
+    //订阅还没有取消 laserCallback()可能还在往队列里面放数据
+    {
+        boost::mutex::scoped_lock queue_lock(scan_queue_mutex_);
+        if(scans_received_)
+            ROS_INFO("scan queue: %lu scans received, %lu dropped, max depth %zu, %lu map snapshots skipped",
+                     scans_received_, scans_dropped_, scan_queue_max_depth_, map_snapshots_skipped_);
+    }
+
     if(transform_thread_)
     {
         transform_thread_->join();
@@ -409,6 +516,10 @@ SlamGMapping::~SlamGMapping()
     }
 
     delete gsp_;
+    if(smap_)
+        delete smap_;
+    if(smap_pruned_)
+        delete smap_pruned_;
     if(gsp_laser_)
         delete gsp_laser_;
     if(gsp_odom_)
@@ -600,6 +711,18 @@ bool SlamGMapping::initMapper(const sensor_msgs::LaserScan& scan)
     gsp_->setUpdateDistances(linearUpdate_, angularUpdate_, resampleThreshold_);
     gsp_->setUpdatePeriod(temporalUpdate_);
     gsp_->setgenerateMap(false);
+    gsp_->setuseLikelihoodField(use_likelihood_field_);
+    gsp_->setcorrelativeLinearWindow(correlative_linear_window_);
+    gsp_->setcorrelativeAngularWindow(correlative_angular_window_);
+    gsp_->setcorrelativeAngularStep(correlative_angular_step_);
+    gsp_->setlowResolutionRatio(low_resolution_ratio_);
+    gsp_->setminParticles(min_particles_);
+    gsp_->setmaxParticles(max_particles_);
+    gsp_->setkldEpsilon(kld_epsilon_);
+    gsp_->setkldZ(kld_z_);
+    gsp_->setkldLinearBin(kld_linear_bin_);
+    gsp_->setkldAngularBin(kld_angular_bin_);
+    gsp_->setmaxTreeDepth(max_tree_depth_ > 0 ? max_tree_depth_ : 0);
     gsp_->GridSlamProcessor::init(particles_, xmin_, ymin_, xmax_, ymax_,
                                   delta_, initialPose);
 
@@ -688,12 +811,13 @@ bool SlamGMapping::addScan(const sensor_msgs::LaserScan& scan, GMapping::Oriente
 }
 
 /*
- * 接受到激光雷达数据的回调函数 在这里面调用addScan()函数
- * 如果addScan()函数调用成功，也就是说激光数据被成功的插入到地图中后，
- * 如果到了地图更新的时间，则对地图进行更新，通过调用updateMap()函数来进行相应的操作。
+ * 接受到激光雷达数据的回调函数
+ * 有滤波线程的时候只把激光数据放进有界的队列 由滤波线程调用processScan()
+ * 这样建图和地图服务都不会阻塞激光数据的接收
+ * 没有滤波线程的时候(回放bag或者scan_queue_size为0) 直接调用processScan()
  *
- * laserCallback()->addScan()->gmapping::processScan()
- *                ->updateMap()
+ * laserCallback()->scan_queue_->filterLoop()->processScan()->addScan()->gmapping::processScan()
+ *                                                         ->map_snapshot_->mapLoop()->updateMap()
  *
 */
 void SlamGMapping::laserCallback(const sensor_msgs::LaserScan::ConstPtr& scan)
@@ -703,8 +827,67 @@ void SlamGMapping::laserCallback(const sensor_msgs::LaserScan::ConstPtr& scan)
     if ((laser_count_ % throttle_scans_) != 0)
         return;
 
-    static ros::Time last_map_update(0,0);
+    if(!filter_thread_)
+    {
+        processScan(scan);
+        return;
+    }
 
+    bool dropped = false;
+    size_t depth;
+    unsigned long received, dropped_total;
+    {
+        boost::mutex::scoped_lock lock(scan_queue_mutex_);
+        //队列满了 丢掉最老的一帧
+        if((int)scan_queue_.size() >= scan_queue_size_)
+        {
+            scan_queue_.pop_front();
+            scans_dropped_++;
+            dropped = true;
+        }
+        scan_queue_.push_back(scan);
+        scans_received_++;
+        depth = scan_queue_.size();
+        if(depth > scan_queue_max_depth_)
+            scan_queue_max_depth_ = depth;
+        received = scans_received_;
+        dropped_total = scans_dropped_;
+    }
+    scan_queue_cond_.notify_one();
+
+    if(dropped)
+        ROS_WARN_THROTTLE(5.0, "scan queue is full, %lu of %lu scans dropped", dropped_total, received);
+    ROS_DEBUG("scan queue depth %zu", depth);
+}
+
+/*滤波线程 从队列中取出激光数据进行处理*/
+void SlamGMapping::filterLoop()
+{
+    while(true)
+    {
+        sensor_msgs::LaserScan::ConstPtr scan;
+        {
+            boost::mutex::scoped_lock lock(scan_queue_mutex_);
+            while(scan_queue_.empty() && !threads_stop_)
+                scan_queue_cond_.wait(lock);
+            if(threads_stop_)
+                return;
+            scan = scan_queue_.front();
+            scan_queue_.pop_front();
+        }
+        processScan(scan);
+    }
+}
+
+/*
+ * 处理一帧激光数据 调用addScan()函数
+ * 如果addScan()函数调用成功，也就是说激光数据被成功的插入到地图中后，
+ * 如果到了地图更新的时间，则取出最优粒子的快照交给建图线程，
+ * 没有建图线程的时候直接调用updateMap()。
+ * 只在一个线程中被调用 gsp_只在这个函数中被访问
+*/
+void SlamGMapping::processScan(const sensor_msgs::LaserScan::ConstPtr& scan)
+{
     // We can't initialize the mapper until we've got the first scan
     if(!got_first_scan_)
     {
@@ -730,19 +913,82 @@ void SlamGMapping::laserCallback(const sensor_msgs::LaserScan::ConstPtr& scan)
         map_to_odom_ = (odom_to_laser * laser_to_map).inverse();
         map_to_odom_mutex_.unlock();
 
-        /*如果没有地图那肯定需要直接更新，如果有地图了则需要到时间了，才更新地图了*/
-        if(!got_map_ || (scan->header.stamp - last_map_update) > map_update_interval_)
+        /*第一次肯定需要直接更新，之后到时间了才更新地图*/
+        if(last_map_update_.isZero() || (scan->header.stamp - last_map_update_) > map_update_interval_)
         {
-            /*多久更新一次地图*/
-            updateMap(*scan);
-            last_map_update = scan->header.stamp;
-            ROS_DEBUG("Updated the map");
+            MapSnapshot snapshot;
+            takeMapSnapshot(snapshot);
+            if(map_thread_)
+            {
+                //建图线程还没有处理上一个快照 直接替换掉
+                {
+                    boost::mutex::scoped_lock lock(map_snapshot_mutex_);
+                    if(map_snapshot_pending_)
+                        map_snapshots_skipped_++;
+                    map_snapshot_.swap(snapshot);
+                    map_snapshot_pending_ = true;
+                }
+                map_snapshot_cond_.notify_one();
+            }
+            else
+                updateMap(snapshot);
+            last_map_update_ = scan->header.stamp;
+            ROS_DEBUG("Requested a map update");
         }
     }
     else
         ROS_DEBUG("cannot process scan");
 }
 
+/*取出最优粒子的轨迹 激光数据只增加引用计数 不拷贝*/
+void SlamGMapping::takeMapSnapshot(MapSnapshot& snapshot)
+{
+    const GMapping::GridSlamProcessor::Particle& best =
+            gsp_->getParticles()[gsp_->getBestParticleIndex()];
+
+    snapshot.nodes.clear();
+    snapshot.poses.clear();
+    snapshot.readings.clear();
+    for(GMapping::GridSlamProcessor::TNode* n = best.node;n;n = n->parent)
+    {
+        snapshot.nodes.push_back(n);
+        snapshot.poses.push_back(n->pose);
+        snapshot.readings.push_back(n->reading);
+    }
+    std::reverse(snapshot.nodes.begin(), snapshot.nodes.end());
+    std::reverse(snapshot.poses.begin(), snapshot.poses.end());
+    std::reverse(snapshot.readings.begin(), snapshot.readings.end());
+
+    snapshot.pruned = gsp_->getprunedDepth();
+    snapshot.entropy = computePoseEntropy();
+}
+
+/*建图线程 以较低的优先级处理最新的快照*/
+void SlamGMapping::mapLoop()
+{
+    //在linux上setpriority()对线程id设置的是这个线程的nice值
+    if(map_thread_nice_ != 0 && setpriority(PRIO_PROCESS, syscall(SYS_gettid), map_thread_nice_) != 0)
+        ROS_WARN("failed to set the nice value of the map thread to %d", map_thread_nice_);
+
+    MapSnapshot snapshot;
+    unsigned long skipped;
+    while(true)
+    {
+        {
+            boost::mutex::scoped_lock lock(map_snapshot_mutex_);
+            while(!map_snapshot_pending_ && !threads_stop_)
+                map_snapshot_cond_.wait(lock);
+            if(threads_stop_)
+                return;
+            snapshot.swap(map_snapshot_);
+            map_snapshot_pending_ = false;
+            skipped = map_snapshots_skipped_;
+        }
+        updateMap(snapshot);
+        ROS_DEBUG("Updated the map, %lu map snapshots skipped", skipped);
+    }
+}
+
 /*计算位姿的信息熵*/
 double SlamGMapping::computePoseEntropy()
 {
@@ -770,80 +1016,136 @@ double SlamGMapping::computePoseEntropy()
 
 得到权值最大的粒子，然后遍历这个粒子的整个轨迹，根据轨迹上记录的信息来进行建图
 然后把得到的地图发布出去
-这个函数被laserCallback()调用，每次addScan()成功了，就会调用这个函数来生成地图，并发布出去
+这个函数在建图线程中被调用，处理的是processScan()取出来的最优粒子的快照，不访问gsp_
+smap_和检查点只在这个函数中被访问，只有最后把栅格交给map_的时候才需要锁住map_mutex_
 
+地图是增量维护的:
+最优粒子的轨迹和上次建图时的轨迹相同，则只插入新增的节点；
+轨迹发生了变化，则回到分叉点之前最近的检查点，只从检查点开始重新插入。
+因此每次更新的计算量和新增的节点数量有关，和轨迹的总长度无关。
 */
-void SlamGMapping::updateMap(const sensor_msgs::LaserScan& scan)
+void SlamGMapping::updateMap(const MapSnapshot& snapshot)
 {
     ROS_DEBUG("Update map");
-    boost::mutex::scoped_lock map_lock (map_mutex_);
     GMapping::ScanMatcher matcher;
 
     /*设置scanmatcher的各个参数*/
-    matcher.setLaserParameters(scan.ranges.size(), &(laser_angles_[0]),
+    matcher.setLaserParameters(laser_angles_.size(), &(laser_angles_[0]),
             gsp_laser_->getPose());
 
     matcher.setlaserMaxRange(maxRange_);
     matcher.setusableRange(maxUrange_);
     matcher.setgenerateMap(true);
 
-    /*得到权值最高的粒子*/
-    GMapping::GridSlamProcessor::Particle best =
-            gsp_->getParticles()[gsp_->getBestParticleIndex()];
-
     //发布位姿的熵
     std_msgs::Float64 entropy;
-    entropy.data = computePoseEntropy();
+    entropy.data = snapshot.entropy;
     if(entropy.data > 0.0)
         entropy_publisher_.publish(entropy);
 
+    /*最优粒子的轨迹 从根节点到叶子节点*/
+    const std::vector<GMapping::GridSlamProcessor::TNode*>& trajectory = snapshot.nodes;
 
-    //如果没有地图 则初始化一个地图
-    if(!got_map_)
+    //轨迹树被剪过之后 trajectory[0]到原来的根节点的深度为pruned
+    //被剪掉的节点从smap_nodes_中去掉 插入到剪枝边界上的地图smap_pruned_中
+    //这些节点不一定被所有的粒子共享 以后最优粒子换到别的分支的时候从smap_pruned_开始重新插入
+    size_t pruned = snapshot.pruned;
+    while(smap_base_ < pruned && !smap_nodes_.empty())
     {
-        map_.map.info.resolution = delta_;
-        map_.map.info.origin.position.x = 0.0;
-        map_.map.info.origin.position.y = 0.0;
-        map_.map.info.origin.position.z = 0.0;
-        map_.map.info.origin.orientation.x = 0.0;
-        map_.map.info.origin.orientation.y = 0.0;
-        map_.map.info.origin.orientation.z = 0.0;
-        map_.map.info.origin.orientation.w = 1.0;
+        if(!smap_pruned_)
+            smap_pruned_ = newMap();
+        if(smap_nodes_.front().reading)
+        {
+            matcher.invalidateActiveArea();
+            matcher.registerScan(*smap_pruned_, smap_nodes_.front().pose, &(smap_nodes_.front().reading->m_dists[0]));
+        }
+        smap_nodes_.pop_front();
+        smap_base_++;
     }
+    if(smap_base_ < pruned)
+    {
+        ROS_WARN("%zu trajectory nodes were pruned before being inserted into the map, increase maxTreeDepth",
+                 pruned - smap_base_);
+        smap_base_ = pruned;
+    }
+    while(!map_checkpoints_.empty() && map_checkpoints_.front().depth < pruned)
+        map_checkpoints_.pop_front();
+
+    //和已经插入地图的轨迹比较 找到分叉的位置
+    //同一深度的节点是在同一次重采样中创建的 因此地址相同就是同一个节点
+    size_t common = 0;
+    while(common < smap_nodes_.size() && common < trajectory.size() &&
+          smap_nodes_[common].node == trajectory[common])
+        common++;
+
+    //轨迹发生了变化 回退到分叉点之前最近的检查点
+    //没有检查点的时候回退到剪枝边界上的smap_pruned_ 没有剪过的时候从头开始
+    if(common < smap_nodes_.size())
+    {
+        while(!map_checkpoints_.empty() && map_checkpoints_.back().depth > pruned + common)
+            map_checkpoints_.pop_back();
 
-    /*地图的中点*/
-    GMapping::Point center;
-    center.x=(xmin_ + xmax_) / 2.0;
-    center.y=(ymin_ + ymax_) / 2.0;
+        delete smap_;
+        smap_nodes_.clear();
+        size_t restored = 0;
+        if(!map_checkpoints_.empty())
+        {
+            smap_ = new GMapping::ScanMatcherMap(map_checkpoints_.back().map);
+            restored = map_checkpoints_.back().depth - pruned;
+        }
+        else if(smap_pruned_)
+            smap_ = new GMapping::ScanMatcherMap(*smap_pruned_);
+        else
+            smap_ = NULL;
+        for(size_t i = 0; i < restored; i++)
+            smap_nodes_.push_back(MapNode(trajectory[i], snapshot.poses[i], snapshot.readings[i]));
+        ROS_DEBUG("best particle changed at node %zu, replay from node %zu", pruned + common, pruned + smap_nodes_.size());
+    }
 
     /*初始化一个scanmatcherMap 创建一个地图*/
-    GMapping::ScanMatcherMap smap(center, xmin_, ymin_, xmax_, ymax_,
-                                  delta_);
+    if(!smap_)
+        smap_ = newMap();
+    GMapping::ScanMatcherMap& smap = *smap_;
 
     /*更新地图*/
-    //遍历粒子的整条轨迹 按照轨迹上各个节点存储的信息来重新计算一个地图
-    ROS_DEBUG("Trajectory tree:");
-    for(GMapping::GridSlamProcessor::TNode* n = best.node;n;n = n->parent)
+    //只插入还没有插入地图的节点
+    ROS_DEBUG("Trajectory tree: %zu nodes, %zu new", trajectory.size(), trajectory.size() - smap_nodes_.size());
+    for(size_t i = smap_nodes_.size(); i < trajectory.size(); i++)
     {
+        const GMapping::OrientedPoint& pose = snapshot.poses[i];
+        const GMapping::readingptr& reading = snapshot.readings[i];
         ROS_DEBUG("  %.3f %.3f %.3f",
-                  n->pose.x,
-                  n->pose.y,
-                  n->pose.theta);
-        if(!n->reading)
+                  pose.x,
+                  pose.y,
+                  pose.theta);
+        smap_nodes_.push_back(MapNode(trajectory[i], pose, reading));
+
+        if(!reading)
         {
             ROS_DEBUG("Reading is NULL");
-            continue;
         }
-        //进行地图更新
-        //matcher.invalidateActiveArea();
-        //matcher.computeActiveArea(smap, n->pose, &((*n->reading)[0]));
-        //matcher.registerScan(smap, n->pose, &((*n->reading)[0]));
-        matcher.registerScan(smap, n->pose, &(n->reading->m_dists[0]));
+        else
+        {
+            //进行地图更新
+            //每次都重新计算activeArea 被修改的patch会被复制 检查点中的地图不会被改变
+            matcher.invalidateActiveArea();
+            matcher.registerScan(smap, pose, &(reading->m_dists[0]));
+        }
+
+        //保存检查点 只保留最近的几个
+        if(map_checkpoint_interval_ > 0 && (smap_base_ + smap_nodes_.size()) % map_checkpoint_interval_ == 0)
+        {
+            map_checkpoints_.push_back(MapCheckpoint(smap_base_ + smap_nodes_.size(), smap));
+            if((int)map_checkpoints_.size() > map_max_checkpoints_)
+                map_checkpoints_.pop_front();
+        }
     }
 
     // the map may have expanded, so resize ros message as well
     // 扩充地图的大小
-    if(map_.map.info.width != (unsigned int) smap.getMapSizeX() || map_.map.info.height != (unsigned int) smap.getMapSizeY())
+    unsigned int width = smap.getMapSizeX(), height = smap.getMapSizeY();
+    bool resized = !got_map_ || map_.map.info.width != width || map_.map.info.height != height;
+    if(resized)
     {
 
         // NOTE: The results of ScanMatcherMap::getSize() are different from the parameters given to the constructor
@@ -855,18 +1157,14 @@ void SlamGMapping::updateMap(const sensor_msgs::LaserScan& scan)
 
         ROS_DEBUG("map size is now %dx%d pixels (%f,%f)-(%f, %f)", smap.getMapSizeX(), smap.getMapSizeY(),
                   xmin_, ymin_, xmax_, ymax_);
-
-        map_.map.info.width = smap.getMapSizeX();
-        map_.map.info.height = smap.getMapSizeY();
-        map_.map.info.origin.position.x = xmin_;
-        map_.map.info.origin.position.y = ymin_;
-        map_.map.data.resize(map_.map.info.width * map_.map.info.height);
-
-        ROS_DEBUG("map origin: (%f, %f)", map_.map.info.origin.position.x, map_.map.info.origin.position.y);
     }
+    map_data_.resize(width * height);
 
     //根据地图的信息计算出来各个点的情况:occ、free、noinformation
     //这样对地图进行标记主要是方便用RVIZ显示出来
+    //用const的方式访问 没有分配内存的patch不会被分配 smap_会一直保留
+    //先填充到map_data_中 这时候不需要锁住map_mutex_
+    const GMapping::ScanMatcherMap& csmap = smap;
     for(int x=0; x < smap.getMapSizeX(); x++)
     {
         for(int y=0; y < smap.getMapSizeY(); y++)
@@ -874,26 +1172,50 @@ void SlamGMapping::updateMap(const sensor_msgs::LaserScan& scan)
             /// @todo Sort out the unknown vs. free vs. obstacle thresholding
             /// 得到.xy被占用的概率
             GMapping::IntPoint p(x, y);
-            double occ=smap.cell(p);
+            double occ=csmap.cell(p);
             assert(occ <= 1.0);
 
             //unknown
             if(occ < 0)
-                map_.map.data[MAP_IDX(map_.map.info.width, x, y)] = GMAPPING_UNKNOWN;
+                map_data_[MAP_IDX(width, x, y)] = GMAPPING_UNKNOWN;
 
             //占用
             else if(occ > occ_thresh_)
             {
-                //map_.map.data[MAP_IDX(map_.map.info.width, x, y)] = (int)round(occ*100.0);
-                map_.map.data[MAP_IDX(map_.map.info.width, x, y)] = GMAPPING_OCC;
+                //map_data_[MAP_IDX(width, x, y)] = (int)round(occ*100.0);
+                map_data_[MAP_IDX(width, x, y)] = GMAPPING_OCC;
             }
 
             //freespace
             else
-                map_.map.data[MAP_IDX(map_.map.info.width, x, y)] = GMAPPING_FREE;
+                map_data_[MAP_IDX(width, x, y)] = GMAPPING_FREE;
         }
     }
 
+    //把填充好的栅格和map_交换 mapCallback()只需要等待这一小段
+    boost::mutex::scoped_lock map_lock (map_mutex_);
+
+    //如果没有地图 则初始化一个地图
+    if(!got_map_)
+    {
+        map_.map.info.resolution = delta_;
+        map_.map.info.origin.position.z = 0.0;
+        map_.map.info.origin.orientation.x = 0.0;
+        map_.map.info.origin.orientation.y = 0.0;
+        map_.map.info.origin.orientation.z = 0.0;
+        map_.map.info.origin.orientation.w = 1.0;
+    }
+    if(resized)
+    {
+        map_.map.info.width = width;
+        map_.map.info.height = height;
+        map_.map.info.origin.position.x = xmin_;
+        map_.map.info.origin.position.y = ymin_;
+
+        ROS_DEBUG("map origin: (%f, %f)", map_.map.info.origin.position.x, map_.map.info.origin.position.y);
+    }
+    map_.map.data.swap(map_data_);
+
     //到了这一步，肯定是有地图了。
     got_map_ = true;
 
@@ -907,6 +1229,18 @@ void SlamGMapping::updateMap(const sensor_msgs::LaserScan& scan)
 }
 
 
+/*创建一个空的地图 大小为初始化的时候设置的大小或者现在的地图的大小*/
+GMapping::ScanMatcherMap* SlamGMapping::newMap() const
+{
+    /*地图的中点*/
+    GMapping::Point center;
+    center.x=(xmin_ + xmax_) / 2.0;
+    center.y=(ymin_ + ymax_) / 2.0;
+
+    return new GMapping::ScanMatcherMap(center, xmin_, ymin_, xmax_, ymax_,
+                                        delta_);
+}
+
 /*
  * 地图服务的回调函数
  * 别的函数可以向gmapping请求地图。
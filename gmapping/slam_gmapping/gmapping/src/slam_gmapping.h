@@ -29,6 +29,8 @@
 #include "../../openslam_gmapping/include/gmapping/sensor/sensor_base/sensor.h"
 
 #include <boost/thread.hpp>
+#include <deque>
+#include <algorithm>
 #include <visualization_msgs/Marker.h>
 
 
@@ -84,6 +86,39 @@ class SlamGMapping
     bool got_map_;
     nav_msgs::GetMap::Response map_;
 
+    /*
+     * 增量维护的最优粒子的地图
+     * smap_nodes_是已经插入到smap_中的轨迹节点 从根节点开始排列
+     * 轨迹树被剪过的时候 smap_nodes_[i]到原来的根节点的深度为smap_base_+i
+     * 最优粒子的轨迹没有变化的时候只需要插入新的节点，
+     * 轨迹变化了则从分叉点之前最近的检查点开始重新插入。
+     *
+     * 被剪掉的节点不一定已经被所有的粒子共享 最优粒子可能换到一个在剪枝边界之前就分叉的分支上
+     * 因此smap_nodes_中被剪掉的节点会插入到smap_pruned_中 它就是剪枝边界(深度smap_base_)上的检查点
+     * 找不到更新的检查点的时候从smap_pruned_开始插入新的分支保留下来的所有节点 不会把两个分支插入到同一个地图中
+     */
+    struct MapNode
+    {
+      MapNode(GMapping::GridSlamProcessor::TNode* n, const GMapping::OrientedPoint& p, const GMapping::readingptr& r):
+        node(n), pose(p), reading(r) {}
+      GMapping::GridSlamProcessor::TNode* node;   //只用来比较是不是同一个节点 不会被访问
+      GMapping::OrientedPoint pose;
+      GMapping::readingptr reading;               //节点被剪掉的时候要插入到smap_pruned_中
+    };
+    struct MapCheckpoint
+    {
+      MapCheckpoint(size_t d, const GMapping::ScanMatcherMap& m): depth(d), map(m) {}
+      size_t depth;                       //检查点包含的节点数量 从原来的根节点开始算
+      GMapping::ScanMatcherMap map;       //和smap_共享patch 只有被修改的patch会被复制
+    };
+    GMapping::ScanMatcherMap* smap_;
+    GMapping::ScanMatcherMap* smap_pruned_;
+    std::deque<MapNode> smap_nodes_;
+    size_t smap_base_;
+    std::deque<MapCheckpoint> map_checkpoints_;
+    int map_checkpoint_interval_;
+    int map_max_checkpoints_;
+
     ros::Duration map_update_interval_;
     tf::Transform map_to_odom_;
     boost::mutex map_to_odom_mutex_;
@@ -99,7 +134,65 @@ class SlamGMapping
     std::string map_frame_;
     std::string odom_frame_;
 
-    void updateMap(const sensor_msgs::LaserScan& scan);
+    /*
+     * 可视化地图的快照
+     * 滤波线程在addScan()之后从最优粒子中取出来 交给建图线程
+     * 激光数据是引用计数共享的 节点的指针只用来和smap_nodes_比较是不是同一个节点 不会被访问
+     * 这样建图线程不需要访问gsp_ 也不需要在建图的时候锁住滤波器
+     */
+    struct MapSnapshot
+    {
+      std::vector<GMapping::GridSlamProcessor::TNode*> nodes;   //从根节点到叶子节点
+      std::vector<GMapping::OrientedPoint> poses;
+      std::vector<GMapping::readingptr> readings;
+      size_t pruned;                                            //nodes[0]到原来的根节点的深度
+      double entropy;
+
+      void swap(MapSnapshot& other)
+      {
+        nodes.swap(other.nodes);
+        poses.swap(other.poses);
+        readings.swap(other.readings);
+        std::swap(pruned, other.pruned);
+        std::swap(entropy, other.entropy);
+      }
+    };
+
+    /*
+     * 有界的激光数据队列
+     * laserCallback()只把激光数据放进队列 滤波线程从队列中取出来调用processScan()
+     * 队列满了的时候丢掉最老的一帧
+     */
+    std::deque<sensor_msgs::LaserScan::ConstPtr> scan_queue_;
+    boost::mutex scan_queue_mutex_;
+    boost::condition_variable scan_queue_cond_;
+    int scan_queue_size_;
+    unsigned long scans_received_;          //进入队列的激光数据的数量
+    unsigned long scans_dropped_;           //因为队列满了被丢掉的激光数据的数量
+    size_t scan_queue_max_depth_;           //队列深度的最大值
+
+    /*建图线程 只处理最新的快照 还没来得及处理的快照会被新的快照替换*/
+    MapSnapshot map_snapshot_;
+    bool map_snapshot_pending_;
+    boost::mutex map_snapshot_mutex_;
+    boost::condition_variable map_snapshot_cond_;
+    int map_thread_nice_;
+    unsigned long map_snapshots_skipped_;   //被新的快照替换掉的快照的数量
+
+    bool threads_stop_;
+    boost::thread* filter_thread_;
+    boost::thread* map_thread_;
+    ros::Time last_map_update_;
+
+    //建图线程填充的栅格 填充完之后和map_.map.data交换 mapCallback()不需要等待建图
+    std::vector<int8_t> map_data_;
+
+    void filterLoop();
+    void mapLoop();
+    void processScan(const sensor_msgs::LaserScan::ConstPtr& scan);
+    void takeMapSnapshot(MapSnapshot& snapshot);
+    void updateMap(const MapSnapshot& snapshot);
+    GMapping::ScanMatcherMap* newMap() const;
     bool getOdomPose(GMapping::OrientedPoint& gmap_pose, const ros::Time& t);
     bool getMapPose(GMapping::OrientedPoint& gmap_pose, const ros::Time& t);
     bool initMapper(const sensor_msgs::LaserScan& scan);
@@ -119,6 +212,11 @@ class SlamGMapping
     double lsigma_;
     double ogain_;
     int lskip_;
+    bool use_likelihood_field_;
+    double correlative_linear_window_;
+    double correlative_angular_window_;
+    double correlative_angular_step_;
+    int low_resolution_ratio_;
     double srr_;
     double srt_;
     double str_;
@@ -128,6 +226,13 @@ class SlamGMapping
     double temporalUpdate_;
     double resampleThreshold_;
     int particles_;
+    int max_tree_depth_;
+    int min_particles_;
+    int max_particles_;
+    double kld_epsilon_;
+    double kld_z_;
+    double kld_linear_bin_;
+    double kld_angular_bin_;
     double xmin_;
     double ymin_;
     double xmax_;
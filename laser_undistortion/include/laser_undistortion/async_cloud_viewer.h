@@ -0,0 +1,49 @@
+#ifndef ASYNC_CLOUD_VIEWER_H
+#define ASYNC_CLOUD_VIEWER_H
+
+#include <deque>
+#include <string>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+/*
+ * 在单独的线程中显示点云
+ * 激光回调函数只把点云放到一个有界队列中，队列满的时候丢掉最老的点云，
+ * 因此矫正的过程永远不会等待显示。
+ * pcl的CloudViewer在显示线程中构造，不使用可视化的时候不会创建窗口。
+ */
+class AsyncCloudViewer
+{
+public:
+    typedef pcl::PointCloud<pcl::PointXYZRGB> Cloud;
+
+    AsyncCloudViewer(const std::string& name, int max_queue = 2);
+    ~AsyncCloudViewer();
+
+    //把点云放入队列 不会阻塞
+    void showCloud(const Cloud::ConstPtr& cloud);
+
+    //因为队列满被丢掉的点云数量
+    unsigned long droppedNumber();
+
+private:
+    void run();
+
+    std::string name_;
+    int max_queue_;
+
+    boost::mutex mutex_;
+    boost::condition_variable cond_;
+    std::deque<Cloud::ConstPtr> queue_;
+    unsigned long dropped_;
+    bool stop_;
+
+    boost::thread thread_;
+};
+
+#endif
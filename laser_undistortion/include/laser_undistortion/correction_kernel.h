@@ -0,0 +1,42 @@
+#ifndef CORRECTION_KERNEL_H
+#define CORRECTION_KERNEL_H
+
+/*
+ * 激光点批量矫正的核函数 数据按SoA(每个量一个连续的float数组)存储
+ * 对第i束激光：
+ *   a = angles[i] + pose_theta[i]
+ *   (px,py) = ranges[i] * (cos(a),sin(a)) + (pose_x[i],pose_y[i])    极坐标->直角坐标 + 刚体变换
+ *   ranges[i] = sqrt(px*px + py*py), angles[i] = atan2(py,px)          直角坐标->极坐标
+ * ranges[i]==0的激光束认为是非法的，只把角度a归一化到[-pi,pi)。
+ *
+ * CorrectBeams()在CPU支持AVX2+FMA时一次处理8束激光，否则使用相同近似的标量版本。
+ * 其中的三角函数为多项式近似，相对于double精度结果的绝对误差(|x|<=64rad，在x86上实测)：
+ *   atan2(sin(x),cos(x))   < 4e-7 rad   (libm的sinf/cosf/atan2f为3e-7)
+ *   atan2(y,x)             < 4e-7 rad
+ * 和float版本的libm在同一个量级；20m处的激光点，位置误差小于1e-5m。
+ * CorrectBeamsReference()直接调用libm，用来做对比测试。
+ */
+
+/**
+ * 矫正n束激光 ranges和angles原地修改
+ * @param pose_x,pose_y,pose_theta 每束激光时刻激光雷达相对于基准坐标系的位姿
+ */
+void CorrectBeams(float* ranges,
+                  float* angles,
+                  const float* pose_x,
+                  const float* pose_y,
+                  const float* pose_theta,
+                  int n);
+
+//标量的参考实现 使用libm的sinf/cosf/atan2f
+void CorrectBeamsReference(float* ranges,
+                           float* angles,
+                           const float* pose_x,
+                           const float* pose_y,
+                           const float* pose_theta,
+                           int n);
+
+//CorrectBeams()是否使用了AVX2
+bool CorrectBeamsUseAvx2();
+
+#endif
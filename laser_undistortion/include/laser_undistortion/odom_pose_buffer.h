@@ -0,0 +1,92 @@
+#ifndef ODOM_POSE_BUFFER_H
+#define ODOM_POSE_BUFFER_H
+
+#include <vector>
+
+/*
+ * 一个里程计位姿 时间单位为秒
+ */
+struct OdomPose2D
+{
+    double t;
+    double x,y,theta;
+};
+
+/*
+ * 查询时间不在缓存覆盖范围内时的处理策略
+ * ODOM_MISSING_FAIL        直接返回失败，这帧激光不进行矫正
+ * ODOM_MISSING_HOLD        使用离查询时间最近的位姿(相当于认为机器人静止)
+ * ODOM_MISSING_EXTRAPOLATE 用最近两个位姿的速度进行匀速外推
+ * 后两种策略都只在max_gap时间范围内有效，超出之后同样返回失败
+ */
+enum OdomMissingPolicy
+{
+    ODOM_MISSING_FAIL = 0,
+    ODOM_MISSING_HOLD,
+    ODOM_MISSING_EXTRAPOLATE
+};
+
+/*
+ * 直接由odom话题填充的位姿环形缓冲区，用来代替tf的waitForTransform()
+ * 查询的时候在相邻的两个位姿之间做线性插值。
+ * 激光的查询时间基本上是单调递增的，因此会记录上一次查询所在的区间，
+ * 从这个区间开始向后查找，均摊下来每次查询为O(1)；时间倒退的时候使用二分查找。
+ * 不是线程安全的，添加和查询需要在同一个线程中(ros::spin())。
+ */
+class OdomPoseBuffer
+{
+public:
+    OdomPoseBuffer(int capacity = 1000);
+
+    void setCapacity(int capacity);
+    void setMissingPolicy(OdomMissingPolicy policy,double max_gap);
+
+    /**
+     * 添加一个位姿，时间必须单调递增，否则会被丢弃
+     * @return 是否添加成功
+     */
+    bool addPose(const OdomPose2D& pose);
+
+    /**
+     * 得到t时刻的位姿
+     * @param t     查询的时刻
+     * @param pose  插值得到的位姿
+     * @return      缓冲区中没有对应的数据并且策略不允许时返回false
+     */
+    bool lookup(double t,OdomPose2D& pose) const;
+
+    /**
+     * 得到[t0,t1]时间段内的位姿：t0和t1时刻的插值位姿，以及中间所有的原始位姿
+     * 用来构造一帧激光的连续轨迹
+     * @return t0或者t1时刻的位姿查询失败时返回false
+     */
+    bool samples(double t0,double t1,std::vector<OdomPose2D>& poses) const;
+
+    void clear();
+
+    int size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const OdomPose2D& oldest() const { return at(0); }
+    const OdomPose2D& newest() const { return at(size_ - 1); }
+
+private:
+    //逻辑下标i对应的位姿 i=0为最老的位姿
+    const OdomPose2D& at(int i) const { return buffer_[(head_ + i) % buffer_.size()]; }
+
+    //找到满足at(i).t <= t < at(i+1).t的i
+    int findSegment(double t) const;
+
+    static void interpolate(const OdomPose2D& a,const OdomPose2D& b,double t,OdomPose2D& pose);
+
+    std::vector<OdomPose2D> buffer_;
+    int head_;
+    int size_;
+
+    OdomMissingPolicy policy_;
+    double max_gap_;
+
+    //上一次查询所在的区间
+    mutable int hint_;
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef UNDISTORTION_CORE_H
+#define UNDISTORTION_CORE_H
+
+#include <vector>
+
+#include "laser_undistortion/odom_pose_buffer.h"
+
+/*
+ * 一帧激光时间内激光雷达的连续SE(2)轨迹
+ * 由这帧激光时间段内的若干个位姿(节点)构成，节点之间做分段线性插值。
+ * 所有的节点都转换到第一个节点(也就是这帧激光的基准坐标系)下，
+ * 相对位姿很小，因此可以用float存储和计算。
+ * 角度会被展开成连续的，插值的时候不需要再做归一化。
+ */
+class Se2Trajectory
+{
+public:
+    Se2Trajectory();
+
+    /**
+     * 构造轨迹
+     * @param knots 激光雷达在odom坐标系中的位姿，按时间排序，第一个位姿为基准位姿
+     * @return 节点少于一个返回false
+     */
+    bool build(const std::vector<OdomPose2D>& knots);
+
+    /**
+     * 计算等时间间隔的n个激光束对应的位姿(相对于基准位姿)
+     * 第i束激光的时间为 start_time + i * time_inc
+     * 每一个分段内的循环没有分支，可以被编译器向量化
+     */
+    void evaluate(double start_time,double time_inc,int n,
+                  float* x,float* y,float* theta) const;
+
+    const OdomPose2D& basePose() const { return base_; }
+    int knotNumber() const { return t_.size(); }
+
+private:
+    //基准位姿 odom坐标系
+    OdomPose2D base_;
+
+    //相对于base_的节点 时间也是相对于base_.t的
+    std::vector<float> t_,x_,y_,theta_;
+};
+
+
+/**
+ * 用连续轨迹对一帧激光进行运动畸变矫正，把每个激光点都转换到基准坐标系中
+ * 第i束激光的时间为 trajectory.basePose().t + i * time_inc
+ * 距离为0的激光束认为是非法的，只矫正角度
+ * @param trajectory    这帧激光的轨迹
+ * @param ranges        激光数据－－距离，原地修改
+ * @param angles        激光数据－－角度，原地修改
+ * @param n             激光束的数量
+ * @param time_inc      每束激光之间的时间间隔
+ */
+void UndistortScanContinuous(const Se2Trajectory& trajectory,
+                             float* ranges,
+                             float* angles,
+                             int n,
+                             double time_inc);
+
+#endif
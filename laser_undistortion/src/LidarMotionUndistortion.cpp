@@ -4,19 +4,22 @@
 #include <tf/transform_listener.h>
 
 #include <sensor_msgs/LaserScan.h>
+#include <nav_msgs/Odometry.h>
 
 #include <champion_nav_msgs/ChampionNavLaserScan.h>
 
 #include <pcl-1.7/pcl/point_cloud.h>
 #include <pcl/point_types.h>
-#include <pcl-1.7/pcl/visualization/cloud_viewer.h>
 
 #include <iostream>
+#include <algorithm>
 #include <dirent.h>
 #include <fstream>
 #include <iostream>
 
-pcl::visualization::CloudViewer g_PointCloudView("PointCloud View");
+#include "laser_undistortion/odom_pose_buffer.h"
+#include "laser_undistortion/undistortion_core.h"
+#include "laser_undistortion/async_cloud_viewer.h"
 
 class LidarMotionCalibrator
 {
@@ -25,112 +28,207 @@ public:
     LidarMotionCalibrator(tf::TransformListener* tf)
     {
         tf_ = tf;
+
+        ros::NodeHandle private_nh("~");
+
+        //使用odom话题填充的位姿缓冲区来代替tf查询 避免在回调函数中阻塞等待tf
+        private_nh.param("use_odom_buffer", use_odom_buffer_, true);
+
+        std::string odom_topic, missing_policy;
+        int buffer_size;
+        double max_gap;
+        private_nh.param("odom_topic", odom_topic, std::string("odom"));
+        private_nh.param("odom_buffer_size", buffer_size, 1000);
+        private_nh.param("missing_odom_policy", missing_policy, std::string("extrapolate"));
+        private_nh.param("max_odom_gap", max_gap, 0.05);
+
+        //segment: 原来的5ms分段插值  continuous: 每一束激光都由连续轨迹计算位姿
+        std::string mode;
+        private_nh.param("undistortion_mode", mode, std::string("continuous"));
+        use_continuous_ = (mode != "segment");
+
+        //消息中的激光束是否是时间倒序的(最后一束激光最先被测量)
+        private_nh.param("reversed_scan", reversed_scan_, true);
+
+        //pcl的可视化 默认关闭 打开时在单独的线程中显示
+        private_nh.param("visualize", visualize_, false);
+        int viewer_queue;
+        private_nh.param("visualize_queue_size", viewer_queue, 2);
+        viewer_ = NULL;
+        if(visualize_)
+            viewer_ = new AsyncCloudViewer("PointCloud View", viewer_queue);
+
+        OdomMissingPolicy policy = ODOM_MISSING_EXTRAPOLATE;
+        if(missing_policy == "fail")
+            policy = ODOM_MISSING_FAIL;
+        else if(missing_policy == "hold")
+            policy = ODOM_MISSING_HOLD;
+        else if(missing_policy != "extrapolate")
+            ROS_WARN("Unknown missing_odom_policy %s, use extrapolate", missing_policy.c_str());
+
+        odom_buffer_.setCapacity(buffer_size);
+        odom_buffer_.setMissingPolicy(policy, max_gap);
+        has_base_to_laser_ = false;
+
+        if(use_odom_buffer_)
+            odom_sub_ = nh_.subscribe(odom_topic, 100, &LidarMotionCalibrator::OdomCallBack, this);
+
+        scan_pub_ = nh_.advertise<champion_nav_msgs::ChampionNavLaserScan>("champion_scan_undistortion", 10);
         scan_sub_ = nh_.subscribe("champion_scan", 10, &LidarMotionCalibrator::ScanCallBack, this);
     }
 
 
     ~LidarMotionCalibrator()
     {
+        if(viewer_ != NULL)
+        {
+            //显示跟不上激光频率的时候点云会被丢掉
+            ROS_INFO("LidarMotion: viewer dropped %lu clouds", viewer_->droppedNumber());
+            delete viewer_;
+        }
         if(tf_!=NULL)
             delete tf_;
     }
 
+    // 里程计数据直接放到位姿缓冲区中
+    void OdomCallBack(const nav_msgs::OdometryConstPtr& odom_msg)
+    {
+        OdomPose2D pose;
+        pose.t = odom_msg->header.stamp.toSec();
+        pose.x = odom_msg->pose.pose.position.x;
+        pose.y = odom_msg->pose.pose.position.y;
+        pose.theta = tf::getYaw(odom_msg->pose.pose.orientation);
+
+        if(!odom_buffer_.addPose(pose))
+            ROS_WARN_THROTTLE(1.0, "LidarMotion: Odom stamp not increasing, drop it");
+
+        if(base_frame_.empty())
+            base_frame_ = odom_msg->child_frame_id;
+    }
+
     // 拿到原始的激光数据来进行处理
+    // 直接在消息的ranges/angles数组上原地矫正，然后把同一个消息发布出去，中间不做任何拷贝
     void ScanCallBack(const champion_nav_msgs::ChampionNavLaserScanPtr& scan_msg)
     {
         //转换到矫正需要的数据
         ros::Time startTime, endTime;
         startTime = scan_msg->header.stamp;
 
-        champion_nav_msgs::ChampionNavLaserScan laserScanMsg = *scan_msg;
+        std::vector<float>& ranges = scan_msg->ranges;
+        std::vector<float>& angles = scan_msg->angles;
 
         //得到最终点的时间
-        int beamNum = laserScanMsg.ranges.size();
-        endTime = startTime + ros::Duration(laserScanMsg.time_increment * beamNum);
-
-        // 将数据复制出来
-        std::vector<double> angles,ranges;
-        for(int i = beamNum - 1; i > 0;i--)
-        {   
-            double lidar_dist = laserScanMsg.ranges[i];
-            double lidar_angle = laserScanMsg.angles[i];
+        int beamNum = ranges.size();
+        if(beamNum == 0 || beamNum != angles.size())
+        {
+            ROS_ERROR("Error:ranges not match to the angles");
+            return ;
+        }
+        endTime = startTime + ros::Duration(scan_msg->time_increment * beamNum);
 
-            if(lidar_dist < 0.05 || std::isnan(lidar_dist) || std::isinf(lidar_dist))
-                lidar_dist = 0.0;
+        // 矫正时要求激光束按时间排序，消息中的激光束是时间倒序的，原地翻转
+        if(reversed_scan_)
+        {
+            std::reverse(ranges.begin(), ranges.end());
+            std::reverse(angles.begin(), angles.end());
+        }
 
-            ranges.push_back(lidar_dist);
-            angles.push_back(lidar_angle);
+        // 矫正的时候距离为0的激光束认为是非法的 只处理角度
+        // 非法的激光束先记下原来的距离再设置为0 矫正之后恢复 发布的消息中保留原来的NaN/inf/过近的距离
+        invalid_beams_.clear();
+        for(int i = 0; i < beamNum; i++)
+        {
+            if(ranges[i] < 0.05 || std::isnan(ranges[i]) || std::isinf(ranges[i]))
+            {
+                invalid_beams_.push_back(std::make_pair(i, ranges[i]));
+                ranges[i] = 0.0;
+            }
         }
 
         //转换为pcl::pointcloud for visuailization
-
+        //查询不到显示用的位姿的时候只是不显示这一帧 仍然矫正和发布
         tf::Stamped<tf::Pose> visualPose;
-        if(!getLaserPose(visualPose, startTime, tf_))
+        AsyncCloudViewer::Cloud::Ptr visual_cloud;
+        if(visualize_)
         {
-
-            ROS_WARN("Not visualPose,Can not Calib");
-            return ;
+            if(getLaserPose(visualPose, startTime, tf_))
+            {
+                //每帧都是新的点云 显示线程持有旧的点云时不会被修改
+                visual_cloud.reset(new AsyncCloudViewer::Cloud);
+                appendVisualCloud(*visual_cloud, ranges, angles, visualPose, 255, 0, 0);   //red color
+            }
+            else
+                ROS_WARN_THROTTLE(1.0, "LidarMotion: No visual pose, skip the cloud");
         }
 
-        double visualYaw = tf::getYaw(visualPose.getRotation());
-
-        visual_cloud_.clear();
-        for(int i = 0; i < ranges.size();i++)
+        //进行矫正
+        bool good;
+        if(use_continuous_)
         {
+            good = Lidar_ContinuousCalibration(ranges,angles,
+                                               startTime,
+                                               endTime,
+                                               tf_);
+        }
+        else
+        {
+            good = Lidar_Calibration(ranges,angles,
+                                     startTime,
+                                     endTime,
+                                     tf_);
+        }
+        if(!good)
+            return ;
 
-            if(ranges[i] < 0.05 || std::isnan(ranges[i]) || std::isinf(ranges[i]))
-                continue;
+        for(size_t i = 0; i < invalid_beams_.size(); i++)
+            ranges[invalid_beams_[i].first] = invalid_beams_[i].second;
 
-            double x = ranges[i] * cos(angles[i]);
-            double y = ranges[i] * sin(angles[i]);
+        if(reversed_scan_)
+        {
+            std::reverse(ranges.begin(), ranges.end());
+            std::reverse(angles.begin(), angles.end());
+        }
 
-            pcl::PointXYZRGB pt;
-            pt.x = x * cos(visualYaw) - y * sin(visualYaw) + visualPose.getOrigin().getX();
-            pt.y = x * sin(visualYaw) + y * cos(visualYaw) + visualPose.getOrigin().getY();
-            pt.z = 1.0;
+        //发布矫正之后的激光 发布之后不能再修改这个消息
+        scan_pub_.publish(scan_msg);
 
-            // pack r/g/b into rgb
-            unsigned char r = 255, g = 0, b = 0;    //red color
-            unsigned int rgb = ((unsigned int)r << 16 | (unsigned int)g << 8 | (unsigned int)b);
-            pt.rgb = *reinterpret_cast<float*>(&rgb);
+        if(visual_cloud)
+        {
+            appendVisualCloud(*visual_cloud, ranges, angles, visualPose, 0, 255, 0);   // green color
 
-            visual_cloud_.push_back(pt);
+            //放到显示线程的队列中 不等待显示
+            viewer_->showCloud(visual_cloud);
         }
-        std::cout << std::endl;
-
+    }
 
+    //把激光点转换到odom坐标系中 加入到可视化的点云中
+    void appendVisualCloud(AsyncCloudViewer::Cloud& cloud,
+                           const std::vector<float>& ranges,
+                           const std::vector<float>& angles,
+                           const tf::Stamped<tf::Pose>& visualPose,
+                           unsigned char r, unsigned char g, unsigned char b)
+    {
+        double visualYaw = tf::getYaw(visualPose.getRotation());
 
-        //进行矫正
-        Lidar_Calibration(ranges,angles,
-                          startTime,
-                          endTime,
-                          tf_);
+        // pack r/g/b into rgb
+        unsigned int rgb = ((unsigned int)r << 16 | (unsigned int)g << 8 | (unsigned int)b);
 
-        //转换为pcl::pointcloud for visuailization
         for(int i = 0; i < ranges.size();i++)
         {
-
             if(ranges[i] < 0.05 || std::isnan(ranges[i]) || std::isinf(ranges[i]))
                 continue;
 
             double x = ranges[i] * cos(angles[i]);
             double y = ranges[i] * sin(angles[i]);
 
-
             pcl::PointXYZRGB pt;
             pt.x = x * cos(visualYaw) - y * sin(visualYaw) + visualPose.getOrigin().getX();
             pt.y = x * sin(visualYaw) + y * cos(visualYaw) + visualPose.getOrigin().getY();
             pt.z = 1.0;
-
-            unsigned char r = 0, g = 255, b = 0;    // green color
-            unsigned int rgb = ((unsigned int)r << 16 | (unsigned int)g << 8 | (unsigned int)b);
             pt.rgb = *reinterpret_cast<float*>(&rgb);
 
-            visual_cloud_.push_back(pt);
+            cloud.push_back(pt);
         }
-
-        //进行显示
-         g_PointCloudView.showCloud(visual_cloud_.makeShared());
     }
 
 
@@ -146,6 +244,9 @@ public:
                       ros::Time dt,
                       tf::TransformListener * tf_)
     {
+        if(use_odom_buffer_)
+            return getLaserPoseFromBuffer(odom_pose, dt, tf_);
+
         odom_pose.setIdentity();
 
         tf::Stamped < tf::Pose > robot_pose;
@@ -183,6 +284,67 @@ public:
     }
 
 
+    /**
+     * @name getBaseToLaser()
+     * @brief base_link到base_laser的静态变换只在第一次使用时从tf中查询一次，不会等待
+    */
+    bool getBaseToLaser(tf::TransformListener * tf_)
+    {
+        if(has_base_to_laser_)
+            return true;
+
+        if(base_frame_.empty())
+            return false;
+
+        try
+        {
+            tf::StampedTransform transform;
+            tf_->lookupTransform(base_frame_, "base_laser", ros::Time(0), transform);
+            base_to_laser_ = transform;
+            has_base_to_laser_ = true;
+        }
+        catch (tf::TransformException& ex)
+        {
+            ROS_WARN_THROTTLE(1.0, "LidarMotion: No %s->base_laser transform: %s", base_frame_.c_str(), ex.what());
+            return false;
+        }
+
+        return true;
+    }
+
+
+    /**
+     * @name getLaserPoseFromBuffer()
+     * @brief 从里程计位姿缓冲区中插值得到dt时刻激光雷达在odom坐标系的位姿
+     * @param odom_pose 激光雷达的位姿
+     * @param dt        dt时刻
+     * @param tf_
+    */
+    bool getLaserPoseFromBuffer(tf::Stamped<tf::Pose> &odom_pose,
+                                ros::Time dt,
+                                tf::TransformListener * tf_)
+    {
+        odom_pose.setIdentity();
+
+        if(!getBaseToLaser(tf_))
+            return false;
+
+        OdomPose2D pose;
+        if(!odom_buffer_.lookup(dt.toSec(), pose))
+        {
+            ROS_WARN_THROTTLE(1.0, "LidarMotion: No odom pose at %.4f", dt.toSec());
+            return false;
+        }
+
+        tf::Transform base_pose(tf::createQuaternionFromYaw(pose.theta), tf::Vector3(pose.x, pose.y, 0.0));
+        odom_pose.setData(base_pose * base_to_laser_);
+        odom_pose.stamp_ = dt;
+        odom_pose.frame_id_ = "/odom";
+
+        return true;
+    }
+
+
     /**
      * @brief Lidar_MotionCalibration
      *        激光雷达运动畸变去除分段函数;
@@ -199,8 +361,8 @@ public:
             tf::Stamped<tf::Pose> frame_base_pose,
             tf::Stamped<tf::Pose> frame_start_pose,
             tf::Stamped<tf::Pose> frame_end_pose,
-            std::vector<double>& ranges,
-            std::vector<double>& angles,
+            std::vector<float>& ranges,
+            std::vector<float>& angles,
             int startIndex,
             int& beam_number)
     {
@@ -326,9 +488,10 @@ public:
      * @param startTime　第一束激光的时间戳
      * @param endTime　最后一束激光的时间戳
      * @param *tf_
+     * @return 位姿查询失败返回false，此时数据可能只被矫正了一部分
     */
-    void Lidar_Calibration(std::vector<double>& ranges,
-                           std::vector<double>& angles,
+    bool Lidar_Calibration(std::vector<float>& ranges,
+                           std::vector<float>& angles,
                            ros::Time startTime,
                            ros::Time endTime,
                            tf::TransformListener * tf_)
@@ -338,7 +501,7 @@ public:
         if(beamNumber != angles.size())
         {
             ROS_ERROR("Error:ranges not match to the angles");
-            return ;
+            return false;
         }
 
         // 5ms来进行分段
@@ -364,13 +527,13 @@ public:
         if(!getLaserPose(frame_start_pose, ros::Time(start_time /1000000.0), tf_))
         {
             ROS_WARN("Not Start Pose,Can not Calib");
-            return ;
+            return false;
         }
 
         if(!getLaserPose(frame_end_pose,ros::Time(end_time / 1000000.0),tf_))
         {
             ROS_WARN("Not End Pose, Can not Calib");
-            return ;
+            return false;
         }
 
         int cnt = 0;
@@ -389,7 +552,7 @@ public:
                 if(!getLaserPose(frame_mid_pose, ros::Time(mid_time/1000000.0), tf_))
                 {
                     ROS_ERROR("Mid %d Pose Error",cnt);
-                    return ;
+                    return false;
                 }
 
                 //对当前的起点和终点进行插值
@@ -410,14 +573,140 @@ public:
                 frame_start_pose = frame_mid_pose;
             }
         }
+        return true;
+    }
+
+
+    /**
+     * @name getLaserKnots()
+     * @brief 得到[startTime,endTime]时间段内激光雷达在odom坐标系中的位姿，用来构造连续轨迹
+     *        使用位姿缓冲区时，直接取缓冲区中这段时间内所有的里程计位姿；
+     *        否则用tf每5ms查询一次
+     * @param knots     激光雷达的位姿 按时间排序
+    */
+    bool getLaserKnots(std::vector<OdomPose2D>& knots,
+                       ros::Time startTime,
+                       ros::Time endTime,
+                       tf::TransformListener * tf_)
+    {
+        knots.clear();
+
+        if(use_odom_buffer_)
+        {
+            if(!getBaseToLaser(tf_))
+                return false;
+
+            if(!odom_buffer_.samples(startTime.toSec(), endTime.toSec(), knots))
+            {
+                ROS_WARN_THROTTLE(1.0, "LidarMotion: No odom pose in [%.4f,%.4f]", startTime.toSec(), endTime.toSec());
+                return false;
+            }
+
+            //base_link的位姿转换为base_laser的位姿
+            double ex = base_to_laser_.getOrigin().x();
+            double ey = base_to_laser_.getOrigin().y();
+            double etheta = tf::getYaw(base_to_laser_.getRotation());
+            for(int i = 0; i < knots.size(); i++)
+            {
+                OdomPose2D& pose = knots[i];
+                double c = cos(pose.theta), s = sin(pose.theta);
+                pose.x += c * ex - s * ey;
+                pose.y += s * ex + c * ey;
+                pose.theta += etheta;
+            }
+            return true;
+        }
+
+        //tf查询 5ms一个节点
+        tf::Stamped<tf::Pose> laser_pose;
+        OdomPose2D pose;
+        for(ros::Time t = startTime; ; t += ros::Duration(0.005))
+        {
+            if(t > endTime)
+                t = endTime;
+
+            if(!getLaserPose(laser_pose, t, tf_))
+                return false;
+
+            pose.t = t.toSec();
+            pose.x = laser_pose.getOrigin().x();
+            pose.y = laser_pose.getOrigin().y();
+            pose.theta = tf::getYaw(laser_pose.getRotation());
+            knots.push_back(pose);
+
+            if(t == endTime)
+                break;
+        }
+        return true;
+    }
+
+
+    /**
+     * @name Lidar_ContinuousCalibration()
+     * @brief 用连续的SE(2)轨迹进行畸变矫正
+     *        每帧激光只构造一次轨迹，然后根据每束激光的时间戳直接计算出对应的位姿，
+     *        不再进行分段，也不需要对每束激光做四元数的slerp
+     * @param ranges 激光束的距离值集合
+     * @param angle　激光束的角度值集合
+     * @param startTime　第一束激光的时间戳
+     * @param endTime　最后一束激光的时间戳
+     * @param *tf_
+    */
+    bool Lidar_ContinuousCalibration(std::vector<float>& ranges,
+                                     std::vector<float>& angles,
+                                     ros::Time startTime,
+                                     ros::Time endTime,
+                                     tf::TransformListener * tf_)
+    {
+        int beamNumber = ranges.size();
+        if(beamNumber != angles.size())
+        {
+            ROS_ERROR("Error:ranges not match to the angles");
+            return false;
+        }
+        if(beamNumber == 0)
+            return false;
+
+        if(!getLaserKnots(laser_knots_, startTime, endTime, tf_))
+        {
+            ROS_WARN("Not Laser Trajectory, Can not Calib");
+            return false;
+        }
+
+        trajectory_.build(laser_knots_);
+
+        // 每束激光数据的时间间隔 和Lidar_Calibration()一致
+        double time_inc = (endTime - startTime).toSec() / beamNumber;
+        UndistortScanContinuous(trajectory_, &ranges[0], &angles[0], beamNumber, time_inc);
+
+        return true;
     }
 
 public:
     tf::TransformListener* tf_;
     ros::NodeHandle nh_;
     ros::Subscriber scan_sub_;
-
-    pcl::PointCloud<pcl::PointXYZRGB> visual_cloud_;
+    ros::Publisher scan_pub_;
+    ros::Subscriber odom_sub_;
+
+    //里程计位姿缓冲区
+    bool use_odom_buffer_;
+    OdomPoseBuffer odom_buffer_;
+    std::string base_frame_;
+    bool has_base_to_laser_;
+    tf::Transform base_to_laser_;
+
+    //连续轨迹矫正
+    bool use_continuous_;
+    bool reversed_scan_;
+    bool visualize_;
+    std::vector<OdomPose2D> laser_knots_;
+    Se2Trajectory trajectory_;
+
+    //非法的激光束的下标和原来的距离 每帧重复使用
+    std::vector<std::pair<int,float> > invalid_beams_;
+
+    AsyncCloudViewer* viewer_;
 };
 
 
@@ -0,0 +1,72 @@
+#include "laser_undistortion/async_cloud_viewer.h"
+
+#include <boost/bind.hpp>
+
+#include <pcl/visualization/cloud_viewer.h>
+
+//thread_是最后一个成员 其它成员都初始化之后才会启动显示线程
+AsyncCloudViewer::AsyncCloudViewer(const std::string& name, int max_queue)
+    : name_(name),
+      max_queue_(max_queue < 1 ? 1 : max_queue),
+      dropped_(0),
+      stop_(false),
+      thread_(boost::bind(&AsyncCloudViewer::run, this))
+{
+}
+
+AsyncCloudViewer::~AsyncCloudViewer()
+{
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+void AsyncCloudViewer::showCloud(const Cloud::ConstPtr& cloud)
+{
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        //队列满了 丢掉最老的点云
+        if((int)queue_.size() >= max_queue_)
+        {
+            queue_.pop_front();
+            dropped_++;
+        }
+        queue_.push_back(cloud);
+    }
+    cond_.notify_one();
+}
+
+unsigned long AsyncCloudViewer::droppedNumber()
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return dropped_;
+}
+
+void AsyncCloudViewer::run()
+{
+    pcl::visualization::CloudViewer viewer(name_);
+
+    while(true)
+    {
+        Cloud::ConstPtr cloud;
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            while(queue_.empty() && !stop_)
+                cond_.wait(lock);
+
+            if(stop_)
+                break;
+
+            cloud = queue_.front();
+            queue_.pop_front();
+        }
+
+        //窗口被关闭之后不再显示 只清空队列
+        if(!viewer.wasStopped())
+            viewer.showCloud(cloud);
+    }
+}
@@ -0,0 +1,289 @@
+#include "laser_undistortion/correction_kernel.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CORRECTION_KERNEL_X86 1
+#endif
+
+/*
+ * sin/cos: 按pi/2进行范围缩减，r = x - k*pi/2 ∈ [-pi/4,pi/4]
+ * pi/2拆成三部分(Cody-Waite)，前两部分的尾数位数较少，k*DP1、k*DP2都没有舍入误差
+ * r上的多项式系数来自cephes的sinf/cosf
+ */
+static const float kDP1 = 1.5703125f;
+static const float kDP2 = 4.837512969970703125e-4f;
+static const float kDP3 = 7.54978995489188216e-8f;
+static const float kTwoOverPi = 0.636619772367581343f;
+
+static const float kSin1 = -1.6666654611e-1f;
+static const float kSin2 =  8.3321608736e-3f;
+static const float kSin3 = -1.9515295891e-4f;
+
+static const float kCos1 =  4.166664568298827e-2f;
+static const float kCos2 = -1.388731625493765e-3f;
+static const float kCos3 =  2.443315711809948e-5f;
+
+/*
+ * atan: z ∈ [0,1]上的奇次多项式(Abramowitz & Stegun 4.4.49)，在double下误差为2e-8
+ */
+static const float kAtan1  =  0.9999993329f;
+static const float kAtan3  = -0.3332985605f;
+static const float kAtan5  =  0.1994653599f;
+static const float kAtan7  = -0.1390853351f;
+static const float kAtan9  =  0.0964200441f;
+static const float kAtan11 = -0.0559098861f;
+static const float kAtan13 =  0.0218612288f;
+static const float kAtan15 = -0.0040540580f;
+
+static const float kPi = 3.14159265358979f;
+static const float kHalfPi = 1.57079632679490f;
+static const float kTwoPi = 6.28318530717959f;
+static const float kInvTwoPi = 0.159154943091895f;
+
+
+//////////////////////////////////////////标量版本///////////////////////////////////////////////
+
+static inline void fastSinCos(float x,float& s,float& c)
+{
+    float k = nearbyintf(x * kTwoOverPi);
+    int q = (int)k;
+
+    float r = ((x - k * kDP1) - k * kDP2) - k * kDP3;
+    float r2 = r * r;
+
+    float sr = r + r * r2 * (kSin1 + r2 * (kSin2 + r2 * kSin3));
+    float cr = 1.0f - 0.5f * r2 + r2 * r2 * (kCos1 + r2 * (kCos2 + r2 * kCos3));
+
+    //根据象限选择
+    switch(q & 3)
+    {
+    case 0: s =  sr; c =  cr; break;
+    case 1: s =  cr; c = -sr; break;
+    case 2: s = -sr; c = -cr; break;
+    default: s = -cr; c =  sr; break;
+    }
+}
+
+static inline float fastAtan2(float y,float x)
+{
+    float ax = fabsf(x), ay = fabsf(y);
+    float mx = ax > ay ? ax : ay;
+    float mn = ax > ay ? ay : ax;
+    float z = mx > 0.0f ? mn / mx : 0.0f;
+    float z2 = z * z;
+
+    float p = z * (kAtan1 + z2 * (kAtan3 + z2 * (kAtan5 + z2 * (kAtan7 +
+              z2 * (kAtan9 + z2 * (kAtan11 + z2 * (kAtan13 + z2 * kAtan15)))))));
+
+    if(ay > ax)
+        p = kHalfPi - p;
+    if(x < 0.0f)
+        p = kPi - p;
+    return copysignf(p,y);
+}
+
+static inline float normalizeAnglef(float a)
+{
+    return a - kTwoPi * floorf((a + kPi) * kInvTwoPi);
+}
+
+static void CorrectBeamsScalar(float* ranges,
+                               float* angles,
+                               const float* pose_x,
+                               const float* pose_y,
+                               const float* pose_theta,
+                               int n)
+{
+    for(int i = 0; i < n; i++)
+    {
+        float a = angles[i] + pose_theta[i];
+        if(ranges[i] == 0.0f)
+        {
+            angles[i] = normalizeAnglef(a);
+            continue;
+        }
+
+        float s,c;
+        fastSinCos(a,s,c);
+
+        float px = ranges[i] * c + pose_x[i];
+        float py = ranges[i] * s + pose_y[i];
+
+        ranges[i] = sqrtf(px * px + py * py);
+        angles[i] = fastAtan2(py,px);
+    }
+}
+
+
+//////////////////////////////////////////AVX2版本///////////////////////////////////////////////
+
+#ifdef CORRECTION_KERNEL_X86
+
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+
+AVX2_TARGET static inline void fastSinCos8(__m256 x,__m256& s,__m256& c)
+{
+    __m256 k = _mm256_round_ps(_mm256_mul_ps(x,_mm256_set1_ps(kTwoOverPi)),
+                               _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256i q = _mm256_cvtps_epi32(k);
+
+    __m256 r = _mm256_fnmadd_ps(k,_mm256_set1_ps(kDP1),x);
+    r = _mm256_fnmadd_ps(k,_mm256_set1_ps(kDP2),r);
+    r = _mm256_fnmadd_ps(k,_mm256_set1_ps(kDP3),r);
+    __m256 r2 = _mm256_mul_ps(r,r);
+
+    __m256 ps = _mm256_fmadd_ps(r2,_mm256_set1_ps(kSin3),_mm256_set1_ps(kSin2));
+    ps = _mm256_fmadd_ps(r2,ps,_mm256_set1_ps(kSin1));
+    __m256 sr = _mm256_fmadd_ps(_mm256_mul_ps(r,r2),ps,r);
+
+    __m256 pc = _mm256_fmadd_ps(r2,_mm256_set1_ps(kCos3),_mm256_set1_ps(kCos2));
+    pc = _mm256_fmadd_ps(r2,pc,_mm256_set1_ps(kCos1));
+    __m256 cr = _mm256_fmadd_ps(_mm256_mul_ps(r2,r2),pc,
+                                _mm256_fnmadd_ps(_mm256_set1_ps(0.5f),r2,_mm256_set1_ps(1.0f)));
+
+    //象限为1或者3时交换sin和cos
+    __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q,_mm256_set1_epi32(1)),
+                                                         _mm256_set1_epi32(1)));
+    __m256 s0 = _mm256_blendv_ps(sr,cr,swap);
+    __m256 c0 = _mm256_blendv_ps(cr,sr,swap);
+
+    //sin在象限2、3取反 cos在象限1、2取反 直接修改符号位
+    __m256i sign_s = _mm256_slli_epi32(_mm256_and_si256(q,_mm256_set1_epi32(2)),30);
+    __m256i sign_c = _mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q,_mm256_set1_epi32(1)),
+                                                        _mm256_set1_epi32(2)),30);
+    s = _mm256_xor_ps(s0,_mm256_castsi256_ps(sign_s));
+    c = _mm256_xor_ps(c0,_mm256_castsi256_ps(sign_c));
+}
+
+AVX2_TARGET static inline __m256 fastAtan28(__m256 y,__m256 x)
+{
+    const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+
+    __m256 ax = _mm256_andnot_ps(sign_mask,x);
+    __m256 ay = _mm256_andnot_ps(sign_mask,y);
+    __m256 mx = _mm256_max_ps(ax,ay);
+    __m256 mn = _mm256_min_ps(ax,ay);
+
+    //mx为0时z为0
+    __m256 nonzero = _mm256_cmp_ps(mx,_mm256_setzero_ps(),_CMP_GT_OQ);
+    __m256 z = _mm256_and_ps(_mm256_div_ps(mn,mx),nonzero);
+    __m256 z2 = _mm256_mul_ps(z,z);
+
+    __m256 p = _mm256_fmadd_ps(z2,_mm256_set1_ps(kAtan15),_mm256_set1_ps(kAtan13));
+    p = _mm256_fmadd_ps(z2,p,_mm256_set1_ps(kAtan11));
+    p = _mm256_fmadd_ps(z2,p,_mm256_set1_ps(kAtan9));
+    p = _mm256_fmadd_ps(z2,p,_mm256_set1_ps(kAtan7));
+    p = _mm256_fmadd_ps(z2,p,_mm256_set1_ps(kAtan5));
+    p = _mm256_fmadd_ps(z2,p,_mm256_set1_ps(kAtan3));
+    p = _mm256_fmadd_ps(z2,p,_mm256_set1_ps(kAtan1));
+    p = _mm256_mul_ps(p,z);
+
+    __m256 steep = _mm256_cmp_ps(ay,ax,_CMP_GT_OQ);
+    p = _mm256_blendv_ps(p,_mm256_sub_ps(_mm256_set1_ps(kHalfPi),p),steep);
+
+    __m256 neg_x = _mm256_cmp_ps(x,_mm256_setzero_ps(),_CMP_LT_OQ);
+    p = _mm256_blendv_ps(p,_mm256_sub_ps(_mm256_set1_ps(kPi),p),neg_x);
+
+    //符号和y相同
+    return _mm256_or_ps(p,_mm256_and_ps(y,sign_mask));
+}
+
+AVX2_TARGET static void CorrectBeamsAvx2(float* ranges,
+                                         float* angles,
+                                         const float* pose_x,
+                                         const float* pose_y,
+                                         const float* pose_theta,
+                                         int n)
+{
+    const __m256 zero = _mm256_setzero_ps();
+
+    int i = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        __m256 r = _mm256_loadu_ps(ranges + i);
+        __m256 a = _mm256_add_ps(_mm256_loadu_ps(angles + i),_mm256_loadu_ps(pose_theta + i));
+
+        __m256 s,c;
+        fastSinCos8(a,s,c);
+
+        __m256 px = _mm256_fmadd_ps(r,c,_mm256_loadu_ps(pose_x + i));
+        __m256 py = _mm256_fmadd_ps(r,s,_mm256_loadu_ps(pose_y + i));
+
+        __m256 new_r = _mm256_sqrt_ps(_mm256_fmadd_ps(px,px,_mm256_mul_ps(py,py)));
+        __m256 new_a = fastAtan28(py,px);
+
+        //非法的激光束 只归一化角度
+        __m256 wrap = _mm256_floor_ps(_mm256_mul_ps(_mm256_add_ps(a,_mm256_set1_ps(kPi)),
+                                                    _mm256_set1_ps(kInvTwoPi)));
+        __m256 norm_a = _mm256_fnmadd_ps(wrap,_mm256_set1_ps(kTwoPi),a);
+
+        __m256 invalid = _mm256_cmp_ps(r,zero,_CMP_EQ_OQ);
+        _mm256_storeu_ps(ranges + i,_mm256_blendv_ps(new_r,zero,invalid));
+        _mm256_storeu_ps(angles + i,_mm256_blendv_ps(new_a,norm_a,invalid));
+    }
+
+    //剩下不足8个的激光束
+    CorrectBeamsScalar(ranges + i,angles + i,pose_x + i,pose_y + i,pose_theta + i,n - i);
+}
+
+static bool DetectAvx2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+#endif
+
+
+bool CorrectBeamsUseAvx2()
+{
+#ifdef CORRECTION_KERNEL_X86
+    static const bool has_avx2 = DetectAvx2();
+    return has_avx2;
+#else
+    return false;
+#endif
+}
+
+void CorrectBeams(float* ranges,
+                  float* angles,
+                  const float* pose_x,
+                  const float* pose_y,
+                  const float* pose_theta,
+                  int n)
+{
+#ifdef CORRECTION_KERNEL_X86
+    if(CorrectBeamsUseAvx2())
+    {
+        CorrectBeamsAvx2(ranges,angles,pose_x,pose_y,pose_theta,n);
+        return;
+    }
+#endif
+    CorrectBeamsScalar(ranges,angles,pose_x,pose_y,pose_theta,n);
+}
+
+void CorrectBeamsReference(float* ranges,
+                           float* angles,
+                           const float* pose_x,
+                           const float* pose_y,
+                           const float* pose_theta,
+                           int n)
+{
+    for(int i = 0; i < n; i++)
+    {
+        float a = angles[i] + pose_theta[i];
+        if(ranges[i] == 0.0f)
+        {
+            angles[i] = normalizeAnglef(a);
+            continue;
+        }
+
+        float px = ranges[i] * cosf(a) + pose_x[i];
+        float py = ranges[i] * sinf(a) + pose_y[i];
+
+        ranges[i] = sqrtf(px * px + py * py);
+        angles[i] = atan2f(py,px);
+    }
+}
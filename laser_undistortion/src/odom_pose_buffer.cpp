@@ -0,0 +1,168 @@
+#include "laser_undistortion/odom_pose_buffer.h"
+
+#include <cmath>
+
+//把角度归一化到[-pi,pi)
+static double normalizeAngle(double a)
+{
+    return a - 2.0 * M_PI * std::floor((a + M_PI) / (2.0 * M_PI));
+}
+
+OdomPoseBuffer::OdomPoseBuffer(int capacity)
+{
+    policy_ = ODOM_MISSING_EXTRAPOLATE;
+    max_gap_ = 0.05;
+    setCapacity(capacity);
+}
+
+void OdomPoseBuffer::setCapacity(int capacity)
+{
+    if(capacity < 2)
+        capacity = 2;
+
+    buffer_.assign(capacity,OdomPose2D());
+    clear();
+}
+
+void OdomPoseBuffer::setMissingPolicy(OdomMissingPolicy policy,double max_gap)
+{
+    policy_ = policy;
+    max_gap_ = max_gap;
+}
+
+void OdomPoseBuffer::clear()
+{
+    head_ = 0;
+    size_ = 0;
+    hint_ = 0;
+}
+
+bool OdomPoseBuffer::addPose(const OdomPose2D& pose)
+{
+    //时间戳必须单调递增
+    if(size_ > 0 && pose.t <= newest().t)
+        return false;
+
+    int capacity = buffer_.size();
+    if(size_ < capacity)
+    {
+        buffer_[(head_ + size_) % capacity] = pose;
+        size_++;
+    }
+    else
+    {
+        //缓冲区满了 覆盖最老的位姿 逻辑下标整体前移一位
+        buffer_[head_] = pose;
+        head_ = (head_ + 1) % capacity;
+        if(hint_ > 0)
+            hint_--;
+    }
+    return true;
+}
+
+int OdomPoseBuffer::findSegment(double t) const
+{
+    int last = size_ - 2;
+    int i = hint_ > last ? last : hint_;
+
+    //从上一次查询的区间开始往后找
+    if(at(i).t <= t)
+    {
+        while(i < last && at(i + 1).t <= t)
+            i++;
+    }
+    //时间倒退 二分查找
+    else
+    {
+        int lo = 0, hi = i;
+        while(lo < hi)
+        {
+            int mid = (lo + hi + 1) / 2;
+            if(at(mid).t <= t)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        i = lo;
+    }
+
+    hint_ = i;
+    return i;
+}
+
+void OdomPoseBuffer::interpolate(const OdomPose2D& a,const OdomPose2D& b,double t,OdomPose2D& pose)
+{
+    double s = (t - a.t) / (b.t - a.t);
+
+    pose.t = t;
+    pose.x = a.x + s * (b.x - a.x);
+    pose.y = a.y + s * (b.y - a.y);
+    pose.theta = normalizeAngle(a.theta + s * normalizeAngle(b.theta - a.theta));
+}
+
+bool OdomPoseBuffer::lookup(double t,OdomPose2D& pose) const
+{
+    if(size_ == 0)
+        return false;
+
+    //在缓冲区的覆盖范围之内 直接插值
+    if(size_ >= 2 && t >= oldest().t && t <= newest().t)
+    {
+        int i = findSegment(t);
+        interpolate(at(i),at(i + 1),t,pose);
+        return true;
+    }
+
+    if(size_ == 1 && t == newest().t)
+    {
+        pose = newest();
+        return true;
+    }
+
+    //超出了覆盖范围 根据策略进行处理
+    bool after = t > newest().t;
+    double gap = after ? t - newest().t : oldest().t - t;
+    if(policy_ == ODOM_MISSING_FAIL || gap > max_gap_)
+        return false;
+
+    if(policy_ == ODOM_MISSING_EXTRAPOLATE && size_ >= 2)
+    {
+        //用最边上的两个位姿的速度外推
+        if(after)
+            interpolate(at(size_ - 2),at(size_ - 1),t,pose);
+        else
+            interpolate(at(0),at(1),t,pose);
+        return true;
+    }
+
+    pose = after ? newest() : oldest();
+    pose.t = t;
+    return true;
+}
+
+bool OdomPoseBuffer::samples(double t0,double t1,std::vector<OdomPose2D>& poses) const
+{
+    poses.clear();
+
+    OdomPose2D pose;
+    if(t1 < t0 || !lookup(t0,pose))
+        return false;
+    poses.push_back(pose);
+
+    //中间的原始位姿 lookup()之后hint_指向t0所在的区间
+    if(size_ >= 2 && t0 >= oldest().t)
+    {
+        for(int i = findSegment(t0) + 1; i < size_ && at(i).t < t1; i++)
+        {
+            if(at(i).t > t0)
+                poses.push_back(at(i));
+        }
+    }
+
+    if(!lookup(t1,pose))
+        return false;
+    if(t1 > t0)
+        poses.push_back(pose);
+
+    return true;
+}
@@ -0,0 +1,498 @@
+/*
+ * 离线的激光畸变矫正测试程序 不依赖ROS
+ * 在一个二维多边形的世界中仿真一个运动中的激光雷达，生成带畸变的激光数据和里程计数据，
+ * 然后用各种插值方式进行矫正，和真值比较，输出端点误差和每帧的耗时。
+ *
+ * 用法: undistortion_benchmark [beams] [scan_rate] [odom_rate] [scans] [odom_noise]
+ *   beams      每帧激光的数量，默认2000
+ *   scan_rate  激光的频率，默认40Hz
+ *   odom_rate  里程计的频率，默认100Hz
+ *   scans      每种运动方式仿真的帧数，默认200
+ *   odom_noise 里程计位置噪声的标准差(m)，角度噪声为其0.5倍(rad)，默认0
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "laser_undistortion/odom_pose_buffer.h"
+#include "laser_undistortion/undistortion_core.h"
+#include "laser_undistortion/correction_kernel.h"
+
+static double normalizeAngle(double a)
+{
+    return a - 2.0 * M_PI * std::floor((a + M_PI) / (2.0 * M_PI));
+}
+
+static double nowMicroSec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+static double gaussianNoise(double sigma)
+{
+    if(sigma <= 0.0)
+        return 0.0;
+
+    //Box-Muller
+    double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sigma * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+
+//////////////////////////////////////////仿真世界///////////////////////////////////////////////
+
+struct Segment
+{
+    double x0,y0,x1,y1;
+};
+
+//一个20m*12m的房间 中间有几个柱子
+static void BuildWorld(std::vector<Segment>& world)
+{
+    world.clear();
+
+    std::vector<std::vector<double> > polygons;
+    double room[] = {-10,-6, 10,-6, 10,6, -10,6};
+    double box1[] = {3,1, 4,1, 4,2, 3,2};
+    double box2[] = {-5,-3, -4,-3.5, -3.5,-2.5, -4.5,-2};
+    double box3[] = {-2,3, -1,3, -1,4.5, -2,4.5};
+    double wall[] = {6,-6, 6,-2, 6.2,-2, 6.2,-6};
+    polygons.push_back(std::vector<double>(room, room + 8));
+    polygons.push_back(std::vector<double>(box1, box1 + 8));
+    polygons.push_back(std::vector<double>(box2, box2 + 8));
+    polygons.push_back(std::vector<double>(box3, box3 + 8));
+    polygons.push_back(std::vector<double>(wall, wall + 8));
+
+    for(size_t k = 0; k < polygons.size(); k++)
+    {
+        const std::vector<double>& p = polygons[k];
+        int n = p.size() / 2;
+        for(int i = 0; i < n; i++)
+        {
+            Segment s;
+            s.x0 = p[2 * i];
+            s.y0 = p[2 * i + 1];
+            s.x1 = p[2 * ((i + 1) % n)];
+            s.y1 = p[2 * ((i + 1) % n) + 1];
+            world.push_back(s);
+        }
+    }
+}
+
+//射线和世界求交 返回距离 没有交点返回0
+static double RayCast(const std::vector<Segment>& world, double ox, double oy, double angle, double max_range)
+{
+    double dx = cos(angle), dy = sin(angle);
+    double best = max_range;
+    bool hit = false;
+
+    for(size_t i = 0; i < world.size(); i++)
+    {
+        const Segment& s = world[i];
+        double ex = s.x1 - s.x0, ey = s.y1 - s.y0;
+        double denom = dx * ey - dy * ex;
+        if(fabs(denom) < 1e-12)
+            continue;
+
+        double wx = s.x0 - ox, wy = s.y0 - oy;
+        double t = (wx * ey - wy * ex) / denom;
+        double u = (wx * dy - wy * dx) / denom;
+        if(t > 0.0 && u >= 0.0 && u <= 1.0 && t < best)
+        {
+            best = t;
+            hit = true;
+        }
+    }
+    return hit ? best : 0.0;
+}
+
+
+//////////////////////////////////////////运动方式///////////////////////////////////////////////
+
+/*
+ * 速度为 v(t) = v0 + acc*t, w(t) = w0 + alpha*t
+ * 用很小的步长预先积分出真值轨迹，查询的时候线性插值
+ */
+class MotionProfile
+{
+public:
+    MotionProfile(const std::string& name, double v0, double acc, double w0, double alpha, double duration)
+    {
+        name_ = name;
+        step_ = 1e-5;
+
+        int n = duration / step_ + 2;
+        OdomPose2D pose;
+        pose.t = 0.0;
+        pose.x = 0.0;
+        pose.y = -1.0;
+        pose.theta = 0.0;
+        poses_.reserve(n);
+        poses_.push_back(pose);
+
+        //中点法积分
+        for(int i = 1; i < n; i++)
+        {
+            double tm = (i - 0.5) * step_;
+            double v = v0 + acc * tm;
+            double w = w0 + alpha * tm;
+            double theta_m = pose.theta + 0.5 * w * step_;
+
+            pose.x += v * cos(theta_m) * step_;
+            pose.y += v * sin(theta_m) * step_;
+            pose.theta += w * step_;
+            pose.t = i * step_;
+            poses_.push_back(pose);
+        }
+    }
+
+    //t时刻的真值位姿 角度没有归一化
+    OdomPose2D pose(double t) const
+    {
+        double f = t / step_;
+        int i = (int)f;
+        if(i < 0)
+            return poses_.front();
+        if(i + 1 >= (int)poses_.size())
+            return poses_.back();
+
+        double s = f - i;
+        const OdomPose2D& a = poses_[i];
+        const OdomPose2D& b = poses_[i + 1];
+        OdomPose2D p;
+        p.t = t;
+        p.x = a.x + s * (b.x - a.x);
+        p.y = a.y + s * (b.y - a.y);
+        p.theta = a.theta + s * (b.theta - a.theta);
+        return p;
+    }
+
+    const std::string& name() const { return name_; }
+
+private:
+    std::string name_;
+    double step_;
+    std::vector<OdomPose2D> poses_;
+};
+
+
+//////////////////////////////////////////矫正方法///////////////////////////////////////////////
+
+/*
+ * 和节点中的Lidar_Calibration()/Lidar_MotionCalibration()相同的5ms分段插值
+ * 位姿从里程计缓冲区中查询，分段内对位置和角度做线性插值，使用double计算。
+ * 和节点一样，每个分段的最后一束激光也是下一个分段的第一束激光，会被矫正两次。
+ */
+static bool UndistortScanSegment(const OdomPoseBuffer& buffer,
+                                 std::vector<float>& ranges,
+                                 std::vector<float>& angles,
+                                 double start_time,
+                                 double end_time)
+{
+    int beam_number = ranges.size();
+    double time_inc = (end_time - start_time) / beam_number;
+    const double segment_duration = 0.005;
+
+    OdomPose2D base_pose, seg_start, seg_end;
+    if(!buffer.lookup(start_time, base_pose))
+        return false;
+    seg_start = base_pose;
+
+    double cb = cos(base_pose.theta), sb = sin(base_pose.theta);
+
+    int start_index = 0;
+    double seg_time = start_time;
+    for(int i = 0; i < beam_number; i++)
+    {
+        double mid_time = seg_time + time_inc * (i - start_index);
+        if(mid_time - seg_time <= segment_duration && i != beam_number - 1)
+            continue;
+
+        if(!buffer.lookup(mid_time, seg_end))
+            return false;
+
+        int count = i - start_index + 1;
+        double step = count > 1 ? 1.0 / (count - 1) : 0.0;
+        double dtheta = normalizeAngle(seg_end.theta - seg_start.theta);
+
+        for(int k = 0; k < count; k++)
+        {
+            int idx = start_index + k;
+            double s = step * k;
+            double theta = seg_start.theta + s * dtheta;
+            double px = seg_start.x + s * (seg_end.x - seg_start.x);
+            double py = seg_start.y + s * (seg_end.y - seg_start.y);
+
+            if(ranges[idx] == 0.0f)
+            {
+                angles[idx] = normalizeAngle(angles[idx] + theta - base_pose.theta);
+                continue;
+            }
+
+            //odom坐标系下的坐标
+            double lx = ranges[idx] * cos(angles[idx]);
+            double ly = ranges[idx] * sin(angles[idx]);
+            double ox = lx * cos(theta) - ly * sin(theta) + px;
+            double oy = lx * sin(theta) + ly * cos(theta) + py;
+
+            //转换到基准坐标系
+            double bx =  (ox - base_pose.x) * cb + (oy - base_pose.y) * sb;
+            double by = -(ox - base_pose.x) * sb + (oy - base_pose.y) * cb;
+
+            ranges[idx] = sqrt(bx * bx + by * by);
+            angles[idx] = atan2(by, bx);
+        }
+
+        seg_time = mid_time;
+        start_index = i;
+        seg_start = seg_end;
+    }
+    return true;
+}
+
+//连续轨迹 + libm的标量参考核函数
+static bool UndistortScanContinuousReference(const OdomPoseBuffer& buffer,
+                                             std::vector<float>& ranges,
+                                             std::vector<float>& angles,
+                                             double start_time,
+                                             double end_time)
+{
+    static std::vector<OdomPose2D> knots;
+    static Se2Trajectory trajectory;
+    if(!buffer.samples(start_time, end_time, knots))
+        return false;
+    trajectory.build(knots);
+
+    int n = ranges.size();
+    double time_inc = (end_time - start_time) / n;
+    std::vector<float> px(n), py(n), ptheta(n);
+    trajectory.evaluate(start_time, time_inc, n, &px[0], &py[0], &ptheta[0]);
+    CorrectBeamsReference(&ranges[0], &angles[0], &px[0], &py[0], &ptheta[0], n);
+    return true;
+}
+
+//连续轨迹 + SIMD核函数 和节点中的Lidar_ContinuousCalibration()相同
+static bool UndistortScanContinuousFast(const OdomPoseBuffer& buffer,
+                                        std::vector<float>& ranges,
+                                        std::vector<float>& angles,
+                                        double start_time,
+                                        double end_time)
+{
+    static std::vector<OdomPose2D> knots;
+    static Se2Trajectory trajectory;
+    if(!buffer.samples(start_time, end_time, knots))
+        return false;
+    trajectory.build(knots);
+
+    int n = ranges.size();
+    UndistortScanContinuous(trajectory, &ranges[0], &angles[0], n, (end_time - start_time) / n);
+    return true;
+}
+
+//不矫正
+static bool UndistortScanNone(const OdomPoseBuffer&,
+                              std::vector<float>&,
+                              std::vector<float>&,
+                              double,
+                              double)
+{
+    return true;
+}
+
+typedef bool (*UndistortFunction)(const OdomPoseBuffer&, std::vector<float>&, std::vector<float>&, double, double);
+
+struct Method
+{
+    const char* name;
+    UndistortFunction function;
+};
+
+
+//////////////////////////////////////////测试///////////////////////////////////////////////
+
+struct BenchmarkParams
+{
+    int beams;
+    double scan_rate;
+    double odom_rate;
+    int scans;
+    double odom_noise;
+};
+
+struct SimulatedScan
+{
+    double start_time,end_time;
+    std::vector<float> ranges,angles;
+
+    //真值：每束激光的端点在起始位姿坐标系中的坐标
+    std::vector<double> true_x,true_y;
+};
+
+static void SimulateScans(const MotionProfile& motion,
+                          const std::vector<Segment>& world,
+                          const BenchmarkParams& params,
+                          std::vector<SimulatedScan>& scans)
+{
+    double period = 1.0 / params.scan_rate;
+    double time_inc = period / params.beams;
+
+    scans.resize(params.scans);
+    for(int k = 0; k < params.scans; k++)
+    {
+        SimulatedScan& scan = scans[k];
+        scan.start_time = 0.1 + k * period;
+        scan.end_time = scan.start_time + time_inc * params.beams;
+        scan.ranges.resize(params.beams);
+        scan.angles.resize(params.beams);
+        scan.true_x.resize(params.beams);
+        scan.true_y.resize(params.beams);
+
+        OdomPose2D base = motion.pose(scan.start_time);
+        double cb = cos(base.theta), sb = sin(base.theta);
+
+        for(int i = 0; i < params.beams; i++)
+        {
+            //第i束激光的测量时刻和角度
+            OdomPose2D pose = motion.pose(scan.start_time + i * time_inc);
+            double angle = -M_PI + 2.0 * M_PI * i / params.beams;
+            double range = RayCast(world, pose.x, pose.y, pose.theta + angle, 30.0);
+
+            scan.ranges[i] = range;
+            scan.angles[i] = angle;
+
+            double wx = pose.x + range * cos(pose.theta + angle);
+            double wy = pose.y + range * sin(pose.theta + angle);
+            scan.true_x[i] =  (wx - base.x) * cb + (wy - base.y) * sb;
+            scan.true_y[i] = -(wx - base.x) * sb + (wy - base.y) * cb;
+        }
+    }
+}
+
+static void FillOdomBuffer(const MotionProfile& motion,
+                           const BenchmarkParams& params,
+                           double duration,
+                           OdomPoseBuffer& buffer)
+{
+    int n = duration * params.odom_rate + 1;
+    buffer.setCapacity(n + 1);
+
+    srand(1);
+    for(int i = 0; i <= n; i++)
+    {
+        OdomPose2D pose = motion.pose(i / params.odom_rate);
+        pose.x += gaussianNoise(params.odom_noise);
+        pose.y += gaussianNoise(params.odom_noise);
+        pose.theta = normalizeAngle(pose.theta + gaussianNoise(0.5 * params.odom_noise));
+        buffer.addPose(pose);
+    }
+}
+
+static void RunMethod(const Method& method,
+                      const OdomPoseBuffer& buffer,
+                      const std::vector<SimulatedScan>& scans)
+{
+    double total_time = 0.0;
+    double sum_error = 0.0, max_error = 0.0;
+    long count = 0;
+    int failed = 0;
+
+    std::vector<float> ranges, angles;
+    for(size_t k = 0; k < scans.size(); k++)
+    {
+        const SimulatedScan& scan = scans[k];
+        ranges = scan.ranges;
+        angles = scan.angles;
+
+        double t0 = nowMicroSec();
+        bool good = method.function(buffer, ranges, angles, scan.start_time, scan.end_time);
+        total_time += nowMicroSec() - t0;
+
+        if(!good)
+        {
+            failed++;
+            continue;
+        }
+
+        for(size_t i = 0; i < ranges.size(); i++)
+        {
+            if(scan.ranges[i] == 0.0f)
+                continue;
+
+            double x = ranges[i] * cos(angles[i]);
+            double y = ranges[i] * sin(angles[i]);
+            double e = hypot(x - scan.true_x[i], y - scan.true_y[i]);
+            sum_error += e;
+            max_error = std::max(max_error, e);
+            count++;
+        }
+    }
+
+    printf("  %-22s mean %9.5f m  max %9.5f m  %9.2f us/scan",
+           method.name,
+           count ? sum_error / count : 0.0,
+           max_error,
+           total_time / scans.size());
+    if(failed)
+        printf("  (%d failed)", failed);
+    printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkParams params;
+    params.beams      = argc > 1 ? atoi(argv[1]) : 2000;
+    params.scan_rate  = argc > 2 ? atof(argv[2]) : 40.0;
+    params.odom_rate  = argc > 3 ? atof(argv[3]) : 100.0;
+    params.scans      = argc > 4 ? atoi(argv[4]) : 200;
+    params.odom_noise = argc > 5 ? atof(argv[5]) : 0.0;
+
+    if(params.beams < 2 || params.scan_rate <= 0.0 || params.odom_rate <= 0.0 || params.scans < 1)
+    {
+        printf("usage: %s [beams] [scan_rate] [odom_rate] [scans] [odom_noise]\n", argv[0]);
+        return 1;
+    }
+
+    printf("beams %d  scan rate %.1f Hz  odom rate %.1f Hz  scans %d  odom noise %.4f  avx2 %s\n",
+           params.beams, params.scan_rate, params.odom_rate, params.scans, params.odom_noise,
+           CorrectBeamsUseAvx2() ? "yes" : "no");
+
+    std::vector<Segment> world;
+    BuildWorld(world);
+
+    double duration = 0.2 + params.scans / params.scan_rate;
+
+    std::vector<MotionProfile> motions;
+    motions.push_back(MotionProfile("constant twist (v=1.0 w=0.8)", 1.0, 0.0, 0.8, 0.0, duration));
+    motions.push_back(MotionProfile("accelerating turn (v=0.5+0.3t w=0.6t)", 0.5, 0.3, 0.0, 0.6, duration));
+
+    Method methods[] = {
+        {"none",                  UndistortScanNone},
+        {"segment 5ms",           UndistortScanSegment},
+        {"continuous reference",  UndistortScanContinuousReference},
+        {"continuous",            UndistortScanContinuousFast}
+    };
+    int method_number = sizeof(methods) / sizeof(methods[0]);
+
+    for(size_t m = 0; m < motions.size(); m++)
+    {
+        std::vector<SimulatedScan> scans;
+        SimulateScans(motions[m], world, params, scans);
+
+        OdomPoseBuffer buffer;
+        FillOdomBuffer(motions[m], params, duration, buffer);
+
+        printf("%s\n", motions[m].name().c_str());
+        for(int i = 0; i < method_number; i++)
+            RunMethod(methods[i], buffer, scans);
+    }
+
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "laser_undistortion/undistortion_core.h"
+#include "laser_undistortion/correction_kernel.h"
+
+#include <cmath>
+
+//把角度归一化到[-pi,pi)
+static float normalizeAnglef(float a)
+{
+    return a - 2.0f * (float)M_PI * std::floor((a + (float)M_PI) / (2.0f * (float)M_PI));
+}
+
+Se2Trajectory::Se2Trajectory()
+{
+    base_.t = base_.x = base_.y = base_.theta = 0.0;
+}
+
+bool Se2Trajectory::build(const std::vector<OdomPose2D>& knots)
+{
+    t_.clear();
+    x_.clear();
+    y_.clear();
+    theta_.clear();
+
+    if(knots.empty())
+        return false;
+
+    base_ = knots[0];
+
+    double c = cos(base_.theta);
+    double s = sin(base_.theta);
+    double last_theta = 0.0;
+    for(size_t i = 0; i < knots.size(); i++)
+    {
+        //时间必须严格递增 否则跳过
+        double t = knots[i].t - base_.t;
+        if(!t_.empty() && t <= t_.back())
+            continue;
+
+        //转换到基准坐标系
+        double dx = knots[i].x - base_.x;
+        double dy = knots[i].y - base_.y;
+        double dtheta = knots[i].theta - base_.theta;
+
+        //角度展开 保证相邻节点之间的角度差在[-pi,pi)之内
+        dtheta = last_theta + normalizeAnglef(dtheta - last_theta);
+        last_theta = dtheta;
+
+        t_.push_back(t);
+        x_.push_back( c * dx + s * dy);
+        y_.push_back(-s * dx + c * dy);
+        theta_.push_back(dtheta);
+    }
+
+    return true;
+}
+
+void Se2Trajectory::evaluate(double start_time,double time_inc,int n,
+                             float* x,float* y,float* theta) const
+{
+    int knot_num = t_.size();
+    if(knot_num == 0 || n <= 0)
+        return;
+
+    //相对于基准位姿的时间
+    double begin = start_time - base_.t;
+    int i = 0;
+
+    //第一个节点之前的激光束 使用第一个节点的位姿
+    for(; i < n && begin + i * time_inc < t_[0]; i++)
+    {
+        x[i] = x_[0];
+        y[i] = y_[0];
+        theta[i] = theta_[0];
+    }
+
+    //分段线性插值
+    if(time_inc > 0.0)
+    {
+        const float inc = time_inc;
+        for(int k = 0; k + 1 < knot_num && i < n; k++)
+        {
+            //时间小于t_[k+1]的激光束都在这个分段内
+            int end = (int)std::ceil((t_[k + 1] - begin) / time_inc);
+            if(end > n)
+                end = n;
+            if(end <= i)
+                continue;
+
+            const float seg_dt = t_[k + 1] - t_[k];
+            const float vx = (x_[k + 1] - x_[k]) / seg_dt;
+            const float vy = (y_[k + 1] - y_[k]) / seg_dt;
+            const float vtheta = (theta_[k + 1] - theta_[k]) / seg_dt;
+            const float t0 = begin - t_[k];
+            const float x0 = x_[k], y0 = y_[k], theta0 = theta_[k];
+
+            for(int j = i; j < end; j++)
+            {
+                float dt = t0 + j * inc;
+                x[j] = x0 + vx * dt;
+                y[j] = y0 + vy * dt;
+                theta[j] = theta0 + vtheta * dt;
+            }
+            i = end;
+        }
+    }
+
+    //最后一个节点之后的激光束 使用最后一个节点的位姿
+    for(; i < n; i++)
+    {
+        x[i] = x_[knot_num - 1];
+        y[i] = y_[knot_num - 1];
+        theta[i] = theta_[knot_num - 1];
+    }
+}
+
+
+void UndistortScanContinuous(const Se2Trajectory& trajectory,
+                             float* ranges,
+                             float* angles,
+                             int n,
+                             double time_inc)
+{
+    if(n <= 0)
+        return;
+
+    //每束激光对应的激光雷达位姿
+    std::vector<float> pose_x(n),pose_y(n),pose_theta(n);
+    trajectory.evaluate(trajectory.basePose().t,time_inc,n,&pose_x[0],&pose_y[0],&pose_theta[0]);
+
+    CorrectBeams(ranges,angles,&pose_x[0],&pose_y[0],&pose_theta[0],n);
+}
@@ -0,0 +1,109 @@
+#ifndef TILED_MAP_H
+#define TILED_MAP_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * 分块的二进制地图格式(.tmap)
+ * 文件布局：
+ *   TiledMapHeader
+ *   TileIndexEntry[tiles_x * tiles_y]   按行存储 tile(tx,ty)的下标为 tx + ty*tiles_x
+ *   各个tile压缩之后的数据
+ * 每个tile独立压缩，因此可以只解压机器人附近的tile，不需要解码整张地图。
+ * 所有字段都按照小端格式存储。
+ */
+
+#define TILED_MAP_MAGIC   0x50414d54      // "TMAP"
+#define TILED_MAP_VERSION 1
+
+//每个tile的压缩方式
+enum TileCodec
+{
+    TILE_CODEC_RAW  = 0,    //不压缩
+    TILE_CODEC_FILL = 1,    //整个tile都是同一个值，只存一个字节
+    TILE_CODEC_RLE  = 2     //游程编码 每一段为(uint16 长度,uint8 值)
+};
+
+#pragma pack(push,1)
+typedef struct tiled_map_header
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t  width,height;          //地图的大小 单位为栅格
+    int32_t  offset_x,offset_y;     //世界坐标系原点在地图中的下标
+    double   resolution;
+    double   origin_x,origin_y;
+    int32_t  tile_size;             //tile的边长 单位为栅格
+    int32_t  tiles_x,tiles_y;       //tile的数量
+}TiledMapHeader;
+
+typedef struct tile_index_entry
+{
+    uint64_t offset;                //tile数据在文件中的偏移
+    uint32_t size;                  //tile压缩之后的字节数
+    uint8_t  codec;                 //TileCodec
+    uint8_t  fill;                  //codec为TILE_CODEC_FILL时的值
+    uint16_t reserved;
+}TileIndexEntry;
+#pragma pack(pop)
+
+
+/**
+ * 把地图保存为分块的二进制格式
+ * 每个tile选择FILL/RLE/RAW中最小的一种编码
+ * @param path      文件路径
+ * @param header    地图的信息 magic/version/tiles_x/tiles_y会在函数内部填写
+ * @param map       地图数据 大小为width*height
+ */
+bool SaveTiledMap(const std::string& path,TiledMapHeader header,const unsigned char* map);
+
+
+/**
+ * 以mmap的方式打开.tmap文件，按需解压单个tile
+ * 打开文件只需要读取文件头和tile索引，和地图的大小无关。
+ */
+class TiledMapFile
+{
+public:
+    TiledMapFile();
+    ~TiledMapFile();
+
+    bool Open(const std::string& path);
+    void Close();
+
+    bool IsOpen() const { return m_data != NULL; }
+    const TiledMapHeader& Header() const { return m_header; }
+
+    //tile(tx,ty)的索引 可以查看它的编码方式和压缩之后的大小
+    const TileIndexEntry& TileEntry(int tx,int ty) const { return m_index[tx + ty * m_header.tiles_x]; }
+
+    /**
+     * 解压一个tile到out中，out的大小为tile_size*tile_size
+     * 地图边缘的tile超出地图的部分不会被写入
+     */
+    bool LoadTile(int tx,int ty,unsigned char* out) const;
+
+    /**
+     * 只解压以世界坐标(x,y)为中心，半径为radius(米)内的tile，写到整张地图的缓冲区中
+     * map 的大小为width*height，没有被加载的区域保持不变
+     * @return 加载的tile的数量，出错返回-1
+     */
+    int LoadTilesNear(double x,double y,double radius,unsigned char* map) const;
+
+private:
+    bool DecodeTile(const TileIndexEntry& entry,unsigned char* out,int count) const;
+
+    TiledMapHeader m_header;
+    const TileIndexEntry* m_index;
+    const unsigned char* m_data;
+    size_t m_size;
+    int m_fd;
+
+    //禁止拷贝
+    TiledMapFile(const TiledMapFile&);
+    TiledMapFile& operator=(const TiledMapFile&);
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "occupany_mapping.h"
+#include "tiled_map.h"
 #include "nav_msgs/GetMap.h"
 #include "sensor_msgs/PointCloud.h"
 #include "sensor_msgs/PointCloud2.h"
@@ -272,6 +273,26 @@ void PublishMap(ros::Publisher& map_pub)
     map_pub.publish(rosMap);
 }
 
+//把地图保存为分块的二进制格式 重新加载的时候可以只加载机器人附近的tile
+bool SaveMap(const std::string& path)
+{
+    TiledMapHeader header;
+    header.width = mapParams.width;
+    header.height = mapParams.height;
+    header.offset_x = mapParams.offset_x;
+    header.offset_y = mapParams.offset_y;
+    header.resolution = mapParams.resolution;
+    header.origin_x = mapParams.origin_x;
+    header.origin_y = mapParams.origin_y;
+    header.tile_size = 256;
+
+    if(SaveTiledMap(path,header,pMap) == false)
+        return false;
+
+    std::cout <<"Save Map:"<<path<<std::endl;
+    return true;
+}
+
 void PubChampionScan(std::vector<GeneralLaserScan>& scans,std::vector<Eigen::Vector3d>& robot_poses,
                      ros::Publisher& ros_pub)
 {
@@ -380,6 +401,8 @@ int main(int argc, char** argv)
 
     OccupanyMapping(generalLaserScans,robotPoses);
 
+    SaveMap(basePath + "/map.tmap");
+
     PubChampionScan(generalLaserScans,robotPoses,laserPub);
 
     PublishMap(mapPub);
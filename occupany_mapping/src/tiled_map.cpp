@@ -0,0 +1,312 @@
+#include "tiled_map.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+//tile在地图中实际的宽和高 地图边缘的tile可能比tile_size小
+static void TileExtent(const TiledMapHeader& header,int tx,int ty,int& tw,int& th)
+{
+    tw = std::min(header.tile_size,header.width  - tx * header.tile_size);
+    th = std::min(header.tile_size,header.height - ty * header.tile_size);
+}
+
+//游程编码 每一段为(uint16 长度,uint8 值)
+static void EncodeRLE(const unsigned char* data,int count,std::vector<unsigned char>& out)
+{
+    out.clear();
+    int i = 0;
+    while(i < count)
+    {
+        unsigned char value = data[i];
+        int run = 1;
+        while(i + run < count && data[i + run] == value && run < 0xFFFF)
+            run++;
+
+        out.push_back(run & 0xFF);
+        out.push_back((run >> 8) & 0xFF);
+        out.push_back(value);
+        i += run;
+    }
+}
+
+static bool DecodeRLE(const unsigned char* data,size_t size,unsigned char* out,int count)
+{
+    int n = 0;
+    for(size_t i = 0; i + 3 <= size; i += 3)
+    {
+        int run = data[i] | (data[i + 1] << 8);
+        if(n + run > count)
+            return false;
+
+        memset(out + n,data[i + 2],run);
+        n += run;
+    }
+    return n == count;
+}
+
+
+bool SaveTiledMap(const std::string& path,TiledMapHeader header,const unsigned char* map)
+{
+    if(header.tile_size <= 0 || header.width <= 0 || header.height <= 0)
+    {
+        std::cout <<"Tiled Map:Invalid Map Size"<<std::endl;
+        return false;
+    }
+
+    header.magic = TILED_MAP_MAGIC;
+    header.version = TILED_MAP_VERSION;
+    header.tiles_x = (header.width  + header.tile_size - 1) / header.tile_size;
+    header.tiles_y = (header.height + header.tile_size - 1) / header.tile_size;
+
+    int tileNum = header.tiles_x * header.tiles_y;
+    std::vector<TileIndexEntry> index(tileNum);
+    std::vector<unsigned char> payload;
+
+    std::vector<unsigned char> tile(header.tile_size * header.tile_size);
+    std::vector<unsigned char> rle;
+
+    uint64_t offset = sizeof(TiledMapHeader) + sizeof(TileIndexEntry) * tileNum;
+
+    for(int ty = 0; ty < header.tiles_y; ty++)
+    {
+        for(int tx = 0; tx < header.tiles_x; tx++)
+        {
+            int tw,th;
+            TileExtent(header,tx,ty,tw,th);
+
+            //把tile的数据取出来 连续存储
+            for(int y = 0; y < th; y++)
+            {
+                const unsigned char* row = map + (ty * header.tile_size + y) * header.width + tx * header.tile_size;
+                memcpy(&tile[y * tw],row,tw);
+            }
+            int count = tw * th;
+
+            TileIndexEntry& entry = index[tx + ty * header.tiles_x];
+            memset(&entry,0,sizeof(entry));
+            entry.offset = offset + payload.size();
+
+            //整个tile都是同一个值 未知区域基本都是这种情况
+            if(std::count(tile.begin(),tile.begin() + count,tile[0]) == count)
+            {
+                entry.codec = TILE_CODEC_FILL;
+                entry.fill = tile[0];
+                entry.size = 0;
+                continue;
+            }
+
+            EncodeRLE(&tile[0],count,rle);
+            if(rle.size() < (size_t)count)
+            {
+                entry.codec = TILE_CODEC_RLE;
+                entry.size = rle.size();
+                payload.insert(payload.end(),rle.begin(),rle.end());
+            }
+            else
+            {
+                entry.codec = TILE_CODEC_RAW;
+                entry.size = count;
+                payload.insert(payload.end(),tile.begin(),tile.begin() + count);
+            }
+        }
+    }
+
+    FILE* fp = fopen(path.c_str(),"wb");
+    if(fp == NULL)
+    {
+        std::cout <<"Tiled Map:Open File Failed:"<<path<<std::endl;
+        return false;
+    }
+
+    bool good = fwrite(&header,sizeof(header),1,fp) == 1 &&
+                fwrite(&index[0],sizeof(TileIndexEntry),tileNum,fp) == (size_t)tileNum &&
+                (payload.empty() || fwrite(&payload[0],1,payload.size(),fp) == payload.size());
+    fclose(fp);
+
+    if(!good)
+        std::cout <<"Tiled Map:Write File Failed:"<<path<<std::endl;
+
+    return good;
+}
+
+
+TiledMapFile::TiledMapFile()
+{
+    memset(&m_header,0,sizeof(m_header));
+    m_index = NULL;
+    m_data = NULL;
+    m_size = 0;
+    m_fd = -1;
+}
+
+TiledMapFile::~TiledMapFile()
+{
+    Close();
+}
+
+bool TiledMapFile::Open(const std::string& path)
+{
+    Close();
+
+    m_fd = open(path.c_str(),O_RDONLY);
+    if(m_fd < 0)
+    {
+        std::cout <<"Tiled Map:Open File Failed:"<<path<<std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(m_fd,&st) != 0 || (size_t)st.st_size < sizeof(TiledMapHeader))
+    {
+        std::cout <<"Tiled Map:Invalid File:"<<path<<std::endl;
+        Close();
+        return false;
+    }
+
+    void* addr = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,m_fd,0);
+    if(addr == MAP_FAILED)
+    {
+        std::cout <<"Tiled Map:mmap Failed:"<<path<<std::endl;
+        Close();
+        return false;
+    }
+    m_data = (const unsigned char*)addr;
+    m_size = st.st_size;
+
+    memcpy(&m_header,m_data,sizeof(m_header));
+
+    size_t tileNum = (size_t)m_header.tiles_x * m_header.tiles_y;
+    if(m_header.magic != TILED_MAP_MAGIC ||
+       m_header.version != TILED_MAP_VERSION ||
+       m_header.tile_size <= 0 ||
+       m_header.width <= 0 || m_header.height <= 0 ||
+       !(m_header.resolution > 0) ||
+       m_header.tiles_x != (m_header.width  + m_header.tile_size - 1) / m_header.tile_size ||
+       m_header.tiles_y != (m_header.height + m_header.tile_size - 1) / m_header.tile_size ||
+       m_size < sizeof(TiledMapHeader) + tileNum * sizeof(TileIndexEntry))
+    {
+        std::cout <<"Tiled Map:Bad Header:"<<path<<std::endl;
+        Close();
+        return false;
+    }
+
+    m_index = (const TileIndexEntry*)(m_data + sizeof(TiledMapHeader));
+
+    return true;
+}
+
+void TiledMapFile::Close()
+{
+    if(m_data != NULL)
+        munmap((void*)m_data,m_size);
+    if(m_fd >= 0)
+        close(m_fd);
+
+    m_data = NULL;
+    m_index = NULL;
+    m_size = 0;
+    m_fd = -1;
+}
+
+bool TiledMapFile::DecodeTile(const TileIndexEntry& entry,unsigned char* out,int count) const
+{
+    if(entry.codec == TILE_CODEC_FILL)
+    {
+        memset(out,entry.fill,count);
+        return true;
+    }
+
+    if(entry.offset + entry.size > m_size)
+        return false;
+
+    const unsigned char* src = m_data + entry.offset;
+    if(entry.codec == TILE_CODEC_RAW)
+    {
+        if(entry.size != (uint32_t)count)
+            return false;
+        memcpy(out,src,count);
+        return true;
+    }
+    else if(entry.codec == TILE_CODEC_RLE)
+    {
+        return DecodeRLE(src,entry.size,out,count);
+    }
+
+    return false;
+}
+
+bool TiledMapFile::LoadTile(int tx,int ty,unsigned char* out) const
+{
+    if(!IsOpen() || tx < 0 || ty < 0 || tx >= m_header.tiles_x || ty >= m_header.tiles_y)
+        return false;
+
+    int tw,th;
+    TileExtent(m_header,tx,ty,tw,th);
+
+    //边缘的tile解压之后按tile_size的行宽重新排列
+    std::vector<unsigned char> tile(tw * th);
+    if(!DecodeTile(m_index[tx + ty * m_header.tiles_x],&tile[0],tw * th))
+        return false;
+
+    for(int y = 0; y < th; y++)
+        memcpy(out + y * m_header.tile_size,&tile[y * tw],tw);
+
+    return true;
+}
+
+int TiledMapFile::LoadTilesNear(double x,double y,double radius,unsigned char* map) const
+{
+    if(!IsOpen())
+        return -1;
+
+    //世界坐标转换为栅格下标 和ConvertWorld2GridIndex()一致
+    int cx = std::ceil((x - m_header.origin_x) / m_header.resolution) + m_header.offset_x;
+    int cy = std::ceil((y - m_header.origin_y) / m_header.resolution) + m_header.offset_y;
+    int r  = std::ceil(radius / m_header.resolution);
+
+    //窗口和地图没有重叠
+    if(cx + r < 0 || cy + r < 0 || cx - r >= m_header.width || cy - r >= m_header.height)
+        return 0;
+
+    //先限制在地图范围内再除 负数的除法是向0取整的
+    int tx0 = std::max(0,cx - r) / m_header.tile_size;
+    int ty0 = std::max(0,cy - r) / m_header.tile_size;
+    int tx1 = std::min(m_header.width  - 1,cx + r) / m_header.tile_size;
+    int ty1 = std::min(m_header.height - 1,cy + r) / m_header.tile_size;
+
+    std::vector<unsigned char> tile(m_header.tile_size * m_header.tile_size);
+
+    int cnt = 0;
+    for(int ty = ty0; ty <= ty1; ty++)
+    {
+        for(int tx = tx0; tx <= tx1; tx++)
+        {
+            int tw,th;
+            TileExtent(m_header,tx,ty,tw,th);
+
+            if(!DecodeTile(m_index[tx + ty * m_header.tiles_x],&tile[0],tw * th))
+            {
+                std::cout <<"Tiled Map:Decode Tile Failed:"<<tx<<","<<ty<<std::endl;
+                return -1;
+            }
+
+            for(int yy = 0; yy < th; yy++)
+            {
+                unsigned char* row = map + (ty * m_header.tile_size + yy) * m_header.width + tx * m_header.tile_size;
+                memcpy(row,&tile[yy * tw],tw);
+            }
+            cnt++;
+        }
+    }
+
+    return cnt;
+}
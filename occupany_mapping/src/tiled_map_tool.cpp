@@ -0,0 +1,365 @@
+/*
+ * 分块地图(.tmap)的离线工具 不依赖ROS
+ *
+ * 用法:
+ *   tiled_map_tool load <map.tmap> <x> <y> <radius>
+ *       打开地图 只加载世界坐标(x,y)附近radius(米)内的tile 输出加载的tile数量、已知栅格的数量和耗时
+ *   tiled_map_tool check
+ *       保存再加载几张人工构造的地图，检查FILL/RLE/RAW三种编码和地图边缘的tile都能原样恢复
+ *   tiled_map_tool bench [size] [resolution] [tile_size]
+ *       构造一张size*size(米)的地图，默认500m*500m、2cm，输出保存、打开、加载附近tile和加载整张地图的耗时
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <sys/stat.h>
+
+#include "tiled_map.h"
+
+//和occupany_mapping中的地图一样 50表示未知
+static const unsigned char UNKNOWN = 50;
+static const unsigned char FREE = 0;
+static const unsigned char OCCUPIED = 100;
+
+static double nowSec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long fileSize(const std::string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? (long)st.st_size : -1;
+}
+
+static TiledMapHeader makeHeader(int width, int height, double resolution, int tile_size)
+{
+    TiledMapHeader header;
+    memset(&header, 0, sizeof(header));
+    header.width = width;
+    header.height = height;
+    header.offset_x = width / 2;
+    header.offset_y = height / 2;
+    header.resolution = resolution;
+    header.origin_x = 0.0;
+    header.origin_y = 0.0;
+    header.tile_size = tile_size;
+    return header;
+}
+
+//统计各种编码的tile的数量
+static void countCodecs(const TiledMapFile& file, int counts[3])
+{
+    counts[0] = counts[1] = counts[2] = 0;
+    const TiledMapHeader& header = file.Header();
+    for(int ty = 0; ty < header.tiles_y; ty++)
+        for(int tx = 0; tx < header.tiles_x; tx++)
+        {
+            int codec = file.TileEntry(tx, ty).codec;
+            if(codec >= 0 && codec < 3)
+                counts[codec]++;
+        }
+}
+
+/*
+ * 仿真一张建好的地图：整张地图都是未知区域，中间一部分是探索过的走廊
+ * 走廊每隔corridor米一条，两边是墙，走廊中有少量噪声，让一部分tile只能用RAW编码
+ */
+static void buildMap(std::vector<unsigned char>& map, int width, int height, double resolution)
+{
+    map.assign((size_t)width * height, UNKNOWN);
+
+    int spacing = (int)(10.0 / resolution);     //走廊的间距10m
+    int half = (int)(1.0 / resolution);         //走廊宽2m
+    int x0 = width / 5, x1 = width - width / 5;
+    int y0 = height / 5, y1 = height - height / 5;
+
+    for(int y = y0; y < y1; y++)
+    {
+        unsigned char* row = &map[(size_t)y * width];
+        int dy = (y - y0) % spacing;
+        bool horizontal = dy <= half || dy >= spacing - half;
+        for(int x = x0; x < x1; x++)
+        {
+            int dx = (x - x0) % spacing;
+            bool vertical = dx <= half || dx >= spacing - half;
+            if(horizontal || vertical)
+                row[x] = FREE;
+        }
+    }
+
+    //走廊的边界为墙
+    for(int y = y0 + 1; y < y1 - 1; y++)
+        for(int x = x0 + 1; x < x1 - 1; x++)
+        {
+            size_t i = (size_t)y * width + x;
+            if(map[i] == UNKNOWN &&
+               (map[i - 1] == FREE || map[i + 1] == FREE || map[i - width] == FREE || map[i + width] == FREE))
+                map[i] = OCCUPIED;
+        }
+
+    //地图中心附近20m*20m的区域为噪声比较大的区域
+    int n = (int)(10.0 / resolution);
+    srand(1);
+    for(int y = height / 2 - n; y < height / 2 + n; y++)
+        for(int x = width / 2 - n; x < width / 2 + n; x++)
+            if(y >= 0 && y < height && x >= 0 && x < width)
+                map[(size_t)y * width + x] = rand() % 101;
+}
+
+
+/////////////////////////////////////////load////////////////////////////////////////////////
+
+static int loadMap(const std::string& path, double x, double y, double radius)
+{
+    double t0 = nowSec();
+    TiledMapFile file;
+    if(!file.Open(path))
+        return 1;
+    double t_open = nowSec() - t0;
+
+    const TiledMapHeader& header = file.Header();
+    printf("map %d x %d  resolution %.3f  tile %d  tiles %d x %d  file %ld bytes\n",
+           header.width, header.height, header.resolution, header.tile_size,
+           header.tiles_x, header.tiles_y, fileSize(path));
+
+    int codecs[3];
+    countCodecs(file, codecs);
+    printf("tiles raw %d  fill %d  rle %d\n", codecs[TILE_CODEC_RAW], codecs[TILE_CODEC_FILL], codecs[TILE_CODEC_RLE]);
+
+    std::vector<unsigned char> map((size_t)header.width * header.height, UNKNOWN);
+    t0 = nowSec();
+    int cnt = file.LoadTilesNear(x, y, radius, &map[0]);
+    double t_load = nowSec() - t0;
+    if(cnt < 0)
+        return 1;
+
+    size_t known = 0;
+    for(size_t i = 0; i < map.size(); i++)
+        known += map[i] != UNKNOWN;
+
+    printf("open %.3f ms  load %d tiles near (%.2f,%.2f) r=%.1f in %.3f ms  known cells %lu\n",
+           t_open * 1e3, cnt, x, y, radius, t_load * 1e3, (unsigned long)known);
+    return 0;
+}
+
+
+/////////////////////////////////////////check////////////////////////////////////////////////
+
+//LoadTile()读出来的tile和地图中对应的区域是否一样 边缘的tile只有左上角的部分有效
+static bool tileMatches(const TiledMapHeader& h, const std::vector<unsigned char>& map, int tx, int ty,
+                        const std::vector<unsigned char>& tile)
+{
+    for(int y = 0; y < h.tile_size && ty * h.tile_size + y < h.height; y++)
+        for(int x = 0; x < h.tile_size && tx * h.tile_size + x < h.width; x++)
+            if(tile[y * h.tile_size + x] != map[(size_t)(ty * h.tile_size + y) * h.width + tx * h.tile_size + x])
+                return false;
+    return true;
+}
+
+//保存map再用LoadTile和LoadTilesNear读回来 和原来的地图比较
+static bool roundTrip(const char* name, const std::vector<unsigned char>& map, const TiledMapHeader& header,
+                      const std::string& path, bool needRaw)
+{
+    if(!SaveTiledMap(path, header, &map[0]))
+        return false;
+
+    TiledMapFile file;
+    if(!file.Open(path))
+        return false;
+
+    bool good = true;
+    int codecs[3];
+    countCodecs(file, codecs);
+    if(codecs[TILE_CODEC_FILL] == 0 || codecs[TILE_CODEC_RLE] == 0 || (needRaw && codecs[TILE_CODEC_RAW] == 0))
+    {
+        printf("%s: expected every codec, got raw %d fill %d rle %d\n", name,
+               codecs[TILE_CODEC_RAW], codecs[TILE_CODEC_FILL], codecs[TILE_CODEC_RLE]);
+        good = false;
+    }
+
+    //整张地图
+    const TiledMapHeader& h = file.Header();
+    std::vector<unsigned char> loaded(map.size(), 255);
+    double radius = (h.width + h.height) * h.resolution;
+    int cnt = file.LoadTilesNear(0.0, 0.0, radius, &loaded[0]);
+    if(cnt != h.tiles_x * h.tiles_y || loaded != map)
+    {
+        printf("%s: full load mismatch (%d tiles)\n", name, cnt);
+        good = false;
+    }
+
+    //单个tile
+    std::vector<unsigned char> tile(h.tile_size * h.tile_size);
+    for(int ty = 0; ty < h.tiles_y && good; ty++)
+        for(int tx = 0; tx < h.tiles_x && good; tx++)
+        {
+            if(!file.LoadTile(tx, ty, &tile[0]) || !tileMatches(h, map, tx, ty, tile))
+            {
+                printf("%s: tile (%d,%d) mismatch\n", name, tx, ty);
+                good = false;
+            }
+        }
+
+    //只加载一个角附近的tile 其他的区域不能被修改
+    std::fill(loaded.begin(), loaded.end(), 255);
+    double cx = (0 - h.offset_x) * h.resolution + h.origin_x;
+    double cy = (0 - h.offset_y) * h.resolution + h.origin_y;
+    cnt = file.LoadTilesNear(cx, cy, h.resolution, &loaded[0]);
+    for(int y = 0; y < h.height && good; y++)
+        for(int x = 0; x < h.width; x++)
+        {
+            bool inTile = x < h.tile_size && y < h.tile_size;
+            unsigned char expect = inTile ? map[(size_t)y * h.width + x] : 255;
+            if(loaded[(size_t)y * h.width + x] != expect)
+            {
+                printf("%s: partial load mismatch at (%d,%d)\n", name, x, y);
+                good = false;
+                break;
+            }
+        }
+    if(good && cnt != 1)
+    {
+        printf("%s: partial load returned %d tiles\n", name, cnt);
+        good = false;
+    }
+
+    //和地图没有重叠的查询
+    if(good && file.LoadTilesNear(cx - 100.0, cy - 100.0, 1.0, &loaded[0]) != 0)
+    {
+        printf("%s: off-map query loaded tiles\n", name);
+        good = false;
+    }
+
+    printf("%-28s %s  raw %d  fill %d  rle %d  %ld bytes\n", name, good ? "ok  " : "FAIL",
+           codecs[TILE_CODEC_RAW], codecs[TILE_CODEC_FILL], codecs[TILE_CODEC_RLE], fileSize(path));
+    return good;
+}
+
+static int checkMaps()
+{
+    std::string path = "/tmp/tiled_map_check.tmap";
+    bool good = true;
+
+    //大小不是tile_size的整数倍 边缘的tile比较小
+    {
+        TiledMapHeader header = makeHeader(1000, 700, 0.05, 128);
+        std::vector<unsigned char> map;
+        buildMap(map, header.width, header.height, header.resolution);
+        good &= roundTrip("corridors 1000x700/128", map, header, path, true);
+    }
+
+    //一个tile中超过65535个栅格的游程要被拆成多段
+    {
+        TiledMapHeader header = makeHeader(1200, 1030, 0.05, 512);
+        std::vector<unsigned char> map((size_t)header.width * header.height, UNKNOWN);
+        for(int y = 0; y < header.height; y++)
+            for(int x = 0; x < header.width; x++)
+            {
+                unsigned char& c = map[(size_t)y * header.width + x];
+                if(x < 512 && y < 512 && (x != 511 || y != 511))
+                    c = FREE;                               //一个长度为512*512-1的游程
+                else if(x >= 512 && x < 1024 && y < 512)
+                    c = (unsigned char)(rand() % 101);      //RAW
+            }
+        good &= roundTrip("long runs 1200x1030/512", map, header, path, true);
+    }
+
+    //只有一行和一列的地图
+    {
+        TiledMapHeader header = makeHeader(300, 1, 0.05, 64);
+        std::vector<unsigned char> map(300, UNKNOWN);
+        for(int x = 100; x < 140; x++)
+            map[x] = x < 120 ? FREE : OCCUPIED;
+        good &= roundTrip("single row 300x1/64", map, header, path, false);
+    }
+
+    remove(path.c_str());
+    printf("%s\n", good ? "all round trips ok" : "round trip FAILED");
+    return good ? 0 : 1;
+}
+
+
+/////////////////////////////////////////bench////////////////////////////////////////////////
+
+static int benchMap(double size, double resolution, int tile_size)
+{
+    int width = (int)std::ceil(size / resolution);
+    TiledMapHeader header = makeHeader(width, width, resolution, tile_size);
+    printf("map %.0fm x %.0fm  resolution %.3f  %d x %d cells  tile %d  raw %.1f MB\n",
+           size, size, resolution, width, width, tile_size, (double)width * width / 1e6);
+
+    std::vector<unsigned char> map;
+    buildMap(map, width, width, resolution);
+
+    std::string path = "/tmp/tiled_map_bench.tmap";
+    double t0 = nowSec();
+    if(!SaveTiledMap(path, header, &map[0]))
+        return 1;
+    double t_save = nowSec() - t0;
+
+    t0 = nowSec();
+    TiledMapFile file;
+    if(!file.Open(path))
+        return 1;
+    double t_open = nowSec() - t0;
+
+    int codecs[3];
+    countCodecs(file, codecs);
+    printf("save %.0f ms  file %.2f MB  tiles raw %d  fill %d  rle %d\n",
+           t_save * 1e3, fileSize(path) / 1e6, codecs[TILE_CODEC_RAW], codecs[TILE_CODEC_FILL], codecs[TILE_CODEC_RLE]);
+
+    //机器人在走廊的交叉口 加载激光范围内的tile
+    std::vector<unsigned char> loaded(map.size(), UNKNOWN);
+    double x = -size * 0.3, y = -size * 0.3;
+    t0 = nowSec();
+    int near = file.LoadTilesNear(x, y, 30.0, &loaded[0]);
+    double t_near = nowSec() - t0;
+
+    t0 = nowSec();
+    int all = file.LoadTilesNear(0.0, 0.0, size * 2.0, &loaded[0]);
+    double t_all = nowSec() - t0;
+
+    bool same = loaded == map;
+    printf("open %.3f ms  load %d tiles (r=30m) %.2f ms  load all %d tiles %.0f ms  round trip %s\n",
+           t_open * 1e3, near, t_near * 1e3, all, t_all * 1e3, same ? "ok" : "FAIL");
+
+    file.Close();
+    remove(path.c_str());
+    return same ? 0 : 1;
+}
+
+
+int main(int argc, char** argv)
+{
+    std::string cmd = argc > 1 ? argv[1] : "";
+
+    if(cmd == "load" && argc == 6)
+        return loadMap(argv[2], atof(argv[3]), atof(argv[4]), atof(argv[5]));
+
+    if(cmd == "check")
+        return checkMaps();
+
+    if(cmd == "bench")
+    {
+        double size       = argc > 2 ? atof(argv[2]) : 500.0;
+        double resolution = argc > 3 ? atof(argv[3]) : 0.02;
+        int tile_size     = argc > 4 ? atoi(argv[4]) : 256;
+        if(size > 0 && resolution > 0 && tile_size > 0)
+            return benchMap(size, resolution, tile_size);
+    }
+
+    printf("usage: %s load <map.tmap> <x> <y> <radius>\n", argv[0]);
+    printf("       %s check\n", argv[0]);
+    printf("       %s bench [size] [resolution] [tile_size]\n", argv[0]);
+    return 1;
+}